@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 
 #include "aws_iot_config.h"
@@ -10,13 +15,62 @@
 #include "aws_iot_shadow_interface.h"
 
 #include "awsclient.h"
+#include "awsclient_arena.h"
 
 #define TAG  "AWSCLIENT"
 
+#define AWSCLIENT_TASK_STACK_SIZE (CONFIG_AWSCLIENT_TASK_STACK_SIZE)
+#define AWSCLIENT_INFLIGHT_MAX    (CONFIG_AWSCLIENT_INFLIGHT_MAX)
+#define AWSCLIENT_QUEUE_LEN       (CONFIG_AWSCLIENT_QUEUE_LEN)
+#define AWSCLIENT_YIELD_MS        (CONFIG_AWSCLIENT_YIELD_MS)
+
+typedef enum {
+  AWSCLIENT_REQ_SHADOW_UPDATE = 0,
+  AWSCLIENT_REQ_PUBLISH,
+} awsclient_req_type_t;
+
+typedef struct {
+  awsclient_req_type_t type;
+  const char *topic;
+  const void *payload;
+  size_t payloadLen;
+  awsclient_done_cb_t cb;
+  void *ctx;
+} awsclient_req_t;
+
+// a shadow update waiting for accepted/rejected
+typedef struct {
+  bool used;
+  awsclient_done_cb_t cb;
+  void *ctx;
+} awsclient_inflight_t;
+
 static AWS_IoT_Client s_aws_client;
 static IoT_Error_t res = FAILURE;
 static volatile uint8_t s_updateInProgress = 0;
 
+/* network task. created once, it owns s_aws_client between awsclient_start() and awsclient_stop() */
+static StackType_t s_task_stack[AWSCLIENT_TASK_STACK_SIZE];
+static StaticTask_t s_task_buffer;
+static TaskHandle_t s_task = NULL;
+static uint8_t s_queue_storage[AWSCLIENT_QUEUE_LEN * sizeof(awsclient_req_t)];
+static StaticQueue_t s_queue_buffer;
+static QueueHandle_t s_queue = NULL;
+static StaticSemaphore_t s_idle_buffer;
+static SemaphoreHandle_t s_idle = NULL;
+static StaticSemaphore_t s_stopped_buffer;
+static SemaphoreHandle_t s_stopped = NULL;
+static awsclient_config_t *s_config = NULL;
+static volatile bool s_running = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+// requests queued or in flight
+static uint32_t s_outstanding = 0;
+static awsclient_inflight_t s_inflight[AWSCLIENT_INFLIGHT_MAX];
+// messages on update/documents since the connection
+static volatile uint32_t s_documents = 0;
+static StaticSemaphore_t s_documents_buffer;
+static SemaphoreHandle_t s_documents_sem = NULL;
+
 static char s_topic_delete_accepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 static char s_topic_delete_rejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 static char s_topic_get_accepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
@@ -33,10 +87,46 @@ static void awsclient_shadow_callback(AWS_IoT_Client *pClient, char *pTopicName,
 static uint8_t awsclient_is_updating_shadow(void);
 static void shadow_update_status_cb(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
                                     const char *pReceivedJsonDocument, void *pContextData);
+static void awsclient_session_free(void);
+static void awsclient_task(void *param);
+static esp_err_t awsclient_enqueue(awsclient_req_t *req);
+static void awsclient_done(awsclient_done_cb_t cb, void *ctx, IoT_Error_t err);
 
 
+void awsclient_shadow_register_delta(awsclient_config_t *config, jsonStruct_t *delta)
+{
+  res = aws_iot_shadow_register_delta(&s_aws_client, delta);
+  if (res != SUCCESS) {
+    ESP_LOGE(TAG, "aws_iot_shadow_register_delta %s failed: return value = %d", delta->pKey, res);
+  }
+}
+
+void awsclient_yield(awsclient_config_t *config, uint32_t timeout_ms)
+{
+  res = aws_iot_shadow_yield(&s_aws_client, timeout_ms);
+  if (res != SUCCESS && res != NETWORK_ATTEMPTING_RECONNECT) {
+    ESP_LOGE(TAG, "aws_iot_shadow_yield failed: return value = %d", res);
+  }
+}
+
+void awsclient_publish(awsclient_config_t *config, const char *topic, const void *payload, size_t payloadLen)
+{
+  IoT_Publish_Message_Params params = {
+    .qos = QOS1,
+    .isRetained = 0,
+    .payload = (void *) payload,
+    .payloadLen = payloadLen,
+  };
+  res = aws_iot_mqtt_publish(&s_aws_client, topic, (uint16_t) strlen(topic), &params);
+  if (res != SUCCESS) {
+    ESP_LOGE(TAG, "aws_iot_mqtt_publish %s failed: return value = %d", topic, res);
+  }
+}
+
 void awsclient_shadow_init(awsclient_config_t *config)
 {
+  awsclient_arena_init();
+  s_documents = 0;
   res = aws_iot_shadow_init(&s_aws_client, &(config->shadow_params));
   ESP_LOGI(TAG, "Shadow init: host = %s, port = %d", config->shadow_params.pHost, config->shadow_params.port);
   if (res != SUCCESS) {
@@ -109,11 +199,21 @@ static void _awsclient_shadow_subscribe_topic(awsclient_config_t *config, char *
   }
 }
 
+// the mutexes of the SDK and the TLS session. aws_iot_shadow_init() over a session which is
+// not freed leaks them, and the leak keeps the arena from being reset.
+static void awsclient_session_free(void)
+{
+  aws_iot_mqtt_free(&s_aws_client);
+  // the TLS session is freed. start the next handshake with an empty arena.
+  awsclient_arena_reset();
+}
+
 void awsclient_shadow_deinit(awsclient_config_t *config)
 {
   aws_iot_shadow_disconnect(&s_aws_client);
   aws_iot_mqtt_free(&s_aws_client);
   aws_iot_shadow_free(&s_aws_client);
+  awsclient_arena_reset();
   s_updateInProgress = 0;
   res = FAILURE;
 }
@@ -122,7 +222,7 @@ void awsclient_shadow_update(awsclient_config_t *config, char *jsonBuffer, size_
 {
   if (!aws_iot_mqtt_is_client_connected(&s_aws_client)) {
     ESP_LOGI(TAG, "aws_iot_mqtt client was not connected. re-initialize it.");
-    aws_iot_mqtt_free(&s_aws_client);
+    awsclient_session_free();
     awsclient_shadow_init(config);
   }
   res = aws_iot_shadow_update(&s_aws_client, config->shadow_connect_params.pMyThingName, jsonBuffer,
@@ -139,6 +239,13 @@ void awsclient_shadow_callback(AWS_IoT_Client *pClient, char *pTopicName, uint16
 									  IoT_Publish_Message_Params *pParams, void *pClientData)
 {
   ESP_LOGI(TAG, "[%s] callback: ", pTopicName);
+  if (topicNameLen == strlen(s_topic_update_documents)
+      && strncmp(pTopicName, s_topic_update_documents, topicNameLen) == 0) {
+    s_documents++;
+    if (s_documents_sem != NULL) {
+      xSemaphoreGive(s_documents_sem);
+    }
+  }
 }
 
 static uint8_t awsclient_is_updating_shadow(void)
@@ -157,10 +264,23 @@ void shadow_update_status_cb(const char *pThingName, ShadowActions_t action, Sha
   IOT_UNUSED(pThingName);
   IOT_UNUSED(action);
   IOT_UNUSED(pReceivedJsonDocument);
-  IOT_UNUSED(pContextData);
 
   s_updateInProgress = false;
 
+  if (pContextData != NULL) {
+    awsclient_inflight_t *inflight = (awsclient_inflight_t *) pContextData;
+    IoT_Error_t err = SUCCESS;
+    if (SHADOW_ACK_TIMEOUT == status) {
+      err = MQTT_REQUEST_TIMEOUT_ERROR;
+    } else if (SHADOW_ACK_REJECTED == status) {
+      err = FAILURE;
+    }
+    if (inflight->used) {
+      inflight->used = false;
+      awsclient_done(inflight->cb, inflight->ctx, err);
+    }
+  }
+
   if(SHADOW_ACK_TIMEOUT == status) {
     ESP_LOGE(TAG, "Update timed out");
   } else if(SHADOW_ACK_REJECTED == status) {
@@ -171,245 +291,495 @@ void shadow_update_status_cb(const char *pThingName, ShadowActions_t action, Sha
 }
 
 
+esp_err_t awsclient_start(awsclient_config_t *config)
+{
+  if (s_task == NULL) {
+    s_queue = xQueueCreateStatic(AWSCLIENT_QUEUE_LEN, sizeof(awsclient_req_t),
+                                 s_queue_storage, &s_queue_buffer);
+    s_idle = xSemaphoreCreateBinaryStatic(&s_idle_buffer);
+    s_stopped = xSemaphoreCreateBinaryStatic(&s_stopped_buffer);
+    s_documents_sem = xSemaphoreCreateBinaryStatic(&s_documents_buffer);
+    s_task = xTaskCreateStatic(awsclient_task, "awsclient", AWSCLIENT_TASK_STACK_SIZE, NULL, 5,
+                               s_task_stack, &s_task_buffer);
+  }
+  if (s_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_config = config;
+  s_running = true;
+  xTaskNotifyGive(s_task);
+  return ESP_OK;
+}
+
+void awsclient_stop(void)
+{
+  if (!s_running) {
+    return;
+  }
+  xSemaphoreTake(s_stopped, 0);
+  // the task leaves its loop within AWSCLIENT_YIELD_MS
+  s_running = false;
+  xSemaphoreTake(s_stopped, portMAX_DELAY);
+}
+
+esp_err_t awsclient_shadow_update_async(const char *jsonBuffer, awsclient_done_cb_t cb, void *ctx)
+{
+  awsclient_req_t req = {
+    .type = AWSCLIENT_REQ_SHADOW_UPDATE,
+    .payload = jsonBuffer,
+    .cb = cb,
+    .ctx = ctx,
+  };
+  return awsclient_enqueue(&req);
+}
+
+esp_err_t awsclient_publish_async(const char *topic, const void *payload, size_t payloadLen,
+                                  awsclient_done_cb_t cb, void *ctx)
+{
+  awsclient_req_t req = {
+    .type = AWSCLIENT_REQ_PUBLISH,
+    .topic = topic,
+    .payload = payload,
+    .payloadLen = payloadLen,
+    .cb = cb,
+    .ctx = ctx,
+  };
+  return awsclient_enqueue(&req);
+}
+
+esp_err_t awsclient_flush(TickType_t timeout)
+{
+  TimeOut_t t;
+  vTaskSetTimeOutState(&t);
+  while (true) {
+    portENTER_CRITICAL(&s_lock);
+    uint32_t outstanding = s_outstanding;
+    portEXIT_CRITICAL(&s_lock);
+    if (outstanding == 0) {
+      return ESP_OK;
+    }
+    if (xTaskCheckForTimeOut(&t, &timeout) == pdTRUE
+        || xSemaphoreTake(s_idle, timeout) != pdTRUE) {
+      ESP_LOGW(TAG, "flush timed out, %u requests outstanding", outstanding);
+      return ESP_ERR_TIMEOUT;
+    }
+  }
+}
+
+esp_err_t awsclient_wait_documents(uint32_t count, TickType_t timeout)
+{
+  TimeOut_t t;
+  vTaskSetTimeOutState(&t);
+  while (s_documents < count) {
+    if (xTaskCheckForTimeOut(&t, &timeout) == pdTRUE
+        || xSemaphoreTake(s_documents_sem, timeout) != pdTRUE) {
+      return ESP_ERR_TIMEOUT;
+    }
+  }
+  return ESP_OK;
+}
+
+static esp_err_t awsclient_enqueue(awsclient_req_t *req)
+{
+  if (!s_running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  portENTER_CRITICAL(&s_lock);
+  s_outstanding++;
+  portEXIT_CRITICAL(&s_lock);
+  if (xQueueSend(s_queue, req, 0) != pdTRUE) {
+    portENTER_CRITICAL(&s_lock);
+    s_outstanding--;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+static void awsclient_done(awsclient_done_cb_t cb, void *ctx, IoT_Error_t err)
+{
+  uint32_t outstanding;
+  if (cb != NULL) {
+    cb(err, ctx);
+  }
+  portENTER_CRITICAL(&s_lock);
+  outstanding = --s_outstanding;
+  portEXIT_CRITICAL(&s_lock);
+  if (outstanding == 0) {
+    xSemaphoreGive(s_idle);
+  }
+}
+
+static awsclient_inflight_t *awsclient_inflight_get(void)
+{
+  for (int i = 0; i < AWSCLIENT_INFLIGHT_MAX; i++) {
+    if (!s_inflight[i].used) {
+      return &s_inflight[i];
+    }
+  }
+  return NULL;
+}
+
+static bool awsclient_inflight_any(void)
+{
+  for (int i = 0; i < AWSCLIENT_INFLIGHT_MAX; i++) {
+    if (s_inflight[i].used) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// false if the request has to wait: aws_iot_shadow_init() clears the ack records of the SDK,
+// so the session is set up again only once the other updates are acked or timed out
+static bool awsclient_process_shadow_update(awsclient_req_t *req, awsclient_inflight_t *inflight)
+{
+  for (int retry = 0; retry < 2; retry++) {
+    if (!aws_iot_mqtt_is_client_connected(&s_aws_client)) {
+      if (awsclient_inflight_any()) {
+        return false;
+      }
+      ESP_LOGI(TAG, "aws_iot_mqtt client was not connected. re-initialize it.");
+      awsclient_session_free();
+      awsclient_shadow_init(s_config);
+    }
+    // the ack is processed by the yield of the task and completes the in-flight slot
+    res = aws_iot_shadow_update(&s_aws_client, s_config->shadow_connect_params.pMyThingName,
+                                (char *) req->payload, shadow_update_status_cb, inflight,
+                                s_config->timeout_sec, true);
+    if (res != NETWORK_SSL_WRITE_ERROR || awsclient_inflight_any()) {
+      break;
+    }
+    // the session is broken. free it, without a DISCONNECT which can not be written, and
+    // connect again once.
+    ESP_LOGI(TAG, "SSL write error. re-initialize the client.");
+    awsclient_session_free();
+    awsclient_shadow_init(s_config);
+  }
+  if (res != SUCCESS) {
+    ESP_LOGE(TAG, "aws_iot_shadow_update failed: return value = %d", res);
+    awsclient_done(req->cb, req->ctx, res);
+    return true;
+  }
+  inflight->used = true;
+  inflight->cb = req->cb;
+  inflight->ctx = req->ctx;
+  return true;
+}
+
+static void awsclient_abort_inflight(void)
+{
+  for (int i = 0; i < AWSCLIENT_INFLIGHT_MAX; i++) {
+    if (s_inflight[i].used) {
+      s_inflight[i].used = false;
+      awsclient_done(s_inflight[i].cb, s_inflight[i].ctx, MQTT_REQUEST_TIMEOUT_ERROR);
+    }
+  }
+}
+
+static void awsclient_task(void *param)
+{
+  awsclient_req_t req;
+  bool pending = false;
+  awsclient_inflight_t *inflight;
+
+  while (true) {
+    // started by awsclient_start()
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // a reconnect handshakes on this task
+    awsclient_arena_own();
+    while (s_running) {
+      if (!pending) {
+        // the yield below is the wait of the loop when connected
+        TickType_t wait = aws_iot_mqtt_is_client_connected(&s_aws_client) ? 0 : pdMS_TO_TICKS(AWSCLIENT_YIELD_MS);
+        pending = (xQueueReceive(s_queue, &req, wait) == pdTRUE);
+      }
+      if (pending) {
+        switch (req.type) {
+        case AWSCLIENT_REQ_SHADOW_UPDATE:
+          inflight = awsclient_inflight_get();
+          if (inflight == NULL) {
+            // the window is full. wait for an ack.
+            break;
+          }
+          if (!awsclient_process_shadow_update(&req, inflight)) {
+            // the session was lost with updates in flight
+            break;
+          }
+          pending = false;
+          break;
+        case AWSCLIENT_REQ_PUBLISH:
+          // the SDK waits for PUBACK of QoS1 in aws_iot_mqtt_publish(), and drops a PUBACK
+          // read by the yield, so plain publishes are not in the window: one round trip each
+          awsclient_publish(s_config, req.topic, req.payload, req.payloadLen);
+          awsclient_done(req.cb, req.ctx, res);
+          pending = false;
+          break;
+        }
+      }
+      if (aws_iot_mqtt_is_client_connected(&s_aws_client)) {
+        IoT_Error_t err = aws_iot_shadow_yield(&s_aws_client, AWSCLIENT_YIELD_MS);
+        if (err != SUCCESS && err != NETWORK_ATTEMPTING_RECONNECT) {
+          ESP_LOGD(TAG, "aws_iot_shadow_yield returns %d", err);
+        }
+      } else if (pending) {
+        // times out the acks of the lost session, which frees their slots
+        aws_iot_shadow_yield(&s_aws_client, 0);
+        vTaskDelay(pdMS_TO_TICKS(AWSCLIENT_YIELD_MS));
+      }
+    }
+    // not acked or not even sent within the wait of the caller
+    awsclient_abort_inflight();
+    if (pending) {
+      awsclient_done(req.cb, req.ctx, FAILURE);
+      pending = false;
+    }
+    while (xQueueReceive(s_queue, &req, 0) == pdTRUE) {
+      awsclient_done(req.cb, req.ctx, FAILURE);
+    }
+    xSemaphoreGive(s_stopped);
+  }
+}
+
 void awsclient_log_error(IoT_Error_t err)
 {
   switch(err) {
 	/** Returned when the Network physical layer is connected */
   case(NETWORK_PHYSICAL_LAYER_CONNECTED):
-    ESP_LOGI(TAG, "NETWORK_PHYSICAL_LAYER_CONNECTED");
+    ESP_LOGD(TAG, "NETWORK_PHYSICAL_LAYER_CONNECTED");
     break;
 	/** Returned when the Network is manually disconnected */
   case(NETWORK_MANUALLY_DISCONNECTED):
-    ESP_LOGI(TAG, "NETWORK_MANUALLY_DISCONNECTED");
+    ESP_LOGD(TAG, "NETWORK_MANUALLY_DISCONNECTED");
       break;
 	/** Returned when the Network is disconnected and the reconnect attempt is in progress */
   case(NETWORK_ATTEMPTING_RECONNECT):
-    ESP_LOGI(TAG, "NETWORK_ATTEMPTING_RECONNECT");
+    ESP_LOGW(TAG, "NETWORK_ATTEMPTING_RECONNECT");
     break;
 	/** Return value of yield function to indicate auto-reconnect was successful */
   case(NETWORK_RECONNECTED):
-    ESP_LOGI(TAG, "NETWORK_RECONNECTED");
+    ESP_LOGD(TAG, "NETWORK_RECONNECTED");
     break;
 	/** Returned when a read attempt is made on the TLS buffer and it is empty */
   case(MQTT_NOTHING_TO_READ):
-    ESP_LOGI(TAG, "MQTT_NOTHING_TO_READ");
+    ESP_LOGD(TAG, "MQTT_NOTHING_TO_READ");
     break;
 	/** Returned when a connection request is successful and packet response is connection accepted */
   case(MQTT_CONNACK_CONNECTION_ACCEPTED):
-    ESP_LOGI(TAG, "MQTT_CONNACK_CONNECTION_ACCEPTED");
+    ESP_LOGD(TAG, "MQTT_CONNACK_CONNECTION_ACCEPTED");
     break;
     /** Success return value - no error occurred */
   case(SUCCESS):
-    ESP_LOGI(TAG, "SUCCESS");
+    ESP_LOGD(TAG, "SUCCESS");
     break;
     /** A generic error. Not enough information for a specific error code */
   case(FAILURE):
-    ESP_LOGI(TAG, "FAILURE");
+    ESP_LOGE(TAG, "FAILURE");
     break;
     /** A required parameter was passed as null */
   case(NULL_VALUE_ERROR):
-    ESP_LOGI(TAG, "NULL_VALUE_ERROR");
+    ESP_LOGE(TAG, "NULL_VALUE_ERROR");
     break;
     /** The TCP socket could not be established */
   case(TCP_CONNECTION_ERROR):
-    ESP_LOGI(TAG, "TCP_CONNECTION_ERROR");
+    ESP_LOGE(TAG, "TCP_CONNECTION_ERROR");
     break;
     /** The TLS handshake failed */
   case(SSL_CONNECTION_ERROR):
-    ESP_LOGI(TAG, "SSL_CONNECTION_ERROR");
+    ESP_LOGE(TAG, "SSL_CONNECTION_ERROR");
     break;
     /** Error associated with setting up the parameters of a Socket */
   case(TCP_SETUP_ERROR):
-    ESP_LOGI(TAG, "TCP_SETUP_ERROR");
+    ESP_LOGE(TAG, "TCP_SETUP_ERROR");
     break;
     /** A timeout occurred while waiting for the TLS handshake to complete. */
   case(NETWORK_SSL_CONNECT_TIMEOUT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_CONNECT_TIMEOUT_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_CONNECT_TIMEOUT_ERROR");
     break;
     /** A Generic write error based on the platform used */
   case(NETWORK_SSL_WRITE_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_WRITE_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_WRITE_ERROR");
     break;
     /** SSL initialization error at the TLS layer */
   case(NETWORK_SSL_INIT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_INIT_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_INIT_ERROR");
     break;
     /** An error occurred when loading the certificates.  The certificates could not be located or are incorrectly formatted. */
   case(NETWORK_SSL_CERT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_CERT_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_CERT_ERROR");
     break;
     /** SSL Write times out */
   case(NETWORK_SSL_WRITE_TIMEOUT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_WRITE_TIMEOUT_ERROR");
+    ESP_LOGW(TAG, "NETWORK_SSL_WRITE_TIMEOUT_ERROR");
     break;
     /** SSL Read times out */
   case(NETWORK_SSL_READ_TIMEOUT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_READ_TIMEOUT_ERROR");
+    ESP_LOGW(TAG, "NETWORK_SSL_READ_TIMEOUT_ERROR");
     break;
     /** A Generic error based on the platform used */
   case(NETWORK_SSL_READ_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_READ_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_READ_ERROR");
     break;
     /** Returned when the Network is disconnected and reconnect is either disabled or physical layer is disconnected */
   case(NETWORK_DISCONNECTED_ERROR):
-    ESP_LOGI(TAG, "NETWORK_DISCONNECTED_ERROR");
+    ESP_LOGW(TAG, "NETWORK_DISCONNECTED_ERROR");
     break;
     /** Returned when the Network is disconnected and the reconnect attempt has timed out */
   case(NETWORK_RECONNECT_TIMED_OUT_ERROR):
-    ESP_LOGI(TAG, "NETWORK_RECONNECT_TIMED_OUT_ERROR");
+    ESP_LOGE(TAG, "NETWORK_RECONNECT_TIMED_OUT_ERROR");
     break;
     /** Returned when the Network is already connected and a connection attempt is made */
   case(NETWORK_ALREADY_CONNECTED_ERROR):
-    ESP_LOGI(TAG, "NETWORK_ALREADY_CONNECTED_ERROR");
+    ESP_LOGW(TAG, "NETWORK_ALREADY_CONNECTED_ERROR");
     break;
 	/** Network layer Error Codes */
 	/** Network layer Random number generator seeding failed */
   case(NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED):
-    ESP_LOGI(TAG, "NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED");
+    ESP_LOGE(TAG, "NETWORK_MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED");
     break;
 	/** A generic error code for Network layer errors */
   case(NETWORK_SSL_UNKNOWN_ERROR):
-    ESP_LOGI(TAG, "NETWORK_SSL_UNKNOWN_ERROR");
+    ESP_LOGE(TAG, "NETWORK_SSL_UNKNOWN_ERROR");
     break;
 	/** Returned when the physical layer is disconnected */
   case(NETWORK_PHYSICAL_LAYER_DISCONNECTED):
-    ESP_LOGI(TAG, "NETWORK_PHYSICAL_LAYER_DISCONNECTED");
+    ESP_LOGW(TAG, "NETWORK_PHYSICAL_LAYER_DISCONNECTED");
     break;
 	/** Returned when the root certificate is invalid */
   case(NETWORK_X509_ROOT_CRT_PARSE_ERROR):
-    ESP_LOGI(TAG, "NETWORK_X509_ROOT_CRT_PARSE_ERROR");
+    ESP_LOGE(TAG, "NETWORK_X509_ROOT_CRT_PARSE_ERROR");
     break;
 	/** Returned when the device certificate is invalid */
   case(NETWORK_X509_DEVICE_CRT_PARSE_ERROR):
-    ESP_LOGI(TAG, "NETWORK_X509_DEVICE_CRT_PARSE_ERROR");
+    ESP_LOGE(TAG, "NETWORK_X509_DEVICE_CRT_PARSE_ERROR");
     break;
 	/** Returned when the private key failed to parse */
   case(NETWORK_PK_PRIVATE_KEY_PARSE_ERROR):
-    ESP_LOGI(TAG, "NETWORK_PK_PRIVATE_KEY_PARSE_ERROR");
+    ESP_LOGE(TAG, "NETWORK_PK_PRIVATE_KEY_PARSE_ERROR");
     break;
 	/** Returned when the network layer failed to open a socket */
   case(NETWORK_ERR_NET_SOCKET_FAILED):
-    ESP_LOGI(TAG, "NETWORK_ERR_NET_SOCKET_FAILED");
+    ESP_LOGE(TAG, "NETWORK_ERR_NET_SOCKET_FAILED");
     break;
 	/** Returned when the server is unknown */
   case(NETWORK_ERR_NET_UNKNOWN_HOST):
-    ESP_LOGI(TAG, "NETWORK_ERR_NET_UNKNOWN_HOST");
+    ESP_LOGE(TAG, "NETWORK_ERR_NET_UNKNOWN_HOST");
     break;
 	/** Returned when connect request failed */
   case(NETWORK_ERR_NET_CONNECT_FAILED):
-    ESP_LOGI(TAG, "NETWORK_ERR_NET_CONNECT_FAILED");
+    ESP_LOGE(TAG, "NETWORK_ERR_NET_CONNECT_FAILED");
     break;
 	/** Returned when there is nothing to read in the TLS read buffer */
   case(NETWORK_SSL_NOTHING_TO_READ):
-    ESP_LOGI(TAG, "NETWORK_SSL_NOTHING_TO_READ");
+    ESP_LOGD(TAG, "NETWORK_SSL_NOTHING_TO_READ");
     break;
 	/** A connection could not be established. */
   case(MQTT_CONNECTION_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNECTION_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNECTION_ERROR");
     break;
 	/** A timeout occurred while waiting for the TLS handshake to complete */
   case(MQTT_CONNECT_TIMEOUT_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNECT_TIMEOUT_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNECT_TIMEOUT_ERROR");
     break;
 	/** A timeout occurred while waiting for the TLS request complete */
   case(MQTT_REQUEST_TIMEOUT_ERROR):
-    ESP_LOGI(TAG, "MQTT_REQUEST_TIMEOUT_ERROR");
+    ESP_LOGW(TAG, "MQTT_REQUEST_TIMEOUT_ERROR");
     break;
 	/** The current client state does not match the expected value */
   case(MQTT_UNEXPECTED_CLIENT_STATE_ERROR):
-    ESP_LOGI(TAG, "MQTT_UNEXPECTED_CLIENT_STATE_ERROR");
+    ESP_LOGE(TAG, "MQTT_UNEXPECTED_CLIENT_STATE_ERROR");
     break;
 	/** The client state is not idle when request is being made */
   case(MQTT_CLIENT_NOT_IDLE_ERROR):
-    ESP_LOGI(TAG, "MQTT_CLIENT_NOT_IDLE_ERROR");
+    ESP_LOGW(TAG, "MQTT_CLIENT_NOT_IDLE_ERROR");
     break;
 	/** The MQTT RX buffer received corrupt or unexpected message  */
   case(MQTT_RX_MESSAGE_PACKET_TYPE_INVALID_ERROR):
-    ESP_LOGI(TAG, "MQTT_RX_MESSAGE_PACKET_TYPE_INVALID_ERROR");
+    ESP_LOGE(TAG, "MQTT_RX_MESSAGE_PACKET_TYPE_INVALID_ERROR");
     break;
 	/** The MQTT RX buffer received a bigger message. The message will be dropped  */
   case(MQTT_RX_BUFFER_TOO_SHORT_ERROR):
-    ESP_LOGI(TAG, "MQTT_RX_BUFFER_TOO_SHORT_ERROR");
+    ESP_LOGE(TAG, "MQTT_RX_BUFFER_TOO_SHORT_ERROR");
     break;
 	/** The MQTT TX buffer is too short for the outgoing message. Request will fail  */
   case(MQTT_TX_BUFFER_TOO_SHORT_ERROR):
-    ESP_LOGI(TAG, "MQTT_TX_BUFFER_TOO_SHORT_ERROR");
+    ESP_LOGE(TAG, "MQTT_TX_BUFFER_TOO_SHORT_ERROR");
     break;
 	/** The client is subscribed to the maximum possible number of subscriptions  */
   case(MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR):
-    ESP_LOGI(TAG, "MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR");
+    ESP_LOGE(TAG, "MQTT_MAX_SUBSCRIPTIONS_REACHED_ERROR");
     break;
 	/** Failed to decode the remaining packet length on incoming packet */
   case(MQTT_DECODE_REMAINING_LENGTH_ERROR):
-    ESP_LOGI(TAG, "MQTT_DECODE_REMAINING_LENGTH_ERROR");
+    ESP_LOGE(TAG, "MQTT_DECODE_REMAINING_LENGTH_ERROR");
     break;
 	/** Connect request failed with the server returning an unknown error */
   case(MQTT_CONNACK_UNKNOWN_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_UNKNOWN_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_UNKNOWN_ERROR");
     break;
 	/** Connect request failed with the server returning an unacceptable protocol version error */
   case(MQTT_CONNACK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_UNACCEPTABLE_PROTOCOL_VERSION_ERROR");
     break;
 	/** Connect request failed with the server returning an identifier rejected error */
   case(MQTT_CONNACK_IDENTIFIER_REJECTED_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_IDENTIFIER_REJECTED_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_IDENTIFIER_REJECTED_ERROR");
     break;
 	/** Connect request failed with the server returning an unavailable error */
   case(MQTT_CONNACK_SERVER_UNAVAILABLE_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_SERVER_UNAVAILABLE_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_SERVER_UNAVAILABLE_ERROR");
     break;
 	/** Connect request failed with the server returning a bad userdata error */
   case(MQTT_CONNACK_BAD_USERDATA_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_BAD_USERDATA_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_BAD_USERDATA_ERROR");
     break;
 	/** Connect request failed with the server failing to authenticate the request */
   case(MQTT_CONNACK_NOT_AUTHORIZED_ERROR):
-    ESP_LOGI(TAG, "MQTT_CONNACK_NOT_AUTHORIZED_ERROR");
+    ESP_LOGE(TAG, "MQTT_CONNACK_NOT_AUTHORIZED_ERROR");
     break;
 	/** An error occurred while parsing the JSON string.  Usually malformed JSON. */
   case(JSON_PARSE_ERROR):
-    ESP_LOGI(TAG, "JSON_PARSE_ERROR");
+    ESP_LOGE(TAG, "JSON_PARSE_ERROR");
     break;
 	/** Shadow: The response Ack table is currently full waiting for previously published updates */
   case(SHADOW_WAIT_FOR_PUBLISH):
-    ESP_LOGI(TAG, "SHADOW_WAIT_FOR_PUBLISH");
+    ESP_LOGD(TAG, "SHADOW_WAIT_FOR_PUBLISH");
     break;
 	/** Any time an snprintf writes more than size value, this error will be returned */
   case(SHADOW_JSON_BUFFER_TRUNCATED):
-    ESP_LOGI(TAG, "SHADOW_JSON_BUFFER_TRUNCATED");
+    ESP_LOGW(TAG, "SHADOW_JSON_BUFFER_TRUNCATED");
     break;
 	/** Any time an snprintf encounters an encoding error or not enough space in the given buffer */
   case(SHADOW_JSON_ERROR):
-    ESP_LOGI(TAG, "SHADOW_JSON_ERROR");
+    ESP_LOGE(TAG, "SHADOW_JSON_ERROR");
     break;
 	/** Mutex initialization failed */
   case(MUTEX_INIT_ERROR):
-    ESP_LOGI(TAG, "MUTEX_INIT_ERROR");
+    ESP_LOGE(TAG, "MUTEX_INIT_ERROR");
     break;
 	/** Mutex lock request failed */
   case(MUTEX_LOCK_ERROR):
-    ESP_LOGI(TAG, "MUTEX_LOCK_ERROR");
+    ESP_LOGE(TAG, "MUTEX_LOCK_ERROR");
     break;
 	/** Mutex unlock request failed */
   case(MUTEX_UNLOCK_ERROR):
-    ESP_LOGI(TAG, "MUTEX_UNLOCK_ERROR");
+    ESP_LOGE(TAG, "MUTEX_UNLOCK_ERROR");
     break;
 	/** Mutex destroy failed */
   case(MUTEX_DESTROY_ERROR):
-    ESP_LOGI(TAG, "MUTEX_DESTROY_ERROR");
+    ESP_LOGE(TAG, "MUTEX_DESTROY_ERROR");
     break;
 	/** Input argument exceeded the allowed maximum size */
   case(MAX_SIZE_ERROR):
-    ESP_LOGI(TAG, "MAX_SIZE_ERROR");
+    ESP_LOGE(TAG, "MAX_SIZE_ERROR");
     break;
 	/** Some limit has been exceeded, e.g. the maximum number of subscriptions has been reached */
   case(LIMIT_EXCEEDED_ERROR):
-    ESP_LOGI(TAG, "LIMIT_EXCEEDED_ERROR");
+    ESP_LOGE(TAG, "LIMIT_EXCEEDED_ERROR");
     break;
 	/** Invalid input topic type */
   case(INVALID_TOPIC_TYPE_ERROR):
-    ESP_LOGI(TAG, "INVALID_TOPIC_TYPE_ERROR");
+    ESP_LOGE(TAG, "INVALID_TOPIC_TYPE_ERROR");
     break;
   }
 }
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "multi_heap.h"
+#include "mbedtls/platform.h"
+
+#include "awsclient_arena.h"
+
+#define TAG "AWSCLIENT_ARENA"
+
+#if CONFIG_AWSCLIENT_TLS_ARENA
+
+#if !defined(MBEDTLS_PLATFORM_MEMORY) || defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+#error "CONFIG_AWSCLIENT_TLS_ARENA needs mbedtls_platform_set_calloc_free()"
+#endif
+
+// the task which connects and the network task
+#define AWSCLIENT_ARENA_OWNERS_MAX 2
+
+// TLS contexts, record buffers and the parsed certificates of one session
+static uint8_t s_arena_buf[CONFIG_AWSCLIENT_TLS_ARENA_SIZE] __attribute__((aligned(8)));
+static multi_heap_handle_t s_arena = NULL;
+// also the lock of the heap. taken around the allocation and the count, so a reset from another
+// task does not register the heap again in between.
+static portMUX_TYPE s_arena_lock = portMUX_INITIALIZER_UNLOCKED;
+// only the allocations of these tasks go to the arena. wpa_supplicant and the other users of
+// mbedTLS would keep allocations alive across the reset.
+static TaskHandle_t s_arena_owners[AWSCLIENT_ARENA_OWNERS_MAX];
+static volatile uint32_t s_arena_live = 0;
+static volatile uint32_t s_arena_fallbacks = 0;
+// free bytes of the empty arena, the heap metadata is not usable
+static size_t s_arena_free_empty = 0;
+// peak of the previous sessions, the heap statistics start over on reset
+static size_t s_arena_peak = 0;
+
+static bool awsclient_arena_owns(void *p)
+{
+  return (uint8_t *)p >= s_arena_buf && (uint8_t *)p < s_arena_buf + sizeof(s_arena_buf);
+}
+
+static bool awsclient_arena_is_owner(void)
+{
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+  for (int i = 0; i < AWSCLIENT_ARENA_OWNERS_MAX; i++) {
+    if (s_arena_owners[i] == task) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *awsclient_arena_calloc(size_t n, size_t size)
+{
+  void *p = NULL;
+  size_t total;
+
+  if (size != 0 && n > SIZE_MAX / size) {
+    return NULL;
+  }
+  total = n * size;
+  if (!awsclient_arena_is_owner()) {
+    return heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  // the spinlock is recursive, the heap takes it again inside
+  portENTER_CRITICAL(&s_arena_lock);
+  p = multi_heap_malloc(s_arena, total);
+  if (p != NULL) {
+    s_arena_live++;
+  } else {
+    s_arena_fallbacks++;
+  }
+  portEXIT_CRITICAL(&s_arena_lock);
+  if (p != NULL) {
+    memset(p, 0, total);
+    return p;
+  }
+  // does not fit. keep working, but count it.
+  return heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+static void awsclient_arena_free(void *p)
+{
+  if (p == NULL) {
+    return;
+  }
+  if (!awsclient_arena_owns(p)) {
+    heap_caps_free(p);
+    return;
+  }
+  portENTER_CRITICAL(&s_arena_lock);
+  multi_heap_free(s_arena, p);
+  s_arena_live--;
+  portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void awsclient_arena_init(void)
+{
+  awsclient_arena_own();
+  if (s_arena != NULL) {
+    return;
+  }
+  s_arena = multi_heap_register(s_arena_buf, sizeof(s_arena_buf));
+  assert(s_arena);
+  multi_heap_set_lock(s_arena, &s_arena_lock);
+  s_arena_free_empty = multi_heap_free_size(s_arena);
+  mbedtls_platform_set_calloc_free(awsclient_arena_calloc, awsclient_arena_free);
+  ESP_LOGI(TAG, "mbedTLS arena: %u bytes", sizeof(s_arena_buf));
+}
+
+void awsclient_arena_own(void)
+{
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+  portENTER_CRITICAL(&s_arena_lock);
+  for (int i = 0; i < AWSCLIENT_ARENA_OWNERS_MAX; i++) {
+    if (s_arena_owners[i] == task) {
+      break;
+    }
+    if (s_arena_owners[i] == NULL) {
+      s_arena_owners[i] = task;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void awsclient_arena_reset(void)
+{
+  awsclient_arena_stats_t stats;
+
+  if (s_arena == NULL) {
+    return;
+  }
+  awsclient_arena_get_stats(&stats);
+  ESP_LOGI(TAG, "peak %u of %u bytes, %u fallbacks", stats.peak, stats.size, stats.fallbacks);
+  portENTER_CRITICAL(&s_arena_lock);
+  if (s_arena_live > 0) {
+    portEXIT_CRITICAL(&s_arena_lock);
+    // something still points into the arena. resetting it would corrupt that.
+    ESP_LOGW(TAG, "%u allocations are not freed, keep the arena", stats.live);
+    return;
+  }
+  s_arena_peak = stats.peak;
+  // a fresh heap over the same buffer: no fragments left from this session
+  s_arena = multi_heap_register(s_arena_buf, sizeof(s_arena_buf));
+  multi_heap_set_lock(s_arena, &s_arena_lock);
+  s_arena_fallbacks = 0;
+  portEXIT_CRITICAL(&s_arena_lock);
+}
+
+void awsclient_arena_get_stats(awsclient_arena_stats_t *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  if (s_arena == NULL) {
+    return;
+  }
+  stats->size = sizeof(s_arena_buf);
+  stats->peak = s_arena_free_empty - multi_heap_minimum_free_size(s_arena);
+  if (stats->peak < s_arena_peak) {
+    stats->peak = s_arena_peak;
+  }
+  stats->fallbacks = s_arena_fallbacks;
+  stats->live = s_arena_live;
+}
+
+#else
+
+void awsclient_arena_init(void)
+{
+}
+
+void awsclient_arena_own(void)
+{
+}
+
+void awsclient_arena_reset(void)
+{
+}
+
+void awsclient_arena_get_stats(awsclient_arena_stats_t *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_AWSCLIENT_TLS_ARENA
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
 #include "aws_iot_config.h"
 #include "aws_iot_error.h"
 #include "aws_iot_log.h"
@@ -7,6 +10,9 @@
 #include "aws_iot_mqtt_client_interface.h"
 #include "aws_iot_shadow_interface.h"
 
+// called from the network task when a request completed. SUCCESS when acknowledged.
+typedef void (*awsclient_done_cb_t)(IoT_Error_t err, void *ctx);
+
 typedef struct _awsclient_config {
   ShadowInitParameters_t shadow_params;
   ShadowConnectParameters_t shadow_connect_params;
@@ -21,6 +27,38 @@ void awsclient_shadow_connect(awsclient_config_t *config);
 
 void awsclient_shadow_update(awsclient_config_t *config, char *jsonBuffer, size_t jsonBufferSize);
 
+void awsclient_shadow_register_delta(awsclient_config_t *config, jsonStruct_t *delta);
+
+void awsclient_yield(awsclient_config_t *config, uint32_t timeout_ms);
+
+void awsclient_publish(awsclient_config_t *config, const char *topic, const void *payload, size_t payloadLen);
+
 IoT_Error_t awsclient_err(void);
 
 void awsclient_log_error(IoT_Error_t err);
+
+/*
+ * Asynchronous API. After awsclient_shadow_init(), awsclient_start() hands the client to a
+ * network task which yields continuously, so acks and deltas are processed while the caller
+ * does other work. Do not call the synchronous functions above until awsclient_stop().
+ * The buffers passed to the requests must stay valid until the callback.
+ */
+esp_err_t awsclient_start(awsclient_config_t *config);
+
+// up to CONFIG_AWSCLIENT_INFLIGHT_MAX updates wait for their acks at the same time
+esp_err_t awsclient_shadow_update_async(const char *jsonBuffer, awsclient_done_cb_t cb, void *ctx);
+
+// QoS1. the SDK waits for PUBACK, so publishes are sent one by one by the task and each costs
+// a round trip. the queue only decouples the caller; the in-flight window is for shadow updates.
+esp_err_t awsclient_publish_async(const char *topic, const void *payload, size_t payloadLen,
+                                  awsclient_done_cb_t cb, void *ctx);
+
+// waits until every request completed, at most timeout
+esp_err_t awsclient_flush(TickType_t timeout);
+
+// waits until update/documents, published by AWS IoT for each accepted update, was received
+// count times since the connection, at most timeout
+esp_err_t awsclient_wait_documents(uint32_t count, TickType_t timeout);
+
+// requests not completed yet fail with their callback
+void awsclient_stop(void);
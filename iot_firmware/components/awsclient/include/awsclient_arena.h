@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _awsclient_arena_stats {
+  // bytes of the arena
+  size_t size;
+  // maximum bytes in use since boot
+  size_t peak;
+  // allocations of this session which did not fit and went to the system heap
+  uint32_t fallbacks;
+  // allocations not freed yet
+  uint32_t live;
+} awsclient_arena_stats_t;
+
+// hooks mbedTLS calloc/free into a static arena. called by awsclient_shadow_init().
+void awsclient_arena_init(void);
+
+// serves the mbedTLS allocations of the calling task from the arena. the task which calls
+// awsclient_shadow_init() and the network task are added.
+void awsclient_arena_own(void);
+
+// discards the whole arena in one step if nothing is allocated from it.
+// called by awsclient_shadow_deinit() and before a reconnect, after the TLS session was freed.
+void awsclient_arena_reset(void);
+
+void awsclient_arena_get_stats(awsclient_arena_stats_t *stats);
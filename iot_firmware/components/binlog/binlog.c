@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "binlog.h"
+
+#define BINLOG_RING_MAGIC 0xb10c0001
+#define BINLOG_RING_WORDS (CONFIG_BINLOG_RING_SIZE / sizeof(uint32_t))
+
+// header, tag, format, timestamp
+#define BINLOG_REC_HDR_WORDS 4
+#define BINLOG_REC_MAGIC     0xb1
+#define BINLOG_REC_HDR(level, nargs, boot) \
+  (((uint32_t)BINLOG_REC_MAGIC << 24) | (((level) & 0x0f) << 20) | (((nargs) & 0x0f) << 16) | ((boot) & 0xffff))
+#define BINLOG_REC_NARGS(hdr) (((hdr) >> 16) & 0x0f)
+#define BINLOG_REC_WORDS(hdr) (BINLOG_REC_HDR_WORDS + BINLOG_REC_NARGS(hdr))
+
+typedef struct {
+  uint32_t magic;
+  uint32_t boot;
+  // index of the next word to write
+  uint32_t head;
+  // index of the oldest record
+  uint32_t tail;
+  uint32_t used;
+  uint32_t dropped;
+} binlog_ring_t;
+
+// not initialized on reset, so the log of a crashed boot can still be uploaded.
+static RTC_NOINIT_ATTR binlog_ring_t s_ring;
+static RTC_NOINIT_ATTR uint32_t s_ring_buf[BINLOG_RING_WORDS];
+
+static portMUX_TYPE s_binlog_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_binlog_initialized = false;
+
+static bool binlog_ring_is_valid(void)
+{
+  return s_ring.magic == BINLOG_RING_MAGIC
+    && s_ring.head < BINLOG_RING_WORDS
+    && s_ring.tail < BINLOG_RING_WORDS
+    && s_ring.used <= BINLOG_RING_WORDS;
+}
+
+static void binlog_drop_oldest(void)
+{
+  uint32_t n = BINLOG_REC_WORDS(s_ring_buf[s_ring.tail]);
+  if ((s_ring_buf[s_ring.tail] >> 24) != BINLOG_REC_MAGIC || n > s_ring.used) {
+    // corrupted. start over.
+    n = s_ring.used;
+  }
+  s_ring.tail = (s_ring.tail + n) % BINLOG_RING_WORDS;
+  s_ring.used -= n;
+  s_ring.dropped++;
+}
+
+void binlog_init(void)
+{
+  portENTER_CRITICAL_SAFE(&s_binlog_lock);
+  if (!s_binlog_initialized) {
+    if (!binlog_ring_is_valid()) {
+      memset(&s_ring, 0, sizeof(s_ring));
+      s_ring.magic = BINLOG_RING_MAGIC;
+    }
+    s_ring.boot++;
+    s_binlog_initialized = true;
+  }
+  portEXIT_CRITICAL_SAFE(&s_binlog_lock);
+}
+
+void binlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                  uint8_t nargs, const uint32_t *args)
+{
+  uint32_t rec[BINLOG_REC_HDR_WORDS + BINLOG_MAX_ARGS];
+  uint32_t n;
+
+  if (!s_binlog_initialized) {
+    binlog_init();
+  }
+  if (nargs > BINLOG_MAX_ARGS) {
+    nargs = BINLOG_MAX_ARGS;
+  }
+  n = BINLOG_REC_HDR_WORDS + nargs;
+  rec[0] = BINLOG_REC_HDR(level, nargs, s_ring.boot);
+  rec[1] = (uint32_t)(uintptr_t) tag;
+  rec[2] = (uint32_t)(uintptr_t) fmt;
+  rec[3] = esp_log_timestamp();
+  memcpy(rec + BINLOG_REC_HDR_WORDS, args, nargs * sizeof(uint32_t));
+
+  portENTER_CRITICAL_SAFE(&s_binlog_lock);
+  while (BINLOG_RING_WORDS - s_ring.used < n) {
+    binlog_drop_oldest();
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    s_ring_buf[s_ring.head] = rec[i];
+    s_ring.head = (s_ring.head + 1) % BINLOG_RING_WORDS;
+  }
+  s_ring.used += n;
+  portEXIT_CRITICAL_SAFE(&s_binlog_lock);
+}
+
+size_t binlog_peek(uint8_t *buf, size_t len)
+{
+  uint32_t *out = (uint32_t *) buf;
+  size_t words = len / sizeof(uint32_t);
+  size_t pos = 0;
+  uint32_t idx;
+  uint32_t remain;
+
+  if (words < 2) {
+    return 0;
+  }
+  portENTER_CRITICAL_SAFE(&s_binlog_lock);
+  out[pos++] = BINLOG_DUMP_MAGIC;
+  out[pos++] = s_ring.dropped;
+  idx = s_ring.tail;
+  remain = s_ring.used;
+  while (remain > 0) {
+    uint32_t n = BINLOG_REC_WORDS(s_ring_buf[idx]);
+    if (n > remain || pos + n > words) {
+      break;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      out[pos++] = s_ring_buf[idx];
+      idx = (idx + 1) % BINLOG_RING_WORDS;
+    }
+    remain -= n;
+  }
+  portEXIT_CRITICAL_SAFE(&s_binlog_lock);
+  return pos * sizeof(uint32_t);
+}
+
+void binlog_consume(size_t len)
+{
+  size_t words = len / sizeof(uint32_t);
+
+  if (words < 2) {
+    return;
+  }
+  // dump header
+  words -= 2;
+  portENTER_CRITICAL_SAFE(&s_binlog_lock);
+  while (words > 0 && s_ring.used > 0) {
+    uint32_t n = BINLOG_REC_WORDS(s_ring_buf[s_ring.tail]);
+    if (n > words || n > s_ring.used) {
+      break;
+    }
+    s_ring.tail = (s_ring.tail + n) % BINLOG_RING_WORDS;
+    s_ring.used -= n;
+    words -= n;
+  }
+  s_ring.dropped = 0;
+  portEXIT_CRITICAL_SAFE(&s_binlog_lock);
+}
+
+size_t binlog_used(void)
+{
+  return s_ring.used * sizeof(uint32_t);
+}
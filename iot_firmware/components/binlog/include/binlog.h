@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  /*
+   * Binary log.
+   *
+   * A record is the address of the format string, the address of the tag,
+   * a timestamp and up to 6 arguments as 32 bit words. Nothing is formatted
+   * on the device. tools/binlog_decode.py resolves the strings from the ELF.
+   *
+   * - integers are stored as 32 bit values
+   * - float and double are stored as float bits (use %f, %e or %g)
+   * - strings must be string literals or other constants in flash
+   */
+
+#ifdef CONFIG_BINLOG_LEVEL
+#define BINLOG_LEVEL CONFIG_BINLOG_LEVEL
+#else
+#define BINLOG_LEVEL ESP_LOG_INFO
+#endif // CONFIG_BINLOG_LEVEL
+
+#define BINLOG_MAX_ARGS 6
+
+// header of the uploaded dump
+#define BINLOG_DUMP_MAGIC 0x31474c42 // "BLG1"
+
+  void binlog_init(void);
+  void binlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                    uint8_t nargs, const uint32_t *args);
+  // copies whole records, oldest first, preceded by the dump header.
+  // returns the number of bytes written to buf.
+  size_t binlog_peek(uint8_t *buf, size_t len);
+  // drops the records returned by binlog_peek
+  void binlog_consume(size_t len);
+  size_t binlog_used(void);
+
+  static inline uint32_t binlog_arg_int(uint32_t v) { return v; }
+  static inline uint32_t binlog_arg_ptr(const void *v) { return (uint32_t)(uintptr_t) v; }
+  static inline uint32_t binlog_arg_float(double v)
+  {
+    union { float f; uint32_t u; } conv = { .f = (float) v };
+    return conv.u;
+  }
+
+#define BINLOG_ARG(x) _Generic((x),                     \
+                               float: binlog_arg_float, \
+                               double: binlog_arg_float, \
+                               char *: binlog_arg_ptr,  \
+                               const char *: binlog_arg_ptr, \
+                               default: binlog_arg_int)(x)
+
+#define BINLOG_NARGS(...) BINLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+
+#define BINLOG_EACH_0()
+#define BINLOG_EACH_1(a) BINLOG_ARG(a)
+#define BINLOG_EACH_2(a, ...) BINLOG_ARG(a), BINLOG_EACH_1(__VA_ARGS__)
+#define BINLOG_EACH_3(a, ...) BINLOG_ARG(a), BINLOG_EACH_2(__VA_ARGS__)
+#define BINLOG_EACH_4(a, ...) BINLOG_ARG(a), BINLOG_EACH_3(__VA_ARGS__)
+#define BINLOG_EACH_5(a, ...) BINLOG_ARG(a), BINLOG_EACH_4(__VA_ARGS__)
+#define BINLOG_EACH_6(a, ...) BINLOG_ARG(a), BINLOG_EACH_5(__VA_ARGS__)
+#define BINLOG_CAT(a, b) BINLOG_CAT_(a, b)
+#define BINLOG_CAT_(a, b) a##b
+#define BINLOG_EACH(...) BINLOG_CAT(BINLOG_EACH_, BINLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#ifdef CONFIG_BINLOG_MIRROR_CONSOLE
+#define BINLOG_MIRROR(level, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL(level, tag, fmt, ##__VA_ARGS__)
+#else
+#define BINLOG_MIRROR(level, tag, fmt, ...)
+#endif // CONFIG_BINLOG_MIRROR_CONSOLE
+
+  // records above BINLOG_LEVEL are removed by the compiler with their strings.
+#define BINLOG_LEVEL_LOCAL(level, tag, fmt, ...) do {                     \
+    if ((level) <= BINLOG_LEVEL) {                                      \
+      const uint32_t _binlog_args[BINLOG_MAX_ARGS + 1] = { BINLOG_EACH(__VA_ARGS__) }; \
+      binlog_write((level), (tag), (fmt), BINLOG_NARGS(__VA_ARGS__), _binlog_args); \
+      BINLOG_MIRROR(level, tag, fmt, ##__VA_ARGS__);                    \
+    }                                                                   \
+  } while (0)
+
+#define BINLOGE(tag, fmt, ...) BINLOG_LEVEL_LOCAL(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define BINLOGW(tag, fmt, ...) BINLOG_LEVEL_LOCAL(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define BINLOGI(tag, fmt, ...) BINLOG_LEVEL_LOCAL(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define BINLOGD(tag, fmt, ...) BINLOG_LEVEL_LOCAL(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define BINLOGV(tag, fmt, ...) BINLOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "busstat.h"
+
+static const char *s_names[BUSSTAT_DEVICE_MAX] = {
+  [BUSSTAT_PAHUB] = "pahub",
+  [BUSSTAT_PBHUB] = "pbhub",
+  [BUSSTAT_SHT30] = "sht30",
+};
+
+// 16 bytes per device and channel
+static RTC_DATA_ATTR busstat_counters_t s_counters[BUSSTAT_DEVICE_MAX][BUSSTAT_CH_MAX + 1];
+static uint8_t s_ch = BUSSTAT_TRUNK;
+
+static void busstat_add16(uint16_t *v, uint16_t n)
+{
+  *v = (*v > UINT16_MAX - n) ? UINT16_MAX : *v + n;
+}
+
+static void busstat_add32(uint32_t *v, uint32_t n)
+{
+  *v = (*v > UINT32_MAX - n) ? UINT32_MAX : *v + n;
+}
+
+static busstat_counters_t *busstat_current(busstat_device_t device)
+{
+  return &s_counters[device][s_ch];
+}
+
+esp_err_t busstat_cmd_begin(busstat_device_t device, i2c_port_t port, i2c_cmd_handle_t cmd,
+                            TickType_t ticks)
+{
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = i2c_master_cmd_begin(port, cmd, ticks);
+  busstat_counters_t *c = busstat_current(device);
+
+  busstat_add32(&c->transactions, 1);
+  busstat_add32(&c->bus_us, (uint32_t)(esp_timer_get_time() - start));
+  if (err == ESP_FAIL) {
+    // no ACK from the device
+    busstat_add16(&c->nacks, 1);
+  } else if (err == ESP_ERR_TIMEOUT) {
+    busstat_add16(&c->timeouts, 1);
+  }
+  return err;
+}
+
+void busstat_crc_error(busstat_device_t device)
+{
+  busstat_add16(&busstat_current(device)->crc_errors, 1);
+}
+
+void busstat_retry(busstat_device_t device)
+{
+  busstat_add16(&busstat_current(device)->retries, 1);
+}
+
+void busstat_select(uint8_t ch)
+{
+  s_ch = (ch < BUSSTAT_CH_MAX) ? ch : BUSSTAT_TRUNK;
+}
+
+const busstat_counters_t *busstat_get(busstat_device_t device, uint8_t ch)
+{
+  if (device >= BUSSTAT_DEVICE_MAX || ch > BUSSTAT_TRUNK) {
+    return NULL;
+  }
+  return &s_counters[device][ch];
+}
+
+void busstat_total(busstat_counters_t *total)
+{
+  memset(total, 0, sizeof(*total));
+  for (int d = 0; d < BUSSTAT_DEVICE_MAX; d++) {
+    for (int ch = 0; ch <= BUSSTAT_TRUNK; ch++) {
+      const busstat_counters_t *c = &s_counters[d][ch];
+      busstat_add32(&total->transactions, c->transactions);
+      busstat_add32(&total->bus_us, c->bus_us);
+      busstat_add16(&total->nacks, c->nacks);
+      busstat_add16(&total->timeouts, c->timeouts);
+      busstat_add16(&total->crc_errors, c->crc_errors);
+      busstat_add16(&total->retries, c->retries);
+    }
+  }
+}
+
+void busstat_reset(void)
+{
+  memset(s_counters, 0, sizeof(s_counters));
+}
+
+esp_err_t busstat_to_json(char *buf, size_t len)
+{
+  size_t pos = 0;
+  int n;
+
+  if (len < 3) {
+    return ESP_ERR_NO_MEM;
+  }
+  buf[pos++] = '{';
+  for (int d = 0; d < BUSSTAT_DEVICE_MAX; d++) {
+    for (int ch = 0; ch <= BUSSTAT_TRUNK; ch++) {
+      const busstat_counters_t *c = &s_counters[d][ch];
+      char key[12];
+      if (c->transactions == 0) {
+        continue;
+      }
+      if (ch == BUSSTAT_TRUNK) {
+        snprintf(key, sizeof(key), "%s", s_names[d]);
+      } else {
+        snprintf(key, sizeof(key), "%s.%d", s_names[d], ch);
+      }
+      n = snprintf(buf + pos, len - pos, "%s\"%s\":[%u,%u,%u,%u,%u,%u]", (pos > 1) ? "," : "",
+                   key, c->transactions, c->bus_us / 1000, c->nacks, c->timeouts,
+                   c->crc_errors, c->retries);
+      if (n < 0 || (size_t) n >= len - pos) {
+        buf[0] = '\0';
+        return ESP_ERR_NO_MEM;
+      }
+      pos += n;
+    }
+  }
+  if (pos + 2 > len) {
+    buf[0] = '\0';
+    return ESP_ERR_NO_MEM;
+  }
+  buf[pos++] = '}';
+  buf[pos] = '\0';
+  return ESP_OK;
+}
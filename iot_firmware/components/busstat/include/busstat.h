@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/i2c.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  /*
+   * I2C bus health counters.
+   *
+   * The drivers run their transactions through busstat_cmd_begin(), which counts them with
+   * their NACKs, timeouts and bus time for the device and the PaHub channel selected by
+   * busstat_select(). CRC failures and retries are counted by the drivers and the caller.
+   * The counters are kept in RTC memory and count from power-on, so marginal wiring shows
+   * up as a growing retry and bus time before values go missing.
+   */
+
+  typedef enum {
+    BUSSTAT_PAHUB = 0,
+    BUSSTAT_PBHUB,
+    BUSSTAT_SHT30,
+    BUSSTAT_DEVICE_MAX
+  } busstat_device_t;
+
+  // PaHub channels, then the devices in front of the PaHub or without one
+#define BUSSTAT_CH_MAX 8
+#define BUSSTAT_TRUNK BUSSTAT_CH_MAX
+
+  // saturating, they do not wrap around
+  typedef struct {
+    uint32_t transactions;
+    uint32_t bus_us;
+    uint16_t nacks;
+    uint16_t timeouts;
+    uint16_t crc_errors;
+    uint16_t retries;
+  } busstat_counters_t;
+
+  // size of a command link of ops operations. the drivers build their command links on the
+  // stack with it, no heap allocation per transaction.
+#define BUSSTAT_CMD_LINK_SIZE(ops) I2C_LINK_RECOMMENDED_SIZE(ops)
+
+  // i2c_master_cmd_begin(), counted for the device on the selected channel
+  esp_err_t busstat_cmd_begin(busstat_device_t device, i2c_port_t port, i2c_cmd_handle_t cmd,
+                              TickType_t ticks);
+  void busstat_crc_error(busstat_device_t device);
+  void busstat_retry(busstat_device_t device);
+  // channel of the next transactions, BUSSTAT_TRUNK if none or several are selected
+  void busstat_select(uint8_t ch);
+  const busstat_counters_t *busstat_get(busstat_device_t device, uint8_t ch);
+  // sum over all devices and channels
+  void busstat_total(busstat_counters_t *total);
+  void busstat_reset(void);
+  // {"sht30.1":[transactions,bus_ms,nacks,timeouts,crc_errors,retries],"pbhub":[...]}
+  // with the devices seen since power-on. ".n" is the PaHub channel.
+  esp_err_t busstat_to_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
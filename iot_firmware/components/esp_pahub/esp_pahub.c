@@ -3,6 +3,8 @@
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "busstat.h"
+
 #include "esp_pahub.h"
 
 #define PAHUB_TAG "PAHUB"
@@ -12,6 +14,7 @@
 #define PAHUB_I2C_CLK (400 * 1000)
 #define PAHUB_I2C I2C_NUM_1
 #define PAHUB_I2C_ADDR (0x70)
+#define PAHUB_CMD_LINK_SIZE BUSSTAT_CMD_LINK_SIZE(1)
 
 static esp_err_t pahub_write_reg(uint8_t value);
 static esp_err_t pahub_read_reg(uint8_t *value);
@@ -46,33 +49,49 @@ esp_err_t pahub_deinit(void)
 
 esp_err_t pahub_ch(uint8_t channel)
 {
-  return pahub_write_reg(channel);
+  esp_err_t err;
+  uint8_t ch = BUSSTAT_TRUNK;
+
+  // the PaHub itself is in front of its channels
+  busstat_select(BUSSTAT_TRUNK);
+  err = pahub_write_reg(channel);
+  if (err == ESP_OK && channel != 0 && (channel & (channel - 1)) == 0) {
+    ch = __builtin_ctz(channel);
+  }
+  busstat_select(ch);
+  return err;
 }
 
 static esp_err_t pahub_write_reg(uint8_t value)
 {
   esp_err_t err;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PAHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, (PAHUB_I2C_ADDR<<1) | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, value, true);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(PAHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
-  ESP_LOGI(PAHUB_TAG, "pahub_write_reg returns %d\n", err);
+  err = busstat_cmd_begin(BUSSTAT_PAHUB, PAHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
+  if (err != ESP_OK) {
+    ESP_LOGW(PAHUB_TAG, "pahub_write_reg returns %d", err);
+  }
   return err;
 }
 
 static esp_err_t pahub_read_reg(uint8_t *value)
 {
   esp_err_t err;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PAHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, (PAHUB_I2C_ADDR<<1) | I2C_MASTER_READ, true);
   i2c_master_read_byte(cmd, value, I2C_MASTER_NACK);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(PAHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
-  ESP_LOGI(PAHUB_TAG, "pahub_read_reg returns %d\n", err);
+  err = busstat_cmd_begin(BUSSTAT_PAHUB, PAHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
+  if (err != ESP_OK) {
+    ESP_LOGW(PAHUB_TAG, "pahub_read_reg returns %d", err);
+  }
   return err;
 }
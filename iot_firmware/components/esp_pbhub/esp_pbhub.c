@@ -3,6 +3,8 @@
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "busstat.h"
+
 #include "esp_pbhub.h"
 
 #define PBHUB_TAG "PBHUB"
@@ -11,6 +13,7 @@
 #define PBHUB_I2C_CLK (400 * 1000)
 #define PBHUB_I2C I2C_NUM_1
 #define PBHUB_I2C_ADDR (0x61)
+#define PBHUB_CMD_LINK_SIZE BUSSTAT_CMD_LINK_SIZE(2)
 
 const uint8_t PB_READ_DIGITAL[6][2] = {
   { 0x44, 0x45 },
@@ -77,7 +80,8 @@ uint8_t pbhub_digital_read(pbhub_channel_t ch, pbhub_io_t io)
 {
   uint8_t value = PB_READ_DIGITAL[ch][io];
   uint8_t v = 0x00;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PBHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, PBHUB_I2C_ADDR << 1 | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, value, true);
@@ -85,32 +89,48 @@ uint8_t pbhub_digital_read(pbhub_channel_t ch, pbhub_io_t io)
   i2c_master_start(cmd);
   i2c_master_read_byte(cmd, &v, I2C_MASTER_NACK);
   i2c_master_stop(cmd);
-  i2c_master_cmd_begin(PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
+  busstat_cmd_begin(BUSSTAT_PBHUB, PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
 
   return v;
 }
 
 void pbhub_digital_write(pbhub_channel_t ch, pbhub_io_t io, uint8_t value)
 {
+  pbhub_digital_set(ch, io, value);
+}
+
+esp_err_t pbhub_digital_set(pbhub_channel_t ch, pbhub_io_t io, uint8_t value)
+{
+  esp_err_t err;
   uint8_t v = PB_WRITE_DIGITAL[ch][io];
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PBHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, PBHUB_I2C_ADDR << 1 | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, v, true);
   i2c_master_write_byte(cmd, value, true);
   i2c_master_stop(cmd);
-  i2c_master_cmd_begin(PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
+  err = busstat_cmd_begin(BUSSTAT_PBHUB, PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
+  return err;
 }
 
 uint16_t pbhub_analog_read(pbhub_channel_t ch)
+{
+  uint16_t value = 0;
+
+  pbhub_analog_get(ch, &value);
+  return value;
+}
+
+esp_err_t pbhub_analog_get(pbhub_channel_t ch, uint16_t *value)
 {
   esp_err_t err;
   uint8_t v = PB_READ_ANALOG[ch];
   uint8_t r[2] = { 0x00, 0x00 };
-  uint16_t rtn;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PBHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, PBHUB_I2C_ADDR << 1 | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, v, true);
@@ -120,22 +140,26 @@ uint16_t pbhub_analog_read(pbhub_channel_t ch)
   i2c_master_read_byte(cmd, r, I2C_MASTER_ACK);
   i2c_master_read_byte(cmd, r+1, I2C_MASTER_NACK);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
-  ESP_LOGI(PBHUB_TAG, "pbhub_analog_read: I2C returns %d", err);
-  rtn = r[0] + (r[1] << 8);
-  return rtn;
+  err = busstat_cmd_begin(BUSSTAT_PBHUB, PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
+  if (err != ESP_OK) {
+    ESP_LOGW(PBHUB_TAG, "pbhub_analog_get: I2C returns %d", err);
+    return err;
+  }
+  *value = r[0] + (r[1] << 8);
+  return ESP_OK;
 }
 
 void pbhub_analog_write(pbhub_channel_t ch, pbhub_io_t io, uint16_t value)
 {
   uint8_t v = PB_WRITE_ANALOG[ch][io];
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[PBHUB_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
   i2c_master_write_byte(cmd, PBHUB_I2C_ADDR << 1 | I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, v, true);
   i2c_master_write_byte(cmd, value, true);
   i2c_master_stop(cmd);
-  i2c_master_cmd_begin(PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
-  i2c_cmd_link_delete(cmd);
+  busstat_cmd_begin(BUSSTAT_PBHUB, PBHUB_I2C, cmd, pdMS_TO_TICKS(1000));
+  i2c_cmd_link_delete_static(cmd);
 }
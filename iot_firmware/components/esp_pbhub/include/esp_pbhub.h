@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "esp_err.h"
+
 typedef enum {
   PBHUB_CH0 = 0,
   PBHUB_CH1 = 1,
@@ -19,6 +23,10 @@ esp_err_t pbhub_deinit(void);
 
 uint8_t pbhub_digital_read(pbhub_channel_t ch, pbhub_io_t io);
 void pbhub_digital_write(pbhub_channel_t ch, pbhub_io_t io, uint8_t value);
+// the PbHub keeps the output until the next write
+esp_err_t pbhub_digital_set(pbhub_channel_t ch, pbhub_io_t io, uint8_t value);
 
 uint16_t pbhub_analog_read(pbhub_channel_t ch);
+// value is left unchanged on an I2C error
+esp_err_t pbhub_analog_get(pbhub_channel_t ch, uint16_t *value);
 void pbhub_analog_write(pbhub_channel_t ch, pbhub_io_t io, uint16_t value);
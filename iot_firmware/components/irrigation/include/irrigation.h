@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  /*
+   * Watering controller of a pot.
+   *
+   * irrigation_step() takes the water level and the weight of the pot and tells whether the
+   * pump runs. A dose starts when the level falls below level_on, or when the pot lost
+   * uptake_start of weight since its heaviest point after the last dose. It stops at
+   * level_off (hysteresis), at the dose limits of time and weight, or when the inputs become
+   * invalid. If neither the level nor the weight responds within watchdog_ms, the pump is
+   * stopped and the controller stays in fault until irrigation_init(): a dry reservoir or a
+   * loose hose must not be pumped on every wake.
+   *
+   * Nothing but stdint/stdbool is used, so it builds on the host (tools/irrigation_sim.c).
+   */
+
+  typedef struct {
+    // water level: start below level_on, stop at or above level_off. higher is wetter.
+    int32_t level_on;
+    int32_t level_off;
+    // weight lost since the heaviest point after the last dose which starts a dose, 0 for none
+    int32_t uptake_start;
+    // a dose stops after dose_max_ms or dose_max_weight of weight gained
+    uint32_t dose_max_ms;
+    int32_t dose_max_weight;
+    // within watchdog_ms of the start, the level must rise by level_response
+    // or the weight by weight_response
+    uint32_t watchdog_ms;
+    int32_t level_response;
+    int32_t weight_response;
+    // no dose until the water has soaked in
+    uint32_t soak_ms;
+    // sampling period while the pump runs
+    uint32_t poll_ms;
+  } irrigation_config_t;
+
+  typedef struct {
+    uint32_t now_ms;
+    int32_t level;
+    int32_t weight;
+    // false if a sensor could not be read
+    bool valid;
+  } irrigation_input_t;
+
+  typedef enum {
+    IRRIGATION_IDLE = 0,
+    IRRIGATION_PUMPING,
+    IRRIGATION_SOAKING,
+    IRRIGATION_FAULT,
+  } irrigation_state_t;
+
+  typedef enum {
+    IRRIGATION_EVENT_NONE = 0,
+    IRRIGATION_EVENT_START,
+    // the level reached level_off
+    IRRIGATION_EVENT_STOP_LEVEL,
+    // dose_max_ms or dose_max_weight
+    IRRIGATION_EVENT_STOP_DOSE,
+    // no response within watchdog_ms, the controller is in fault
+    IRRIGATION_EVENT_STOP_WATCHDOG,
+    // an invalid input while pumping
+    IRRIGATION_EVENT_STOP_SENSOR,
+    IRRIGATION_EVENT_MAX
+  } irrigation_event_t;
+
+  typedef struct {
+    irrigation_config_t config;
+    irrigation_state_t state;
+    uint32_t start_ms;
+    uint32_t stop_ms;
+    int32_t start_level;
+    int32_t start_weight;
+    // heaviest weight since the last dose, the reference of the uptake
+    int32_t ref_weight;
+    bool ref_valid;
+    // of the last dose
+    uint32_t dose_ms;
+    int32_t dose_weight;
+  } irrigation_t;
+
+  void irrigation_init(irrigation_t *ctl, const irrigation_config_t *config);
+  // the event of this step, IRRIGATION_EVENT_NONE if the pump state did not change
+  irrigation_event_t irrigation_step(irrigation_t *ctl, const irrigation_input_t *in);
+  // stops a dose from outside, e.g. by a time limit of the caller. the controller is in fault.
+  irrigation_event_t irrigation_abort(irrigation_t *ctl, uint32_t now_ms);
+  bool irrigation_pump_on(const irrigation_t *ctl);
+  // time[ms] until the next step while the pump runs, 0 if the pump is off
+  uint32_t irrigation_poll_ms(const irrigation_t *ctl);
+  const char *irrigation_event_str(irrigation_event_t event);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "irrigation.h"
+
+void irrigation_init(irrigation_t *ctl, const irrigation_config_t *config)
+{
+  memset(ctl, 0, sizeof(*ctl));
+  ctl->config = *config;
+  ctl->state = IRRIGATION_IDLE;
+}
+
+static irrigation_event_t irrigation_stop(irrigation_t *ctl, const irrigation_input_t *in,
+                                          irrigation_event_t event)
+{
+  ctl->stop_ms = in->now_ms;
+  ctl->dose_ms = in->now_ms - ctl->start_ms;
+  ctl->dose_weight = in->valid ? in->weight - ctl->start_weight : 0;
+  ctl->state = (event == IRRIGATION_EVENT_STOP_WATCHDOG) ? IRRIGATION_FAULT : IRRIGATION_SOAKING;
+  // the weight after the dose is the new reference
+  ctl->ref_valid = false;
+  return event;
+}
+
+static bool irrigation_dry(const irrigation_t *ctl, const irrigation_input_t *in)
+{
+  const irrigation_config_t *c = &ctl->config;
+
+  if (in->level < c->level_on) {
+    return true;
+  }
+  return c->uptake_start > 0 && ctl->ref_valid && ctl->ref_weight - in->weight >= c->uptake_start;
+}
+
+static irrigation_event_t irrigation_step_pumping(irrigation_t *ctl, const irrigation_input_t *in)
+{
+  const irrigation_config_t *c = &ctl->config;
+  uint32_t elapsed = in->now_ms - ctl->start_ms;
+  int32_t gained;
+
+  if (!in->valid) {
+    return irrigation_stop(ctl, in, IRRIGATION_EVENT_STOP_SENSOR);
+  }
+  if (in->level >= c->level_off) {
+    return irrigation_stop(ctl, in, IRRIGATION_EVENT_STOP_LEVEL);
+  }
+  gained = in->weight - ctl->start_weight;
+  if (elapsed >= c->dose_max_ms || (c->dose_max_weight > 0 && gained >= c->dose_max_weight)) {
+    return irrigation_stop(ctl, in, IRRIGATION_EVENT_STOP_DOSE);
+  }
+  if (elapsed >= c->watchdog_ms && in->level - ctl->start_level < c->level_response
+      && gained < c->weight_response) {
+    return irrigation_stop(ctl, in, IRRIGATION_EVENT_STOP_WATCHDOG);
+  }
+  return IRRIGATION_EVENT_NONE;
+}
+
+irrigation_event_t irrigation_step(irrigation_t *ctl, const irrigation_input_t *in)
+{
+  switch (ctl->state) {
+  case IRRIGATION_PUMPING:
+    return irrigation_step_pumping(ctl, in);
+  case IRRIGATION_FAULT:
+    return IRRIGATION_EVENT_NONE;
+  case IRRIGATION_SOAKING:
+    if (in->now_ms - ctl->stop_ms < ctl->config.soak_ms) {
+      break;
+    }
+    ctl->state = IRRIGATION_IDLE;
+    // fall through
+  case IRRIGATION_IDLE:
+  default:
+    if (!in->valid) {
+      return IRRIGATION_EVENT_NONE;
+    }
+    if (irrigation_dry(ctl, in)) {
+      ctl->state = IRRIGATION_PUMPING;
+      ctl->start_ms = in->now_ms;
+      ctl->start_level = in->level;
+      ctl->start_weight = in->weight;
+      return IRRIGATION_EVENT_START;
+    }
+    break;
+  }
+  if (in->valid && (!ctl->ref_valid || in->weight > ctl->ref_weight)) {
+    ctl->ref_weight = in->weight;
+    ctl->ref_valid = true;
+  }
+  return IRRIGATION_EVENT_NONE;
+}
+
+irrigation_event_t irrigation_abort(irrigation_t *ctl, uint32_t now_ms)
+{
+  irrigation_input_t in = {
+    .now_ms = now_ms,
+    .valid = false,
+  };
+
+  if (ctl->state != IRRIGATION_PUMPING) {
+    return IRRIGATION_EVENT_NONE;
+  }
+  return irrigation_stop(ctl, &in, IRRIGATION_EVENT_STOP_WATCHDOG);
+}
+
+bool irrigation_pump_on(const irrigation_t *ctl)
+{
+  return ctl->state == IRRIGATION_PUMPING;
+}
+
+uint32_t irrigation_poll_ms(const irrigation_t *ctl)
+{
+  return irrigation_pump_on(ctl) ? ctl->config.poll_ms : 0;
+}
+
+const char *irrigation_event_str(irrigation_event_t event)
+{
+  switch (event) {
+  case IRRIGATION_EVENT_NONE:
+    return "none";
+  case IRRIGATION_EVENT_START:
+    return "start";
+  case IRRIGATION_EVENT_STOP_LEVEL:
+    return "stop_level";
+  case IRRIGATION_EVENT_STOP_DOSE:
+    return "stop_dose";
+  case IRRIGATION_EVENT_STOP_WATCHDOG:
+    return "stop_watchdog";
+  case IRRIGATION_EVENT_STOP_SENSOR:
+    return "stop_sensor";
+  default:
+    return "???";
+  }
+}
@@ -1,13 +1,30 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "esp_err.h"
 
+// ADDR pin low and high
+#define SHT30_I2C_ADDR     0x44
+#define SHT30_I2C_ADDR_ALT 0x45
+
 esp_err_t sht30_init(void);
 esp_err_t sht30_deinit(void);
+// the address of the following transactions, SHT30_I2C_ADDR by default
+esp_err_t sht30_set_addr(uint8_t addr);
 
 esp_err_t sht30_start_measurement(void);
 esp_err_t sht30_wait_measurement(void);
 esp_err_t sht30_read_measured_values(uint16_t *temperature, uint16_t *humidity);
+// single shot. the conversion takes up to SHT30_SINGLE_SHOT_MS, the bus is free meanwhile.
+#define SHT30_SINGLE_SHOT_MS 16
+esp_err_t sht30_start_single_shot(void);
+// ESP_FAIL (NACK) until the conversion is done
+esp_err_t sht30_fetch_single_shot(uint16_t *temperature, uint16_t *humidity);
 float sht30_calc_celsius(uint16_t temp);
 float sht30_calc_relative_humidity(uint16_t hum);
+// fixed-point, without float: [0.01 degC] and [0.01 %RH]
+int16_t sht30_calc_centi_celsius(uint16_t temp);
+uint16_t sht30_calc_centi_relative_humidity(uint16_t hum);
 esp_err_t sht30_heater(bool b);
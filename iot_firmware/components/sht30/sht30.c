@@ -6,15 +6,21 @@
 #include "esp_log.h"
 #include "esp_err.h"
 
+#include "busstat.h"
+
 #include "sht30.h"
 
 #define SHT30_I2C      I2C_NUM_1
-#define SHT30_I2C_ADDR 0x44
+#define SHT30_CMD_LINK_SIZE BUSSTAT_CMD_LINK_SIZE(3)
 
 #define SHT30_CRC_LEN 2
 #define SHT30_CRC_POLYNOMIAL 0x31
 
-static uint8_t sht30_check_crc(uint8_t *buf, uint8_t crc);
+static uint8_t s_sht30_addr = SHT30_I2C_ADDR;
+
+static bool sht30_check_crc(uint8_t *buf, uint8_t crc);
+static esp_err_t sht30_unpack(uint8_t *temp, uint8_t *hum, uint8_t *crc,
+                              uint16_t *temperature, uint16_t *humidity);
 
 esp_err_t sht30_init(void)
 {
@@ -26,31 +32,42 @@ esp_err_t sht30_deinit(void)
   return ESP_OK;
 }
 
+esp_err_t sht30_set_addr(uint8_t addr)
+{
+  if (addr != SHT30_I2C_ADDR && addr != SHT30_I2C_ADDR_ALT) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  s_sht30_addr = addr;
+  return ESP_OK;
+}
+
 esp_err_t sht30_start_measurement(void)
 {
   esp_err_t err = ESP_OK;
 
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (SHT30_I2C_ADDR<<1)|I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, 0x2C, true);
   i2c_master_write_byte(cmd, 0x10, true);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
-  i2c_cmd_link_delete(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
   return err;
 }
 
 esp_err_t sht30_wait_measurement(void)
 {
   esp_err_t err = ESP_OK;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (SHT30_I2C_ADDR<<1)|I2C_MASTER_READ, true);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_READ, true);
   i2c_master_start(cmd);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
-  i2c_cmd_link_delete(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
   return err;
 }
 
@@ -61,13 +78,57 @@ esp_err_t sht30_read_measured_values(uint16_t *temperature, uint16_t *humidity)
   uint8_t crc[2];
   uint8_t temp[2];
   uint8_t hum[2];
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (SHT30_I2C_ADDR<<1)|I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, code[0], true);
   i2c_master_write_byte(cmd, code[1], true);
   i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (SHT30_I2C_ADDR<<1)|I2C_MASTER_READ, true);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_READ, true);
+  i2c_master_read_byte(cmd, temp, I2C_MASTER_ACK);
+  i2c_master_read_byte(cmd, temp+1, I2C_MASTER_ACK);
+  i2c_master_read_byte(cmd, crc, I2C_MASTER_ACK);
+  i2c_master_read_byte(cmd, hum, I2C_MASTER_ACK);
+  i2c_master_read_byte(cmd, hum+1, I2C_MASTER_ACK);
+  i2c_master_read_byte(cmd, crc+1, I2C_MASTER_NACK);
+  i2c_master_stop(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return sht30_unpack(temp, hum, crc, temperature, humidity);
+}
+
+esp_err_t sht30_start_single_shot(void)
+{
+  esp_err_t err = ESP_OK;
+
+  // high repeatability, no clock stretching: the bus is free during the conversion
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, 0x24, true);
+  i2c_master_write_byte(cmd, 0x00, true);
+  i2c_master_stop(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
+  return err;
+}
+
+esp_err_t sht30_fetch_single_shot(uint16_t *temperature, uint16_t *humidity)
+{
+  esp_err_t err = ESP_OK;
+  uint8_t crc[2];
+  uint8_t temp[2];
+  uint8_t hum[2];
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+  i2c_master_start(cmd);
+  // NACKed until the conversion is done
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_READ, true);
   i2c_master_read_byte(cmd, temp, I2C_MASTER_ACK);
   i2c_master_read_byte(cmd, temp+1, I2C_MASTER_ACK);
   i2c_master_read_byte(cmd, crc, I2C_MASTER_ACK);
@@ -75,13 +136,24 @@ esp_err_t sht30_read_measured_values(uint16_t *temperature, uint16_t *humidity)
   i2c_master_read_byte(cmd, hum+1, I2C_MASTER_ACK);
   i2c_master_read_byte(cmd, crc+1, I2C_MASTER_NACK);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
-  i2c_cmd_link_delete(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return sht30_unpack(temp, hum, crc, temperature, humidity);
+}
+
+static esp_err_t sht30_unpack(uint8_t *temp, uint8_t *hum, uint8_t *crc,
+                              uint16_t *temperature, uint16_t *humidity)
+{
+  esp_err_t err = ESP_OK;
 
   if (!sht30_check_crc(temp, crc[0])) {
     ESP_LOGI("sht30", "temp %d(%x, %x), crc %d(%x), check result = %d", (uint8_t)((temp[0]<<8)+temp[1]), temp[0], temp[1], crc[0], crc[0], sht30_check_crc(temp, crc[0]));
     temp[0] = 0;
     temp[1] = 0;
+    busstat_crc_error(BUSSTAT_SHT30);
     err = ESP_ERR_INVALID_CRC;
   }
 
@@ -89,6 +161,7 @@ esp_err_t sht30_read_measured_values(uint16_t *temperature, uint16_t *humidity)
     ESP_LOGI("sht30", "humdity %d(%x, %x), crc %d(%x), check result = %d", (uint8_t)((hum[0]<<8)+hum[1]), hum[0], hum[1], crc[1], crc[1], sht30_check_crc(hum, crc[1]));
     hum[0] = 0;
     hum[1] = 0;
+    busstat_crc_error(BUSSTAT_SHT30);
     err = ESP_ERR_INVALID_CRC;
   }
   *temperature = (temp[0] << 8) | temp[1];
@@ -106,6 +179,17 @@ float sht30_calc_relative_humidity(uint16_t hum)
   return 100.0F * hum / (65536.0F - 1);
 }
 
+int16_t sht30_calc_centi_celsius(uint16_t temp)
+{
+  // -45 + 175 * temp / (2^16 - 1), rounded
+  return (int16_t)(-4500 + (17500 * (int32_t) temp + 32767) / 65535);
+}
+
+uint16_t sht30_calc_centi_relative_humidity(uint16_t hum)
+{
+  return (uint16_t)((10000 * (uint32_t) hum + 32767) / 65535);
+}
+
 esp_err_t sht30_heater(bool b)
 {
   esp_err_t err = ESP_OK;
@@ -113,18 +197,19 @@ esp_err_t sht30_heater(bool b)
   if (!b) {
     c[1] = 0x66;
   }
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  uint8_t link[SHT30_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
   i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (SHT30_I2C_ADDR<<1)|I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, (s_sht30_addr<<1)|I2C_MASTER_WRITE, true);
   i2c_master_write_byte(cmd, c[0], true);
   i2c_master_write_byte(cmd, c[1], true);
   i2c_master_stop(cmd);
-  err = i2c_master_cmd_begin(SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
-  i2c_cmd_link_delete(cmd);
+  err = busstat_cmd_begin(BUSSTAT_SHT30, SHT30_I2C, cmd, pdMS_TO_TICKS(3000));
+  i2c_cmd_link_delete_static(cmd);
   return err;
 }
 
-static uint8_t sht30_check_crc(uint8_t *buf, uint8_t crc)
+static bool sht30_check_crc(uint8_t *buf, uint8_t crc)
 {
   uint8_t v = 0xff;
   for (int i = 0; i < SHT30_CRC_LEN; i++) {
@@ -138,7 +223,5 @@ static uint8_t sht30_check_crc(uint8_t *buf, uint8_t crc)
       }
     }
   }
-  return v;
-  /* ESP_LOGI("sht30", "crc should be 0x%x. calc = 0x%x", crc, v); */
-  /* return (v ==  crc); */
+  return v == crc;
 }
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  /*
+   * Time series codec.
+   *
+   * Samples of up to TSCODEC_MAX_FIELDS fields are appended one by one to a byte buffer,
+   * so the buffer can live in RTC memory or flash and grow across wakes.
+   * - timestamps [s]: delta-of-delta
+   * - TSCODEC_INT fields (fixed-point values): delta to the previous value
+   * - TSCODEC_FLOAT fields: XOR with the bits of the previous value
+   * each with a variable length prefix code, packed MSB first.
+   *
+   * The buffer starts with a header: version, number of fields, field types,
+   * sample count (little endian u16). tools/tscodec.py decodes it.
+   */
+
+#define TSCODEC_VERSION 1
+#define TSCODEC_MAX_FIELDS 8
+
+  typedef enum {
+    TSCODEC_INT = 0,
+    TSCODEC_FLOAT,
+  } tscodec_type_t;
+
+  typedef union {
+    int32_t i;
+    float f;
+  } tscodec_value_t;
+
+  typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    // bits written after the header
+    uint32_t bits;
+    uint16_t count;
+    uint8_t nfields;
+    uint8_t types[TSCODEC_MAX_FIELDS];
+    uint32_t prev_t;
+    int32_t prev_dt;
+    uint32_t prev_v[TSCODEC_MAX_FIELDS];
+    // leading and trailing zeros of the previous XOR of a float field
+    uint8_t prev_lead[TSCODEC_MAX_FIELDS];
+    uint8_t prev_trail[TSCODEC_MAX_FIELDS];
+  } tscodec_t;
+
+  esp_err_t tscodec_init(tscodec_t *c, uint8_t *buf, size_t cap,
+                         uint8_t nfields, const tscodec_type_t *types);
+  // appends a sample. ESP_ERR_NO_MEM if it does not fit, the buffer is left unchanged.
+  esp_err_t tscodec_append(tscodec_t *c, uint32_t t, const tscodec_value_t *values);
+  // bytes used in buf, header included
+  size_t tscodec_size(const tscodec_t *c);
+  // moves the time of all samples. only the first timestamp is absolute.
+  void tscodec_shift_time(tscodec_t *c, int32_t dt);
+
+  // sequential decoder
+  typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    uint32_t pos;
+    uint16_t index;
+    uint16_t count;
+    uint8_t nfields;
+    uint8_t types[TSCODEC_MAX_FIELDS];
+    uint32_t t;
+    int32_t dt;
+    uint32_t v[TSCODEC_MAX_FIELDS];
+    uint8_t lead[TSCODEC_MAX_FIELDS];
+    uint8_t trail[TSCODEC_MAX_FIELDS];
+  } tscodec_reader_t;
+
+  esp_err_t tscodec_reader_init(tscodec_reader_t *r, const uint8_t *buf, size_t len);
+  // ESP_ERR_NOT_FOUND after the last sample
+  esp_err_t tscodec_next(tscodec_reader_t *r, uint32_t *t, tscodec_value_t *values);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
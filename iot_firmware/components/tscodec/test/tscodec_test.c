@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "tscodec.h"
+
+#define TSCODEC_TEST_FIELDS 4
+#define TSCODEC_TEST_SAMPLES 32
+
+static const tscodec_type_t s_types[TSCODEC_TEST_FIELDS] = {
+  TSCODEC_INT, TSCODEC_INT, TSCODEC_FLOAT, TSCODEC_FLOAT,
+};
+static uint32_t s_t[TSCODEC_TEST_SAMPLES];
+static tscodec_value_t s_v[TSCODEC_TEST_SAMPLES][TSCODEC_TEST_FIELDS];
+static uint8_t s_buf[512];
+
+// each prefix class of the timestamps and of the deltas, and the ends of the ranges
+static void tscodec_test_samples(void)
+{
+  static const int32_t dts[] = { 600, 600, 601, 599, 660, 300, 1200, 0, 5000, -30, 100000 };
+  static const int32_t ints[] = { 0, 0, 1, -1, 31, -32, 2047, -2048, 524287, -524288,
+                                  INT32_MAX, INT32_MIN, 2150, 2151 };
+  static const float floats[] = { 0.0f, 21.5f, 21.5f, 21.75f, -3.0f, 1e-30f, 3.4e38f, 65.25f };
+  uint32_t t = 1700000000;
+
+  for (int k = 0; k < TSCODEC_TEST_SAMPLES; k++) {
+    s_t[k] = t;
+    t += (uint32_t) dts[k % (sizeof(dts) / sizeof(dts[0]))];
+    s_v[k][0].i = ints[k % (sizeof(ints) / sizeof(ints[0]))];
+    s_v[k][1].i = 4095 - k * 17;
+    s_v[k][2].f = floats[k % (sizeof(floats) / sizeof(floats[0]))];
+    s_v[k][3].f = 3.3f + k * 0.001f;
+  }
+}
+
+// the decoded samples are those appended, bit for bit
+static void tscodec_test_check(const uint8_t *buf, size_t len, uint16_t count)
+{
+  tscodec_reader_t r;
+  tscodec_value_t v[TSCODEC_TEST_FIELDS];
+  uint32_t t;
+
+  TEST_ASSERT_EQUAL(ESP_OK, tscodec_reader_init(&r, buf, len));
+  for (uint16_t k = 0; k < count; k++) {
+    TEST_ASSERT_EQUAL(ESP_OK, tscodec_next(&r, &t, v));
+    TEST_ASSERT_EQUAL_UINT32(s_t[k], t);
+    for (int i = 0; i < TSCODEC_TEST_FIELDS; i++) {
+      TEST_ASSERT_EQUAL_HEX32(s_v[k][i].i, v[i].i);
+    }
+  }
+  TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, tscodec_next(&r, &t, v));
+}
+
+TEST_CASE("tscodec round trip", "[tscodec]")
+{
+  tscodec_t c;
+
+  tscodec_test_samples();
+  TEST_ASSERT_EQUAL(ESP_OK, tscodec_init(&c, s_buf, sizeof(s_buf), TSCODEC_TEST_FIELDS, s_types));
+  for (int k = 0; k < TSCODEC_TEST_SAMPLES; k++) {
+    TEST_ASSERT_EQUAL(ESP_OK, tscodec_append(&c, s_t[k], s_v[k]));
+  }
+  tscodec_test_check(s_buf, tscodec_size(&c), TSCODEC_TEST_SAMPLES);
+}
+
+TEST_CASE("tscodec full buffer", "[tscodec]")
+{
+  tscodec_t c;
+  uint8_t before[sizeof(s_buf)];
+  size_t size;
+  uint16_t count = 0;
+
+  tscodec_test_samples();
+  // a few samples fit
+  TEST_ASSERT_EQUAL(ESP_OK, tscodec_init(&c, s_buf, 64, TSCODEC_TEST_FIELDS, s_types));
+  while (count < TSCODEC_TEST_SAMPLES && tscodec_append(&c, s_t[count], s_v[count]) == ESP_OK) {
+    count++;
+  }
+  TEST_ASSERT_TRUE(count > 0 && count < TSCODEC_TEST_SAMPLES);
+  // a failed append leaves the buffer and the encoder as they were
+  size = tscodec_size(&c);
+  memcpy(before, s_buf, size);
+  TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, tscodec_append(&c, s_t[count], s_v[count]));
+  TEST_ASSERT_EQUAL(size, tscodec_size(&c));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(before, s_buf, size);
+  tscodec_test_check(s_buf, size, count);
+}
+
+TEST_CASE("tscodec shift time", "[tscodec]")
+{
+  tscodec_t c;
+
+  tscodec_test_samples();
+  TEST_ASSERT_EQUAL(ESP_OK, tscodec_init(&c, s_buf, sizeof(s_buf), TSCODEC_TEST_FIELDS, s_types));
+  for (int k = 0; k < TSCODEC_TEST_SAMPLES / 2; k++) {
+    TEST_ASSERT_EQUAL(ESP_OK, tscodec_append(&c, s_t[k], s_v[k]));
+  }
+  // e.g. the clock set by SNTP between two wakes
+  tscodec_shift_time(&c, -3600);
+  for (int k = 0; k < TSCODEC_TEST_SAMPLES; k++) {
+    s_t[k] -= 3600;
+  }
+  for (int k = TSCODEC_TEST_SAMPLES / 2; k < TSCODEC_TEST_SAMPLES; k++) {
+    TEST_ASSERT_EQUAL(ESP_OK, tscodec_append(&c, s_t[k], s_v[k]));
+  }
+  tscodec_test_check(s_buf, tscodec_size(&c), TSCODEC_TEST_SAMPLES);
+}
@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "tscodec.h"
+
+#define TSCODEC_HDR_SIZE(nfields) ((size_t) 4 + (nfields))
+#define TSCODEC_NO_WINDOW 0xff
+
+// prefix code classes: the n-th class is n one bits and a zero (none for the last),
+// then the zigzag encoded value in the given number of bits.
+static const uint8_t s_dod_bits[] = { 0, 7, 9, 12, 32 };
+static const uint8_t s_delta_bits[] = { 0, 6, 12, 20, 32 };
+#define TSCODEC_CLASSES 5
+
+static uint32_t tscodec_zigzag(int32_t v)
+{
+  return ((uint32_t) v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t tscodec_unzigzag(uint32_t v)
+{
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint8_t tscodec_clz(uint32_t v)
+{
+  return v ? __builtin_clz(v) : 32;
+}
+
+static uint8_t tscodec_ctz(uint32_t v)
+{
+  return v ? __builtin_ctz(v) : 32;
+}
+
+// returns false when the buffer is full
+static bool tscodec_put(tscodec_t *c, uint32_t v, uint8_t n)
+{
+  size_t hdr = TSCODEC_HDR_SIZE(c->nfields);
+
+  if (hdr + (c->bits + n + 7) / 8 > c->cap) {
+    return false;
+  }
+  while (n > 0) {
+    n--;
+    uint8_t *p = &c->buf[hdr + c->bits / 8];
+    uint8_t mask = 0x80 >> (c->bits % 8);
+    // the bits after the end may be left from a rolled back append
+    if ((v >> n) & 1) {
+      *p |= mask;
+    } else {
+      *p &= ~mask;
+    }
+    c->bits++;
+  }
+  return true;
+}
+
+static bool tscodec_put_class(tscodec_t *c, const uint8_t *classes, uint32_t zz)
+{
+  for (int i = 0; i < TSCODEC_CLASSES; i++) {
+    if (i < TSCODEC_CLASSES - 1 && (classes[i] >= 32 || (zz >> classes[i]) != 0)) {
+      continue;
+    }
+    // i ones, then a zero except for the last class
+    if (!tscodec_put(c, (1u << i) - 1, i)) {
+      return false;
+    }
+    if (i < TSCODEC_CLASSES - 1 && !tscodec_put(c, 0, 1)) {
+      return false;
+    }
+    return tscodec_put(c, zz, classes[i]);
+  }
+  return false;
+}
+
+static bool tscodec_put_xor(tscodec_t *c, int field, uint32_t x)
+{
+  uint8_t lead, trail, len;
+
+  if (x == 0) {
+    return tscodec_put(c, 0, 1);
+  }
+  lead = tscodec_clz(x);
+  trail = tscodec_ctz(x);
+  if (c->prev_lead[field] != TSCODEC_NO_WINDOW
+      && lead >= c->prev_lead[field] && trail >= c->prev_trail[field]) {
+    // within the window of the previous value
+    len = 32 - c->prev_lead[field] - c->prev_trail[field];
+    return tscodec_put(c, 2, 2) && tscodec_put(c, x >> c->prev_trail[field], len);
+  }
+  len = 32 - lead - trail;
+  c->prev_lead[field] = lead;
+  c->prev_trail[field] = trail;
+  return tscodec_put(c, 3, 2) && tscodec_put(c, lead, 5)
+    && tscodec_put(c, len - 1, 5) && tscodec_put(c, x >> trail, len);
+}
+
+esp_err_t tscodec_init(tscodec_t *c, uint8_t *buf, size_t cap,
+                       uint8_t nfields, const tscodec_type_t *types)
+{
+  if (nfields == 0 || nfields > TSCODEC_MAX_FIELDS || cap < TSCODEC_HDR_SIZE(nfields)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(c, 0, sizeof(tscodec_t));
+  c->buf = buf;
+  c->cap = cap;
+  c->nfields = nfields;
+  buf[0] = TSCODEC_VERSION;
+  buf[1] = nfields;
+  for (int i = 0; i < nfields; i++) {
+    c->types[i] = types[i];
+    c->prev_lead[i] = TSCODEC_NO_WINDOW;
+    buf[2 + i] = types[i];
+  }
+  buf[2 + nfields] = 0;
+  buf[3 + nfields] = 0;
+  return ESP_OK;
+}
+
+esp_err_t tscodec_append(tscodec_t *c, uint32_t t, const tscodec_value_t *values)
+{
+  tscodec_t saved = *c;
+  bool ok;
+
+  if (c->count == UINT16_MAX) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (c->count == 0) {
+    ok = tscodec_put(c, t, 32);
+  } else {
+    int32_t dt = (int32_t)(t - c->prev_t);
+    ok = tscodec_put_class(c, s_dod_bits, tscodec_zigzag(dt - c->prev_dt));
+    c->prev_dt = dt;
+  }
+  c->prev_t = t;
+  for (int i = 0; ok && i < c->nfields; i++) {
+    uint32_t v = (uint32_t) values[i].i;
+    if (c->types[i] == TSCODEC_FLOAT) {
+      ok = tscodec_put_xor(c, i, v ^ c->prev_v[i]);
+    } else {
+      ok = tscodec_put_class(c, s_delta_bits, tscodec_zigzag((int32_t)(v - c->prev_v[i])));
+    }
+    c->prev_v[i] = v;
+  }
+  if (!ok) {
+    *c = saved;
+    return ESP_ERR_NO_MEM;
+  }
+  c->count++;
+  c->buf[2 + c->nfields] = c->count & 0xff;
+  c->buf[3 + c->nfields] = c->count >> 8;
+  return ESP_OK;
+}
+
+size_t tscodec_size(const tscodec_t *c)
+{
+  return TSCODEC_HDR_SIZE(c->nfields) + (c->bits + 7) / 8;
+}
+
+void tscodec_shift_time(tscodec_t *c, int32_t dt)
+{
+  uint8_t *p = &c->buf[TSCODEC_HDR_SIZE(c->nfields)];
+  uint32_t t;
+
+  if (c->count == 0) {
+    return;
+  }
+  // the first timestamp is the first 32 bits, byte aligned
+  t = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+  t += (uint32_t) dt;
+  p[0] = t >> 24;
+  p[1] = t >> 16;
+  p[2] = t >> 8;
+  p[3] = t;
+  c->prev_t += (uint32_t) dt;
+}
+
+static bool tscodec_get(tscodec_reader_t *r, uint8_t n, uint32_t *v)
+{
+  size_t hdr = TSCODEC_HDR_SIZE(r->nfields);
+
+  *v = 0;
+  if (hdr + (r->pos + n + 7) / 8 > r->len) {
+    return false;
+  }
+  while (n > 0) {
+    n--;
+    *v = (*v << 1) | ((r->buf[hdr + r->pos / 8] >> (7 - r->pos % 8)) & 1);
+    r->pos++;
+  }
+  return true;
+}
+
+static bool tscodec_get_class(tscodec_reader_t *r, const uint8_t *classes, uint32_t *zz)
+{
+  uint32_t bit;
+  int i;
+
+  for (i = 0; i < TSCODEC_CLASSES - 1; i++) {
+    if (!tscodec_get(r, 1, &bit)) {
+      return false;
+    }
+    if (bit == 0) {
+      break;
+    }
+  }
+  return tscodec_get(r, classes[i], zz);
+}
+
+static bool tscodec_get_xor(tscodec_reader_t *r, int field, uint32_t *x)
+{
+  uint32_t ctrl, lead, len;
+
+  if (!tscodec_get(r, 1, &ctrl)) {
+    return false;
+  }
+  if (ctrl == 0) {
+    *x = 0;
+    return true;
+  }
+  if (!tscodec_get(r, 1, &ctrl)) {
+    return false;
+  }
+  if (ctrl == 0) {
+    len = 32 - r->lead[field] - r->trail[field];
+    if (!tscodec_get(r, len, x)) {
+      return false;
+    }
+    *x <<= r->trail[field];
+    return true;
+  }
+  if (!tscodec_get(r, 5, &lead) || !tscodec_get(r, 5, &len)) {
+    return false;
+  }
+  len++;
+  r->lead[field] = lead;
+  r->trail[field] = 32 - lead - len;
+  if (!tscodec_get(r, len, x)) {
+    return false;
+  }
+  *x <<= r->trail[field];
+  return true;
+}
+
+esp_err_t tscodec_reader_init(tscodec_reader_t *r, const uint8_t *buf, size_t len)
+{
+  if (len < 4 || buf[0] != TSCODEC_VERSION || buf[1] == 0 || buf[1] > TSCODEC_MAX_FIELDS
+      || len < TSCODEC_HDR_SIZE(buf[1])) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(r, 0, sizeof(tscodec_reader_t));
+  r->buf = buf;
+  r->len = len;
+  r->nfields = buf[1];
+  for (int i = 0; i < r->nfields; i++) {
+    r->types[i] = buf[2 + i];
+  }
+  r->count = buf[2 + r->nfields] | (buf[3 + r->nfields] << 8);
+  return ESP_OK;
+}
+
+esp_err_t tscodec_next(tscodec_reader_t *r, uint32_t *t, tscodec_value_t *values)
+{
+  uint32_t v;
+
+  if (r->index >= r->count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (r->index == 0) {
+    if (!tscodec_get(r, 32, &r->t)) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+  } else {
+    if (!tscodec_get_class(r, s_dod_bits, &v)) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    r->dt += tscodec_unzigzag(v);
+    r->t += (uint32_t) r->dt;
+  }
+  for (int i = 0; i < r->nfields; i++) {
+    if (r->types[i] == TSCODEC_FLOAT) {
+      if (!tscodec_get_xor(r, i, &v)) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      r->v[i] ^= v;
+    } else {
+      if (!tscodec_get_class(r, s_delta_bits, &v)) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      r->v[i] += (uint32_t) tscodec_unzigzag(v);
+    }
+    values[i].i = (int32_t) r->v[i];
+  }
+  *t = r->t;
+  r->index++;
+  return ESP_OK;
+}
@@ -9,9 +9,21 @@
 extern "C" {
 #endif // __cplusplus
 
+  typedef struct {
+    uint8_t ssid[33];
+    uint8_t password[65];
+    uint8_t bssid_set;
+    uint8_t bssid[6];
+  } wificlient_credentials_t;
+
   typedef struct {
     // power save mode
     wifi_ps_type_t power_save;
+    // credentials kept by the caller, e.g. in RTC memory. NULL keeps them in the NVS
+    // namespace "wificlient", read on every init.
+    const wificlient_credentials_t *credentials;
+    // called with the credentials received by smartconfig, if credentials is not NULL
+    void (*store_credentials)(const wificlient_credentials_t *credentials);
   } wificlient_config_t;
 
   esp_err_t wificlient_init(wificlient_config_t *config);
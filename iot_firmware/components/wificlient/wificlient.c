@@ -25,10 +25,13 @@
 #define WIFICLIENT_KEY_BSSID_SET (char *)"BSSID_SET"
 #define WIFICLIENT_KEY_BSSID     (char *)"BSSID"
 
+#define WIFICLIENT_SMARTCONFIG_STACK_SIZE (4096)
+
 
 static const char *TAG = "wificlient";
 
 static void smartconfig_task(void *parm);
+static void smartconfig_run(void);
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data);
 static void ip_event_handler(void* arg, esp_event_base_t event_base,
@@ -37,7 +40,8 @@ static void smart_config_event_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data);
 
 /* EventGroup and bits */
-static EventGroupHandle_t s_wificlient_event_group;
+static StaticEventGroup_t s_wificlient_event_group_buffer;
+static EventGroupHandle_t s_wificlient_event_group = NULL;
 static const int CONNECTED_BIT = BIT0;
 static const int DONE_BIT = BIT1;
 
@@ -47,9 +51,14 @@ static nvs_handle_t s_wificlient_handle = 0;
 /* Static variables for credentials */
 static uint8_t s_wificlient_has_credentials = 0;
 static uint8_t s_wificlient_ssid[33] = { 0 };
-static uint8_t *s_wificlient_password[65] = { 0 };
+static uint8_t s_wificlient_password[65] = { 0 };
 static uint8_t bssid_set = 0;
-static uint8_t *s_wificlient_bssid[7] = { 0 };
+static uint8_t s_wificlient_bssid[7] = { 0 };
+
+/* smartconfig task. created once and started by every WIFI_EVENT_STA_START */
+static StackType_t s_smartconfig_stack[WIFICLIENT_SMARTCONFIG_STACK_SIZE];
+static StaticTask_t s_smartconfig_task_buffer;
+static TaskHandle_t s_smartconfig_task = NULL;
 
 /* WIFI interface */
 static esp_netif_t *sta_netif = NULL;
@@ -61,6 +70,18 @@ static wificlient_config_t *s_wificlient_config;
 static uint8_t _wificlient_load_credentials()
 {
   size_t required;
+  const wificlient_credentials_t *c = s_wificlient_config->credentials;
+
+  if (c != NULL) {
+    // kept by the caller, NVS is not read
+    memcpy(s_wificlient_ssid, c->ssid, sizeof(c->ssid));
+    memcpy(s_wificlient_password, c->password, sizeof(c->password));
+    bssid_set = c->bssid_set;
+    memcpy(s_wificlient_bssid, c->bssid, sizeof(c->bssid));
+    s_wificlient_ssid[sizeof(s_wificlient_ssid) - 1] = '\0';
+    s_wificlient_password[sizeof(s_wificlient_password) - 1] = '\0';
+    return strlen((const char*)s_wificlient_ssid) > 0 && strlen((const char*)s_wificlient_password) > 0;
+  }
   // Check saved credentials
   // SSID
   nvs_get_str(s_wificlient_handle, WIFICLIENT_KEY_SSID, (char *)s_wificlient_ssid, &required);
@@ -119,7 +140,7 @@ esp_err_t wificlient_init(wificlient_config_t *config)
   ESP_LOGI(TAG, "start initializing.");
   s_wificlient_config = config;
 
-  if (s_wificlient_handle == 0) {
+  if (s_wificlient_handle == 0 && config->credentials == NULL) {
     err = nvs_open("wificlient", NVS_READWRITE, &s_wificlient_handle);
     if (err != ESP_OK) {
       s_wificlient_handle = 0;
@@ -127,7 +148,14 @@ esp_err_t wificlient_init(wificlient_config_t *config)
   }
 
   ESP_ERROR_CHECK(esp_netif_init());
-  s_wificlient_event_group = xEventGroupCreate();
+  if (s_wificlient_event_group == NULL) {
+    s_wificlient_event_group = xEventGroupCreateStatic(&s_wificlient_event_group_buffer);
+  }
+  if (s_smartconfig_task == NULL) {
+    s_smartconfig_task = xTaskCreateStatic(smartconfig_task, "smartconfig_task",
+                                           WIFICLIENT_SMARTCONFIG_STACK_SIZE, NULL, 3,
+                                           s_smartconfig_stack, &s_smartconfig_task_buffer);
+  }
   err = esp_event_loop_create_default();
   switch(err) {
   case ESP_OK:
@@ -196,6 +224,14 @@ esp_err_t wificlient_wait_for_connected(TickType_t xTicksToWait)
 }
 
 static void smartconfig_task(void *parm)
+{
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    smartconfig_run();
+  }
+}
+
+static void smartconfig_run(void)
 {
   EventBits_t uxBits;
   ESP_ERROR_CHECK(esp_smartconfig_set_type(SC_TYPE_ESPTOUCH));
@@ -215,7 +251,7 @@ static void smartconfig_task(void *parm)
       if(uxBits & DONE_BIT) {
         // ESP_LOGI(TAG, "smartconfig over");
         esp_smartconfig_stop();
-        vTaskDelete(NULL);
+        return;
       }
       vTaskDelay(pdMS_TO_TICKS(3000));
     }
@@ -229,7 +265,7 @@ static void smartconfig_task(void *parm)
         ESP_ERROR_CHECK(esp_netif_dhcpc_get_status(sta_netif, &dhcp_status));
         if (dhcp_status == ESP_NETIF_DHCP_STARTED) {
           xEventGroupSetBits(s_wificlient_event_group, DONE_BIT);
-          vTaskDelete(NULL);        
+          return;
         }
       }
       vTaskDelay(pdMS_TO_TICKS(3000));
@@ -252,7 +288,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     break;
   case WIFI_EVENT_STA_START:
     ESP_LOGI(TAG, "WIFI_EVENT: sta started.");
-    xTaskCreate(smartconfig_task, "smartconfig_task", 4096, NULL, 3, NULL);
+    xTaskNotifyGive(s_smartconfig_task);
     break;
   case WIFI_EVENT_STA_STOP:
     ESP_LOGI(TAG, "WIFI_EVENT: sta stoppped.");
@@ -328,6 +364,18 @@ static void smart_config_event_handler(void* arg, esp_event_base_t event_base,
     esp_wifi_connect();
 
     // store credentials
+    if (s_wificlient_config->credentials != NULL) {
+      wificlient_credentials_t c;
+      memset(&c, 0, sizeof(c));
+      memcpy(c.ssid, evt->ssid, sizeof(evt->ssid));
+      memcpy(c.password, evt->password, sizeof(evt->password));
+      c.bssid_set = evt->bssid_set;
+      memcpy(c.bssid, evt->bssid, sizeof(c.bssid));
+      if (s_wificlient_config->store_credentials != NULL) {
+        s_wificlient_config->store_credentials(&c);
+      }
+      break;
+    }
     err = nvs_set_str(s_wificlient_handle, WIFICLIENT_KEY_SSID, (const char*)evt->ssid);
     if (err != ESP_OK) {
       ESP_LOGI(TAG, "Failed nvs_set ssid");
@@ -344,6 +392,10 @@ static void smart_config_event_handler(void* arg, esp_event_base_t event_base,
     if (err != ESP_OK) {
       ESP_LOGI(TAG, "Failed nvs_set bssid");
     }
+    err = nvs_commit(s_wificlient_handle);
+    if (err != ESP_OK) {
+      ESP_LOGI(TAG, "Failed nvs_commit");
+    }
     break;
   case SC_EVENT_SEND_ACK_DONE:
     ESP_LOGI(TAG, "SC_EVENT: SEND_ACK_DONE");
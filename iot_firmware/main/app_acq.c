@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_acq.h"
+#include "app_pm.h"
+
+#define APP_ACQ_TAG "app_acq"
+
+#define APP_ACQ_NO_OWNER 0xff
+
+static StaticSemaphore_t s_notify_buf;
+static SemaphoreHandle_t s_notify = NULL;
+
+static uint32_t app_acq_max(uint32_t a, uint32_t b)
+{
+  return (a > b) ? a : b;
+}
+
+// time [ms] from the start until the rails of the job are stable
+static uint32_t app_acq_rails_ready(uint8_t need, const app_acq_rail_t *rails)
+{
+  uint32_t ready = 0;
+
+  for (int r = 0; r < APP_ACQ_RAIL_MAX; r++) {
+    if (need & APP_ACQ_RAIL(r)) {
+      ready = app_acq_max(ready, rails[r].settle_ms);
+    }
+  }
+  return ready;
+}
+
+uint32_t app_acq_plan(const app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails)
+{
+  uint32_t bus_free[APP_ACQ_BUS_MAX] = { 0 };
+  uint32_t makespan = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    const app_acq_job_t *job = &jobs[i];
+    uint32_t start = app_acq_rails_ready(job->rails, rails) + job->warmup_ms;
+    uint32_t end;
+    if (job->bus != APP_ACQ_BUS_NONE) {
+      start = app_acq_max(start, bus_free[job->bus]);
+    }
+    end = start + job->planned_ms;
+    if (job->bus != APP_ACQ_BUS_NONE) {
+      bus_free[job->bus] = end;
+    }
+    makespan = app_acq_max(makespan, end);
+  }
+  return makespan;
+}
+
+uint32_t app_acq_plan_serial(const app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails)
+{
+  uint32_t t = 0;
+
+  for (int r = 0; r < APP_ACQ_RAIL_MAX; r++) {
+    t += rails[r].settle_ms;
+  }
+  for (size_t i = 0; i < n; i++) {
+    t += jobs[i].warmup_ms + jobs[i].planned_ms;
+  }
+  return t;
+}
+
+void IRAM_ATTR app_acq_notify_from_isr(void)
+{
+  BaseType_t woken = pdFALSE;
+
+  if (s_notify == NULL) {
+    return;
+  }
+  xSemaphoreGiveFromISR(s_notify, &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+bool app_acq_wait_event(uint32_t timeout_ms)
+{
+  if (s_notify == NULL) {
+    s_notify = xSemaphoreCreateBinaryStatic(&s_notify_buf);
+  }
+  return xSemaphoreTake(s_notify, pdMS_TO_TICKS(timeout_ms) + 1) == pdTRUE;
+}
+
+esp_err_t app_acq_run(app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails, uint32_t timeout_ms)
+{
+  uint8_t owner[APP_ACQ_BUS_MAX];
+  uint8_t need = 0;
+  size_t remaining = n;
+  bool event = false;
+  int64_t t0;
+  int64_t now;
+  esp_err_t err = ESP_OK;
+
+  if (s_notify == NULL) {
+    s_notify = xSemaphoreCreateBinaryStatic(&s_notify_buf);
+  }
+  for (int b = 0; b < APP_ACQ_BUS_MAX; b++) {
+    owner[b] = APP_ACQ_NO_OWNER;
+  }
+  for (size_t i = 0; i < n; i++) {
+    need |= jobs[i].rails;
+  }
+
+  t0 = esp_timer_get_time();
+  // the rails first, their settle time is the longest wait
+  for (int r = 0; r < APP_ACQ_RAIL_MAX; r++) {
+    if ((need & APP_ACQ_RAIL(r)) && rails[r].on != NULL) {
+      app_pm_bus_acquire();
+      rails[r].on();
+      app_pm_bus_release();
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    app_acq_job_t *job = &jobs[i];
+    job->steps = 0;
+    job->done = false;
+    job->on_event = false;
+    job->start_us = 0;
+    job->end_us = 0;
+    job->due_us = t0 + (int64_t)(app_acq_rails_ready(job->rails, rails) + job->warmup_ms) * 1000;
+  }
+  xSemaphoreTake(s_notify, 0);
+
+  while (remaining > 0) {
+    int64_t next = INT64_MAX;
+
+    now = esp_timer_get_time();
+    if (now - t0 > (int64_t) timeout_ms * 1000) {
+      BINLOGW(APP_ACQ_TAG, "timeout, %d jobs not done", (uint32_t) remaining);
+      err = ESP_ERR_TIMEOUT;
+      break;
+    }
+    for (size_t i = 0; i < n; i++) {
+      app_acq_job_t *job = &jobs[i];
+      int32_t delay;
+      if (job->done) {
+        continue;
+      }
+      if (job->bus != APP_ACQ_BUS_NONE && owner[job->bus] != APP_ACQ_NO_OWNER
+          && owner[job->bus] != i) {
+        // runs when the owner is done
+        continue;
+      }
+      if (now < job->due_us && !(event && job->on_event)) {
+        next = (job->due_us < next) ? job->due_us : next;
+        continue;
+      }
+      if (job->steps == 0) {
+        job->start_us = now;
+        if (job->bus != APP_ACQ_BUS_NONE) {
+          owner[job->bus] = i;
+        }
+      }
+      job->on_event = false;
+      app_pm_bus_acquire();
+      delay = job->step(job);
+      app_pm_bus_release();
+      job->steps++;
+      now = esp_timer_get_time();
+      if (delay == APP_ACQ_FAILED) {
+        BINLOGW(APP_ACQ_TAG, "%s failed", job->name);
+        err = ESP_FAIL;
+        delay = APP_ACQ_DONE;
+      }
+      if (delay == APP_ACQ_DONE) {
+        job->done = true;
+        job->end_us = now;
+        if (job->bus != APP_ACQ_BUS_NONE) {
+          owner[job->bus] = APP_ACQ_NO_OWNER;
+        }
+        remaining--;
+        // a job waiting for the bus may run now
+        next = now;
+        continue;
+      }
+      job->due_us = now + (int64_t) delay * 1000;
+      next = (job->due_us < next) ? job->due_us : next;
+    }
+    event = false;
+    if (remaining > 0) {
+      int64_t wait_us = next - esp_timer_get_time();
+      if (wait_us > 0) {
+        // the cpu may enter automatic light sleep. an event ends the wait early.
+        TickType_t ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+        event = (xSemaphoreTake(s_notify, (ticks > 0) ? ticks : 1) == pdTRUE);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    app_acq_job_t *job = &jobs[i];
+    // e.g. a sensor left powered or an interrupt enabled
+    if (!job->done && job->steps > 0 && job->abort != NULL) {
+      app_pm_bus_acquire();
+      job->abort(job);
+      app_pm_bus_release();
+    }
+  }
+  now = esp_timer_get_time();
+  for (size_t i = 0; i < n; i++) {
+    app_acq_job_t *job = &jobs[i];
+    if (!job->done) {
+      continue;
+    }
+    BINLOGI(APP_ACQ_TAG, "%s: from %d ms for %d ms, planned %d ms, %d steps", job->name,
+            (int32_t)((job->start_us - t0) / 1000), (int32_t)((job->end_us - job->start_us) / 1000),
+            job->planned_ms, job->steps);
+  }
+  BINLOGI(APP_ACQ_TAG, "makespan %d ms, planned %d ms, serial %d ms",
+          (int32_t)((now - t0) / 1000), app_acq_plan(jobs, n, rails), app_acq_plan_serial(jobs, n, rails));
+  return err;
+}
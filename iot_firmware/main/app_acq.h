@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  typedef enum {
+    // no bus, or one which is free between steps
+    APP_ACQ_BUS_NONE = 0,
+    // I2C of the PMU
+    APP_ACQ_BUS_INTERNAL,
+    // PORT_A. the PaHub channel is state, so a job keeps the bus from its first to its last step.
+    APP_ACQ_BUS_PORT_A,
+    // GPIOs of the HX711
+    APP_ACQ_BUS_HX711,
+    APP_ACQ_BUS_MAX
+  } app_acq_bus_t;
+
+  typedef enum {
+    // 5V output of the PMU (EXTEN) to the units
+    APP_ACQ_RAIL_5V = 0,
+    APP_ACQ_RAIL_MAX
+  } app_acq_rail_id_t;
+
+#define APP_ACQ_RAIL(id) (1 << (id))
+  // returned by a step when the job is finished
+#define APP_ACQ_DONE (-1)
+  // returned by a step when the job is finished without a result, e.g. a sensor not ready
+#define APP_ACQ_FAILED (-2)
+
+  typedef struct app_acq_job app_acq_job_t;
+
+  // one step of a job, run with app_pm_bus_acquire(). returns the time [ms] until the next step
+  // or APP_ACQ_DONE. if the step sets on_event, the next step runs as well on app_acq_notify_from_isr().
+  typedef int32_t (*app_acq_step_fn)(app_acq_job_t *job);
+  // releases what the steps opened when app_acq_run() gives up on a started job. run with
+  // app_pm_bus_acquire().
+  typedef void (*app_acq_abort_fn)(app_acq_job_t *job);
+
+  struct app_acq_job {
+    // constant string, for the log
+    const char *name;
+    // APP_ACQ_RAIL() bits of the rails which must be stable
+    uint8_t rails;
+    app_acq_bus_t bus;
+    // after the rails are stable, e.g. the start-up of a sensor
+    uint16_t warmup_ms;
+    // declared duration from the first to the last step, for the plan
+    uint16_t planned_ms;
+    app_acq_step_fn step;
+    // NULL if a step leaves nothing open
+    app_acq_abort_fn abort;
+    bool on_event;
+    // set by app_acq_run()
+    uint16_t steps;
+    bool done;
+    int64_t due_us;
+    int64_t start_us;
+    int64_t end_us;
+  };
+
+  typedef struct {
+    // turns the rail on, NULL if it is always on
+    void (*on)(void);
+    // 0 if the rail is already stable
+    uint16_t settle_ms;
+  } app_acq_rail_t;
+
+  // runs the jobs until all are done: each starts when its rails are stable, its warm-up is over
+  // and its bus is free. the waits of all jobs overlap. earlier jobs in the array go first.
+  // ESP_ERR_TIMEOUT after timeout_ms, the started jobs are aborted. ESP_FAIL if a job failed.
+  esp_err_t app_acq_run(app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails, uint32_t timeout_ms);
+  // makespan [ms] from the declared times, the policy of app_acq_run() and tools/acq_sim.py
+  uint32_t app_acq_plan(const app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails);
+  // the same jobs one after the other, as without the scheduler
+  uint32_t app_acq_plan_serial(const app_acq_job_t *jobs, size_t n, const app_acq_rail_t *rails);
+  // wakes app_acq_run() for the jobs waiting with on_event
+  void app_acq_notify_from_isr(void);
+  // outside app_acq_run(), waits for app_acq_notify_from_isr(). false on timeout.
+  bool app_acq_wait_event(uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
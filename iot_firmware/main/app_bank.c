@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/base64.h"
+
+#include "binlog.h"
+#include "tscodec.h"
+
+#include "main.h"
+#include "app_sensors.h"
+#include "app_bank.h"
+#include "app_time.h"
+
+#define APP_BANK_TAG "app_bank"
+
+#if CONFIG_APP_BANK_TSCODEC
+// samples are compressed as they are banked, so the bank holds more than a window
+// when uploads fail. the fields and scales are BANK_FIELDS of tools/tscodec.py.
+static const tscodec_type_t s_bank_types[] = {
+  TSCODEC_INT, TSCODEC_INT, TSCODEC_INT, TSCODEC_INT, TSCODEC_INT, TSCODEC_INT, TSCODEC_INT,
+};
+#define APP_BANK_FIELDS (sizeof(s_bank_types) / sizeof(s_bank_types[0]))
+
+static RTC_DATA_ATTR uint8_t s_bank_z[CONFIG_APP_BANK_TSCODEC_SIZE];
+// buf is NULL after power-on
+static RTC_DATA_ATTR tscodec_t s_codec;
+
+esp_err_t app_bank_push(void)
+{
+  tscodec_value_t v[APP_BANK_FIELDS];
+  int64_t start;
+  esp_err_t err;
+
+  if (s_codec.buf == NULL) {
+    app_bank_clear();
+  }
+  v[0].i = env.temperature;
+  v[1].i = env.humidity;
+  v[2].i = soil.temperature;
+  v[3].i = soil.humidity;
+  v[4].i = light;
+  v[5].i = water_level;
+  v[6].i = weight;
+  start = esp_timer_get_time();
+  err = tscodec_append(&s_codec, app_time_now_sec(), v);
+  if (err != ESP_OK) {
+    BINLOGW(APP_BANK_TAG, "bank is full, sample dropped");
+    return err;
+  }
+  BINLOGI(APP_BANK_TAG, "banked sample %d, %d bytes, encoded in %d us",
+          s_codec.count, (uint32_t) tscodec_size(&s_codec), (int32_t)(esp_timer_get_time() - start));
+  return ESP_OK;
+}
+
+uint16_t app_bank_count(void)
+{
+  return (s_codec.buf != NULL) ? s_codec.count : 0;
+}
+
+void app_bank_clear(void)
+{
+  tscodec_init(&s_codec, s_bank_z, sizeof(s_bank_z), APP_BANK_FIELDS, s_bank_types);
+}
+
+esp_err_t app_bank_to_json(char *buf, size_t len)
+{
+  size_t olen = 0;
+
+  if (len < 3 || app_bank_count() == 0) {
+    return ESP_ERR_NO_MEM;
+  }
+  // a json string
+  buf[0] = '"';
+  if (mbedtls_base64_encode((unsigned char *) buf + 1, len - 2, &olen,
+                            s_bank_z, tscodec_size(&s_codec)) != 0) {
+    return ESP_ERR_NO_MEM;
+  }
+  buf[1 + olen] = '"';
+  buf[2 + olen] = '\0';
+  return ESP_OK;
+}
+
+esp_err_t app_bank_times_to_json(char *buf, size_t len)
+{
+  // the times are in the compressed buffer
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+void app_bank_time_step(int64_t step_us)
+{
+  if (app_bank_count() > 0) {
+    tscodec_shift_time(&s_codec, (int32_t)(step_us / 1000000));
+  }
+}
+
+#else
+#ifdef CONFIG_APP_UPLOAD_EVERY_N_WAKES
+#define APP_BANK_SIZE CONFIG_APP_UPLOAD_EVERY_N_WAKES
+#else
+#define APP_BANK_SIZE 1
+#endif // CONFIG_APP_UPLOAD_EVERY_N_WAKES
+
+static RTC_DATA_ATTR app_bank_sample_t s_bank[APP_BANK_SIZE];
+static RTC_DATA_ATTR uint16_t s_bank_count = 0;
+
+esp_err_t app_bank_push(void)
+{
+  if (s_bank_count >= APP_BANK_SIZE) {
+    BINLOGW(APP_BANK_TAG, "bank is full, sample dropped");
+    return ESP_ERR_NO_MEM;
+  }
+  app_bank_sample_t *s = &s_bank[s_bank_count];
+  s->env_temperature = env.temperature;
+  s->env_humidity = env.humidity;
+  s->soil_temperature = soil.temperature;
+  s->soil_humidity = soil.humidity;
+  s->light = light;
+  s->water_level = water_level;
+  s->weight = weight;
+  s->time = app_time_now_sec();
+  s_bank_count++;
+  BINLOGI(APP_BANK_TAG, "banked sample %d/%d", s_bank_count, APP_BANK_SIZE);
+  return ESP_OK;
+}
+
+uint16_t app_bank_count(void)
+{
+  return s_bank_count;
+}
+
+void app_bank_clear(void)
+{
+  s_bank_count = 0;
+}
+
+esp_err_t app_bank_to_json(char *buf, size_t len)
+{
+  size_t pos = 0;
+  int n;
+
+  n = snprintf(buf, len, "[");
+  if (n < 0 || n >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += n;
+  for (int i = 0; i < s_bank_count; i++) {
+    app_bank_sample_t *s = &s_bank[i];
+    n = snprintf(buf + pos, len - pos, "%s[%d,%u,%d,%u,%u,%u,%d]",
+                 (i == 0) ? "" : ",",
+                 s->env_temperature, s->env_humidity,
+                 s->soil_temperature, s->soil_humidity,
+                 s->light, s->water_level, s->weight);
+    if (n < 0 || n >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += n;
+  }
+  n = snprintf(buf + pos, len - pos, "]");
+  if (n < 0 || n >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t app_bank_times_to_json(char *buf, size_t len)
+{
+  size_t pos = 0;
+  uint32_t prev = 0;
+  int n;
+
+  n = snprintf(buf, len, "[");
+  if (n < 0 || n >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += n;
+  for (int i = 0; i < s_bank_count; i++) {
+    // the samples are banked in order, the deltas are small and non-negative
+    n = snprintf(buf + pos, len - pos, (i == 0) ? "%u" : ",%u", s_bank[i].time - prev);
+    if (n < 0 || n >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += n;
+    prev = s_bank[i].time;
+  }
+  n = snprintf(buf + pos, len - pos, "]");
+  if (n < 0 || n >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void app_bank_time_step(int64_t step_us)
+{
+  int64_t step = step_us / 1000000;
+
+  if (step == 0) {
+    return;
+  }
+  for (int i = 0; i < s_bank_count; i++) {
+    s_bank[i].time = (uint32_t)((int64_t) s_bank[i].time + step);
+  }
+}
+#endif // CONFIG_APP_BANK_TSCODEC
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // one sensor reading kept in RTC memory until the next upload
+  // fixed-point as in app_sensors: [0.01 degC] and [0.01 %RH]
+  typedef struct app_bank_sample {
+    int16_t env_temperature;
+    uint16_t env_humidity;
+    int16_t soil_temperature;
+    uint16_t soil_humidity;
+    uint16_t light;
+    uint16_t water_level;
+    int32_t weight;
+    // app_time_now_sec() when banked
+    uint32_t time;
+  } app_bank_sample_t;
+
+  // stores the current values of app_sensors
+  esp_err_t app_bank_push(void);
+  uint16_t app_bank_count(void);
+  void app_bank_clear(void);
+  // writes banked samples as a json array of integers, "[[env_t,env_h,soil_t,soil_h,light,water,weight],...]".
+  // with CONFIG_APP_BANK_TSCODEC, the compressed bank as a base64 json string, times included.
+  esp_err_t app_bank_to_json(char *buf, size_t len);
+  // writes the times of the banked samples, the first one and then the deltas [s] to
+  // the previous sample, "[t0,t1-t0,t2-t1,...]". not supported with CONFIG_APP_BANK_TSCODEC.
+  esp_err_t app_bank_times_to_json(char *buf, size_t len);
+  // moves the banked times by the step of the clock by a time sync
+  void app_bank_time_step(int64_t step_us);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "awsclient_arena.h"
+#include "binlog.h"
+#include "busstat.h"
+
+#include "main.h"
+#include "app_diag.h"
+#include "app_wake.h"
+
+#define APP_DIAG_TAG "app_diag"
+
+#define APP_DIAG_TASKS_MAX (24)
+
+// the first cycle of a boot starts with a fresh heap, the later ones follow a light sleep
+// which kept the drivers
+#define APP_DIAG_BOOT_FIRST 0
+#define APP_DIAG_BOOT_LATER 1
+#define APP_DIAG_BOOT_MAX 2
+
+static RTC_DATA_ATTR uint32_t s_cycles = 0;
+#if CONFIG_APP_DIAG_ASSERT_STEADY_HEAP
+// in RTC memory, so the warm-up and the steady state span the boots after deep sleep. the wake
+// modes use very different amounts of heap, e.g. a sample-only wake starts neither wifi nor
+// NVS, so each mode is compared with its own baseline.
+static RTC_DATA_ATTR uint32_t s_mode_cycles[APP_DIAG_BOOT_MAX][APP_WAKE_MODE_MAX];
+static RTC_DATA_ATTR size_t s_steady_free[APP_DIAG_BOOT_MAX][APP_WAKE_MODE_MAX];
+static bool s_boot_reported = false;
+#endif // CONFIG_APP_DIAG_ASSERT_STEADY_HEAP
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t s_tasks[APP_DIAG_TASKS_MAX];
+#endif // CONFIG_FREERTOS_USE_TRACE_FACILITY
+
+static void app_diag_report_stacks(void);
+static void app_diag_check_steady_heap(size_t free);
+
+void app_diag_report(void)
+{
+  size_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+  s_cycles++;
+  BINLOGI(APP_DIAG_TAG, "heap: free %u, min free %u, largest block %u (cycle %u)",
+          (uint32_t)free, (uint32_t)min_free, (uint32_t)largest, s_cycles);
+  app_diag_report_stacks();
+  busstat_counters_t bus;
+  busstat_total(&bus);
+  BINLOGI(APP_DIAG_TAG, "bus: %u transactions, %u ms, %u nacks, %u timeouts, %u crc errors, %u retries",
+          bus.transactions, bus.bus_us / 1000, bus.nacks, bus.timeouts, bus.crc_errors, bus.retries);
+#if CONFIG_AWSCLIENT_TLS_ARENA
+  awsclient_arena_stats_t arena;
+  awsclient_arena_get_stats(&arena);
+  BINLOGI(APP_DIAG_TAG, "tls arena: peak %u of %u, %u fallbacks, %u live",
+          (uint32_t)arena.peak, (uint32_t)arena.size, arena.fallbacks, arena.live);
+#endif // CONFIG_AWSCLIENT_TLS_ARENA
+  app_diag_check_steady_heap(free);
+}
+
+static void app_diag_report_stacks(void)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  UBaseType_t n = uxTaskGetSystemState(s_tasks, APP_DIAG_TASKS_MAX, NULL);
+  if (n == 0) {
+    BINLOGW(APP_DIAG_TAG, "more than %d tasks", APP_DIAG_TASKS_MAX);
+    return;
+  }
+  for (UBaseType_t i = 0; i < n; i++) {
+    // task names are not in the ELF, binlog_decode.py can not resolve them
+    ESP_LOGD(APP_DIAG_TAG, "stack: %s %u", s_tasks[i].pcTaskName,
+             s_tasks[i].usStackHighWaterMark);
+    BINLOGI(APP_DIAG_TAG, "stack: task %u, prio %u, high-water mark %u",
+            (uint32_t)s_tasks[i].xTaskNumber, (uint32_t)s_tasks[i].uxCurrentPriority,
+            (uint32_t)s_tasks[i].usStackHighWaterMark);
+  }
+#else
+  BINLOGI(APP_DIAG_TAG, "stack: main high-water mark %u",
+          (uint32_t)uxTaskGetStackHighWaterMark(NULL));
+#endif // CONFIG_FREERTOS_USE_TRACE_FACILITY
+}
+
+static void app_diag_check_steady_heap(size_t free)
+{
+#if CONFIG_APP_DIAG_ASSERT_STEADY_HEAP
+  app_wake_mode_t mode = app_wake_mode();
+  int boot = s_boot_reported ? APP_DIAG_BOOT_LATER : APP_DIAG_BOOT_FIRST;
+  uint32_t *cycles = &s_mode_cycles[boot][mode];
+  size_t *steady_free = &s_steady_free[boot][mode];
+
+  s_boot_reported = true;
+  (*cycles)++;
+  if (*cycles < CONFIG_APP_DIAG_WARMUP_CYCLES) {
+    return;
+  }
+  if (*cycles == CONFIG_APP_DIAG_WARMUP_CYCLES) {
+    *steady_free = free;
+    BINLOGI(APP_DIAG_TAG, "steady heap of %s wakes%s: %u free", app_wake_mode_str(mode),
+            (boot == APP_DIAG_BOOT_LATER) ? " after light sleep" : "", (uint32_t)free);
+    return;
+  }
+  if (free + CONFIG_APP_DIAG_HEAP_TOLERANCE < *steady_free) {
+    BINLOGE(APP_DIAG_TAG, "heap of %s wakes grew by %u since the warm-up",
+            app_wake_mode_str(mode), (uint32_t)(*steady_free - free));
+    abort();
+  }
+#endif // CONFIG_APP_DIAG_ASSERT_STEADY_HEAP
+}
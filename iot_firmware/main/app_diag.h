@@ -0,0 +1,15 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // logs free heap, minimum free heap, largest free block, stack high-water marks and the
+  // sum of the I2C bus counters.
+  // with CONFIG_APP_DIAG_ASSERT_STEADY_HEAP, aborts if the heap usage grew since the warm-up.
+  // call once per cycle at the same point, e.g. before sleep.
+  void app_diag_report(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "binlog.h"
+#include "irrigation.h"
+
+#include "main.h"
+#include "app_irrigation.h"
+#include "app_sensors.h"
+#include "app_time.h"
+
+#define APP_IRRIGATION_TAG "app_irrigation"
+
+#define APP_IRRIGATION_EVENTS_MAX 8
+// conversions of HX711 averaged per step while the pump runs
+#define APP_IRRIGATION_WEIGHT_READS 2
+// an off which fails is written again, the PbHub would keep the pump running
+#define APP_IRRIGATION_OFF_RETRIES 3
+
+typedef struct {
+  uint32_t time;
+  uint32_t dose_ms;
+  int32_t level;
+  int32_t dose_weight;
+  uint8_t event;
+} app_irrigation_event_t;
+
+#ifdef CONFIG_APP_IRRIGATION
+// the dose is stopped here whatever the controller says, e.g. if the clock stalls
+#define APP_IRRIGATION_HARD_LIMIT_US ((CONFIG_APP_IRRIGATION_DOSE_MAX_S + 5) * 1000000LL)
+
+static const irrigation_config_t s_irrigation_config = {
+  .level_on = CONFIG_APP_IRRIGATION_LEVEL_ON,
+  .level_off = CONFIG_APP_IRRIGATION_LEVEL_OFF,
+  .uptake_start = CONFIG_APP_IRRIGATION_UPTAKE_START,
+  .dose_max_ms = CONFIG_APP_IRRIGATION_DOSE_MAX_S * 1000,
+  .dose_max_weight = CONFIG_APP_IRRIGATION_DOSE_MAX_WEIGHT,
+  .watchdog_ms = CONFIG_APP_IRRIGATION_WATCHDOG_S * 1000,
+  .level_response = CONFIG_APP_IRRIGATION_LEVEL_RESPONSE,
+  .weight_response = CONFIG_APP_IRRIGATION_WEIGHT_RESPONSE,
+  .soak_ms = CONFIG_APP_IRRIGATION_SOAK_MIN * 60 * 1000,
+  .poll_ms = CONFIG_APP_IRRIGATION_POLL_MS,
+};
+
+// the controller and the events since the last upload are kept across deep sleep
+static RTC_DATA_ATTR irrigation_t s_ctl;
+static RTC_DATA_ATTR bool s_ctl_initialized = false;
+static RTC_DATA_ATTR app_irrigation_event_t s_events[APP_IRRIGATION_EVENTS_MAX];
+static RTC_DATA_ATTR uint16_t s_event_count = 0;
+static bool s_pump_checked = false;
+
+static uint32_t app_irrigation_now_ms(void)
+{
+  return (uint32_t)(app_time_now_us() / 1000);
+}
+
+static int32_t app_irrigation_level(void)
+{
+#if CONFIG_APP_IRRIGATION_LEVEL_INVERTED
+  return 4095 - water_level;
+#else
+  return water_level;
+#endif // CONFIG_APP_IRRIGATION_LEVEL_INVERTED
+}
+
+// in the unit of the calibration
+static int32_t app_irrigation_weight(int32_t raw)
+{
+  return (int32_t)(raw * weight_lsb);
+}
+
+static esp_err_t app_irrigation_pump(bool on)
+{
+  esp_err_t err = ESP_FAIL;
+
+  for (int i = 0; i < (on ? 1 : APP_IRRIGATION_OFF_RETRIES) && err != ESP_OK; i++) {
+    err = app_sensors_pbhub_output(CONFIG_APP_IRRIGATION_PBHUB_CH, on);
+  }
+  if (err != ESP_OK) {
+    BINLOGE(APP_IRRIGATION_TAG, "pump %s returns %d", on ? "on" : "off", err);
+  }
+  return err;
+}
+
+static void app_irrigation_record(irrigation_event_t event, int32_t level)
+{
+  app_irrigation_event_t *e;
+  bool start = (event == IRRIGATION_EVENT_START);
+
+  BINLOGI(APP_IRRIGATION_TAG, "irrigation %s: level %d, dose %u ms, weight %d",
+          irrigation_event_str(event), level, start ? 0 : s_ctl.dose_ms,
+          start ? 0 : s_ctl.dose_weight);
+  if (s_event_count >= APP_IRRIGATION_EVENTS_MAX) {
+    // the oldest is dropped
+    memmove(&s_events[0], &s_events[1], sizeof(s_events[0]) * (APP_IRRIGATION_EVENTS_MAX - 1));
+    s_event_count = APP_IRRIGATION_EVENTS_MAX - 1;
+  }
+  e = &s_events[s_event_count++];
+  e->time = app_time_now_sec();
+  e->event = event;
+  e->level = level;
+  e->dose_ms = start ? 0 : s_ctl.dose_ms;
+  e->dose_weight = start ? 0 : s_ctl.dose_weight;
+}
+
+// runs the pump and steps the controller every poll_ms until it stops the dose
+static void app_irrigation_dose(void)
+{
+  int64_t start_us = esp_timer_get_time();
+  irrigation_input_t in;
+  irrigation_event_t event = IRRIGATION_EVENT_NONE;
+  int32_t raw = weight;
+
+  app_sensors_weight_open();
+  if (app_irrigation_pump(true) != ESP_OK) {
+    // stopped as a failed input, the next wake tries again
+    in.now_ms = app_irrigation_now_ms();
+    in.level = app_irrigation_level();
+    in.weight = app_irrigation_weight(raw);
+    in.valid = false;
+    event = irrigation_step(&s_ctl, &in);
+  }
+  while (event == IRRIGATION_EVENT_NONE) {
+    vTaskDelay(pdMS_TO_TICKS(irrigation_poll_ms(&s_ctl)));
+    // a level sensor which stops answering leaves water_level as it was
+    in.valid = app_sensors_proc_jobs(APP_SENSORS_JOB_PORT_A) == ESP_OK
+      && app_sensors_read_ok(&water_level)
+      && app_sensors_weight_read(APP_IRRIGATION_WEIGHT_READS, &raw) == ESP_OK;
+    in.now_ms = app_irrigation_now_ms();
+    in.level = app_irrigation_level();
+    in.weight = app_irrigation_weight(raw);
+    event = irrigation_step(&s_ctl, &in);
+    if (event == IRRIGATION_EVENT_NONE
+        && esp_timer_get_time() - start_us > APP_IRRIGATION_HARD_LIMIT_US) {
+      BINLOGE(APP_IRRIGATION_TAG, "dose over the hard limit");
+      event = irrigation_abort(&s_ctl, in.now_ms);
+    }
+  }
+  app_irrigation_pump(false);
+  app_sensors_weight_close();
+  weight = raw;
+  app_irrigation_record(event, in.level);
+}
+#endif // CONFIG_APP_IRRIGATION
+
+void app_irrigation_proc(void)
+{
+#ifdef CONFIG_APP_IRRIGATION
+  irrigation_input_t in;
+  irrigation_event_t event;
+
+  if (!s_pump_checked) {
+    s_pump_checked = true;
+    // a reset in the middle of a dose leaves the output of the PbHub on
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+      app_irrigation_pump(false);
+    }
+  }
+  if (!s_ctl_initialized) {
+    irrigation_init(&s_ctl, &s_irrigation_config);
+    s_ctl_initialized = true;
+  }
+  in.now_ms = app_irrigation_now_ms();
+  in.level = app_irrigation_level();
+  in.weight = app_irrigation_weight(weight);
+  // not if the level was not read in this cycle, e.g. not due or no sensor
+  in.valid = app_sensors_read_ok(&water_level);
+  event = irrigation_step(&s_ctl, &in);
+  if (event == IRRIGATION_EVENT_NONE) {
+    return;
+  }
+  app_irrigation_record(event, in.level);
+  if (event == IRRIGATION_EVENT_START) {
+    app_irrigation_dose();
+  }
+#endif // CONFIG_APP_IRRIGATION
+}
+
+uint16_t app_irrigation_event_count(void)
+{
+#ifdef CONFIG_APP_IRRIGATION
+  return s_event_count;
+#else
+  return 0;
+#endif // CONFIG_APP_IRRIGATION
+}
+
+esp_err_t app_irrigation_to_json(char *buf, size_t len)
+{
+#ifdef CONFIG_APP_IRRIGATION
+  size_t pos = 0;
+  int r;
+
+  r = snprintf(buf, len, "[");
+  if (r < 0 || r >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += r;
+  for (uint16_t i = 0; i < s_event_count; i++) {
+    const app_irrigation_event_t *e = &s_events[i];
+    r = snprintf(buf + pos, len - pos, "%s[%u,\"%s\",%u,%d,%d]", (i > 0) ? "," : "",
+                 e->time, irrigation_event_str(e->event), e->dose_ms, e->level, e->dose_weight);
+    if (r < 0 || r >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += r;
+  }
+  r = snprintf(buf + pos, len - pos, "]");
+  if (r < 0 || r >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_APP_IRRIGATION
+}
+
+void app_irrigation_clear(void)
+{
+#ifdef CONFIG_APP_IRRIGATION
+  s_event_count = 0;
+#endif // CONFIG_APP_IRRIGATION
+}
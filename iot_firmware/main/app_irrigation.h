@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // steps the watering controller with the values of app_sensors_proc(). if it starts a dose,
+  // the pump runs here with fast sampling until the controller or the hard limit stops it.
+  // only a cycle in which the water level was read can start a dose.
+  void app_irrigation_proc(void);
+  uint16_t app_irrigation_event_count(void);
+  // the events since the last upload, "[[time,"stop_level",dose_ms,level,dose_weight],...]"
+  esp_err_t app_irrigation_to_json(char *buf, size_t len);
+  void app_irrigation_clear(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "awsclient.h"
+#include "binlog.h"
+
+#include "main.h"
+#include "app_log.h"
+
+#define APP_LOG_TAG "app_log"
+
+#define APP_LOG_TOPIC_TEMPLATE "be_bonsai/%s/binlog"
+// MQTT header and topic have to fit in the TX buffer as well
+#define APP_LOG_CHUNK_SIZE (CONFIG_AWS_IOT_MQTT_TX_BUF_LEN - 64)
+// at most, for the documents of the shadow update when they are not there yet
+#define APP_LOG_DELTA_WAIT_MS 500
+// PUBACK of one chunk
+#define APP_LOG_PUBLISH_WAIT_MS 5000
+// {"state":{"desired":{"log_upload":null},"reported":{"log_upload":false}},"clientToken":...}
+#define APP_LOG_ACK_MAX_LENGTH 192
+
+static bool s_log_upload = false;
+static bool s_log_upload_requested = false;
+static jsonStruct_t s_log_upload_delta;
+static char s_log_topic[64];
+static uint8_t s_log_chunk[APP_LOG_CHUNK_SIZE];
+static volatile IoT_Error_t s_log_publish_err = FAILURE;
+static char s_log_ack_doc[APP_LOG_ACK_MAX_LENGTH];
+
+static void app_log_publish_done(IoT_Error_t err, void *ctx)
+{
+  s_log_publish_err = err;
+}
+
+static void app_log_upload_delta_cb(const char *pJsonValueBuffer, uint32_t valueLength,
+                                    jsonStruct_t *pJsonStruct_t)
+{
+  if (pJsonStruct_t != NULL && *(bool *)pJsonStruct_t->pData) {
+    s_log_upload_requested = true;
+  }
+}
+
+#ifdef CONFIG_APP_LOG_UPLOAD_ON_REQUEST
+// removes desired.log_upload, otherwise the delta comes again on every connection
+static void app_log_upload_ack(void)
+{
+  bool reported = false;
+  jsonStruct_t desired_field = {
+    .cb = NULL,
+    .pData = "null",
+    .dataLength = sizeof("null"),
+    .pKey = "log_upload",
+    .type = SHADOW_JSON_OBJECT,
+  };
+  jsonStruct_t reported_field = {
+    .cb = NULL,
+    .pData = &reported,
+    .dataLength = sizeof(bool),
+    .pKey = "log_upload",
+    .type = SHADOW_JSON_BOOL,
+  };
+
+  if (aws_iot_shadow_init_json_document(s_log_ack_doc, sizeof(s_log_ack_doc)) != SUCCESS
+      || aws_iot_shadow_add_desired(s_log_ack_doc, sizeof(s_log_ack_doc), 1,
+                                    &desired_field) != SUCCESS
+      || aws_iot_shadow_add_reported(s_log_ack_doc, sizeof(s_log_ack_doc), 1,
+                                     &reported_field) != SUCCESS
+      || aws_iot_finalize_json_document(s_log_ack_doc, sizeof(s_log_ack_doc)) != SUCCESS) {
+    BINLOGW(APP_LOG_TAG, "log_upload ack does not fit");
+    return;
+  }
+  s_log_publish_err = FAILURE;
+  awsclient_shadow_update_async(s_log_ack_doc, app_log_publish_done, NULL);
+  if (awsclient_flush(pdMS_TO_TICKS(APP_LOG_PUBLISH_WAIT_MS)) != ESP_OK
+      || s_log_publish_err != SUCCESS) {
+    BINLOGW(APP_LOG_TAG, "log_upload ack failed, %d", s_log_publish_err);
+  }
+}
+#endif // CONFIG_APP_LOG_UPLOAD_ON_REQUEST
+
+void app_log_init(void)
+{
+  binlog_init();
+  s_log_upload_delta.cb = app_log_upload_delta_cb;
+  s_log_upload_delta.pData = &s_log_upload;
+  s_log_upload_delta.dataLength = sizeof(bool);
+  s_log_upload_delta.pKey = "log_upload";
+  s_log_upload_delta.type = SHADOW_JSON_BOOL;
+}
+
+void app_log_register(awsclient_config_t *config)
+{
+  awsclient_shadow_register_delta(config, &s_log_upload_delta);
+}
+
+void app_log_upload_if_requested(awsclient_config_t *config)
+{
+#ifdef CONFIG_APP_LOG_UPLOAD_ON_REQUEST
+  size_t len;
+
+  // AWS IoT publishes the delta and the documents of the update together. a delta received
+  // after the documents is not lost, desired.log_upload sends it again on the next wake.
+  if (!s_log_upload_requested) {
+    awsclient_wait_documents(1, pdMS_TO_TICKS(APP_LOG_DELTA_WAIT_MS));
+  }
+  if (!s_log_upload_requested) {
+    return;
+  }
+  snprintf(s_log_topic, sizeof(s_log_topic), APP_LOG_TOPIC_TEMPLATE,
+           config->shadow_connect_params.pMyThingName);
+  ESP_LOGI(APP_LOG_TAG, "uploading %u bytes of binlog to %s", binlog_used(), s_log_topic);
+  while (binlog_used() > 0) {
+    len = binlog_peek(s_log_chunk, sizeof(s_log_chunk));
+    // the chunk buffer is reused, so one chunk at a time. awsclient sends plain publishes one
+    // PUBACK apart anyway, queueing more chunks would not save round trips.
+    s_log_publish_err = FAILURE;
+    awsclient_publish_async(s_log_topic, s_log_chunk, len, app_log_publish_done, NULL);
+    if (awsclient_flush(pdMS_TO_TICKS(APP_LOG_PUBLISH_WAIT_MS)) != ESP_OK
+        || s_log_publish_err != SUCCESS) {
+      // keep the rest for the next request
+      break;
+    }
+    binlog_consume(len);
+  }
+  if (binlog_used() == 0) {
+    app_log_upload_ack();
+  }
+  s_log_upload_requested = false;
+#endif // CONFIG_APP_LOG_UPLOAD_ON_REQUEST
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "awsclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  void app_log_init(void);
+  // registers the "log_upload" shadow delta. call after awsclient_shadow_init().
+  void app_log_register(awsclient_config_t *config);
+  // publishes the binlog ring when the backend requested it by the shadow delta.
+  // call while the awsclient network task runs.
+  void app_log_upload_if_requested(awsclient_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
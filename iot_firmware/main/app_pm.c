@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_pm.h"
+
+#define APP_PM_TAG "app_pm"
+
+typedef struct {
+  int64_t time_us;
+  // time holding the bus lock
+  int64_t busy_us;
+  float current_sum_ma;
+  uint32_t current_count;
+} app_pm_timeline_t;
+
+// modeled current of each phase, used when nothing was measured
+static const float s_model_current_ma[APP_PM_PHASE_MAX] = {
+  [APP_PM_PHASE_IDLE] = CONFIG_APP_PM_CURRENT_IDLE_MA,
+  [APP_PM_PHASE_SENSOR] = CONFIG_APP_PM_CURRENT_SENSOR_MA,
+  [APP_PM_PHASE_NETWORK] = CONFIG_APP_PM_CURRENT_NETWORK_MA,
+  [APP_PM_PHASE_COMPUTE] = CONFIG_APP_PM_CURRENT_COMPUTE_MA,
+};
+
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+// the phases which only keep the cpu awake for bus activity
+static const bool s_phase_light_sleep[APP_PM_PHASE_MAX] = {
+  [APP_PM_PHASE_SENSOR] = true,
+};
+#endif // CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+
+static app_pm_timeline_t s_timeline[APP_PM_PHASE_MAX];
+static app_pm_phase_t s_phase = APP_PM_PHASE_IDLE;
+static int64_t s_phase_start_us = 0;
+static int s_bus_depth = 0;
+static int64_t s_bus_start_us = 0;
+static bool s_pm_configured = false;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_pm_lock_cpu_max = NULL;
+static esp_pm_lock_handle_t s_pm_lock_no_light_sleep = NULL;
+#endif // CONFIG_PM_ENABLE
+
+static void app_pm_phase_locks(app_pm_phase_t phase, bool acquire);
+
+void app_pm_config(void)
+{
+  if (s_pm_configured) {
+    return;
+  }
+  s_pm_configured = true;
+#if CONFIG_PM_ENABLE
+  // Configure dynamic frequency scaling:
+  // maximum and minimum frequencies are set in sdkconfig,
+  // automatic light sleep is enabled if tickless idle support is enabled.
+#if CONFIG_IDF_TARGET_ESP32
+  esp_pm_config_esp32_t pm_config = {
+#elif CONFIG_IDF_TARGET_ESP32S2
+  esp_pm_config_esp32s2_t pm_config = {
+#elif CONFIG_IDF_TARGET_ESP32C3
+  esp_pm_config_esp32c3_t pm_config = {
+#endif
+    .max_freq_mhz = CONFIG_EXAMPLE_MAX_CPU_FREQ_MHZ,
+    .min_freq_mhz = CONFIG_EXAMPLE_MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    .light_sleep_enable = true
+#endif
+  };
+  ESP_ERROR_CHECK( esp_pm_configure(&pm_config) );
+#if CONFIG_IDF_TARGET_ESP32 && CONFIG_EXAMPLE_MAX_CPU_FREQ_240
+  // esp_pm can not switch between 240 MHz and an 80 MHz APB, so not only the compute phase
+  BINLOGW(APP_PM_TAG, "the holders of APB_FREQ_MAX, e.g. wifi and I2C, run at 240 MHz too");
+#endif // CONFIG_IDF_TARGET_ESP32 && CONFIG_EXAMPLE_MAX_CPU_FREQ_240
+
+  // the maximum frequency is only used while a phase holds the lock
+  if (s_pm_lock_cpu_max == NULL) {
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "app_cpu_max", &s_pm_lock_cpu_max));
+  }
+  if (s_pm_lock_no_light_sleep == NULL) {
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "app_no_sleep", &s_pm_lock_no_light_sleep));
+  }
+  // the phase may have been entered before the locks existed
+  app_pm_phase_locks(s_phase, true);
+  if (s_bus_depth > 0) {
+    esp_pm_lock_acquire(s_pm_lock_no_light_sleep);
+  }
+#endif // CONFIG_PM_ENABLE
+}
+
+void app_pm_phase(app_pm_phase_t phase)
+{
+  int64_t now = esp_timer_get_time();
+
+  if (phase == s_phase) {
+    return;
+  }
+  s_timeline[s_phase].time_us += now - s_phase_start_us;
+  s_phase_start_us = now;
+  // take the new locks first, so the frequency does not drop in between
+  app_pm_phase_locks(phase, true);
+  app_pm_phase_locks(s_phase, false);
+  s_phase = phase;
+}
+
+void app_pm_phase_current(float ma)
+{
+  s_timeline[s_phase].current_sum_ma += ma;
+  s_timeline[s_phase].current_count++;
+}
+
+void app_pm_bus_acquire(void)
+{
+  if (s_bus_depth++ > 0) {
+    return;
+  }
+  s_bus_start_us = esp_timer_get_time();
+#if CONFIG_PM_ENABLE
+  if (s_pm_lock_no_light_sleep != NULL) {
+    esp_pm_lock_acquire(s_pm_lock_no_light_sleep);
+  }
+#endif // CONFIG_PM_ENABLE
+}
+
+void app_pm_bus_release(void)
+{
+  if (s_bus_depth == 0 || --s_bus_depth > 0) {
+    return;
+  }
+#if CONFIG_PM_ENABLE
+  if (s_pm_lock_no_light_sleep != NULL) {
+    esp_pm_lock_release(s_pm_lock_no_light_sleep);
+  }
+#endif // CONFIG_PM_ENABLE
+  s_timeline[s_phase].busy_us += esp_timer_get_time() - s_bus_start_us;
+}
+
+float app_pm_report(void)
+{
+  int64_t now = esp_timer_get_time();
+  float total_uah = 0;
+  int64_t total_us = 0;
+
+  s_timeline[s_phase].time_us += now - s_phase_start_us;
+  s_phase_start_us = now;
+
+  for (int i = 0; i < APP_PM_PHASE_MAX; i++) {
+    app_pm_timeline_t *t = &s_timeline[i];
+    float ma = s_model_current_ma[i];
+    if (t->current_count > 0) {
+      ma = t->current_sum_ma / t->current_count;
+    }
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    if (s_phase_light_sleep[i] && t->time_us > 0) {
+      // active only while holding the bus, in light sleep for the rest
+      ma = (ma * t->busy_us
+            + (float)CONFIG_APP_PM_CURRENT_LIGHT_SLEEP_MA * (t->time_us - t->busy_us)) / t->time_us;
+    }
+#endif // CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    // mA * us -> uAh
+    float uah = ma * t->time_us / 3600000.0f;
+    total_uah += uah;
+    total_us += t->time_us;
+    // in uA and nAh, no float is formatted
+    BINLOGI(APP_PM_TAG, "phase %s: %u ms (busy %u ms), avg %u uA%s, %u nAh",
+            app_pm_phase_str(i), (uint32_t)(t->time_us / 1000), (uint32_t)(t->busy_us / 1000),
+            (uint32_t)(ma * 1000 + 0.5f), (t->current_count > 0) ? "" : " (model)",
+            (uint32_t)(uah * 1000 + 0.5f));
+  }
+  BINLOGI(APP_PM_TAG, "cycle: %u ms, %u nAh", (uint32_t)(total_us / 1000),
+          (uint32_t)(total_uah * 1000 + 0.5f));
+  memset(s_timeline, 0, sizeof(s_timeline));
+  return total_uah;
+}
+
+void app_pm_wakeup(void)
+{
+  // esp_timer keeps counting in light sleep
+  s_phase_start_us = esp_timer_get_time();
+}
+
+const char *app_pm_phase_str(app_pm_phase_t phase)
+{
+  switch (phase) {
+  case APP_PM_PHASE_IDLE:
+    return "idle";
+  case APP_PM_PHASE_SENSOR:
+    return "sensor";
+  case APP_PM_PHASE_NETWORK:
+    return "network";
+  case APP_PM_PHASE_COMPUTE:
+    return "compute";
+  default:
+    return "???";
+  }
+}
+
+static void app_pm_phase_locks(app_pm_phase_t phase, bool acquire)
+{
+#if CONFIG_PM_ENABLE && CONFIG_APP_PM_GOVERNOR
+  esp_pm_lock_handle_t lock = NULL;
+
+  switch (phase) {
+  case APP_PM_PHASE_COMPUTE:
+    // race to sleep: crypto finishes much faster at the maximum frequency
+    lock = s_pm_lock_cpu_max;
+    break;
+  default:
+    break;
+  }
+  if (lock == NULL) {
+    return;
+  }
+  if (acquire) {
+    esp_pm_lock_acquire(lock);
+  } else {
+    esp_pm_lock_release(lock);
+  }
+#endif // CONFIG_PM_ENABLE && CONFIG_APP_PM_GOVERNOR
+}
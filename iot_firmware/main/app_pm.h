@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  typedef enum {
+    // nothing to do. no lock, the cpu runs at the minimum frequency.
+    APP_PM_PHASE_IDLE = 0,
+    // I2C/ADC/GPIO work and the waits between them
+    APP_PM_PHASE_SENSOR,
+    // waiting for wifi association and DHCP
+    APP_PM_PHASE_NETWORK,
+    // TLS handshake, JSON encoding and MQTT. the cpu runs at the maximum frequency.
+    APP_PM_PHASE_COMPUTE,
+    APP_PM_PHASE_MAX
+  } app_pm_phase_t;
+
+  void app_pm_config(void);
+  // switches the power management locks and the phase timeline
+  void app_pm_phase(app_pm_phase_t phase);
+  // a measured current (e.g. by the PMU) while the cpu is active in the current phase
+  void app_pm_phase_current(float ma);
+  // hold around actual I2C/GPIO activity. between them the cpu may enter automatic light sleep.
+  void app_pm_bus_acquire(void);
+  void app_pm_bus_release(void);
+  // logs time, average current and charge of each phase since the last report, then resets them.
+  // returns the charge[uAh] of the cycle.
+  float app_pm_report(void);
+  // the time in light sleep since app_pm_report() is not a phase of the next cycle
+  void app_pm_wakeup(void);
+  const char *app_pm_phase_str(app_pm_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
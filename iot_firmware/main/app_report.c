@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_shadow_json_data.h"
+
+#include "app_report.h"
+
+static void app_report_field(struct jsonStruct *f, const char *key, void *data, size_t len,
+                             JsonPrimitiveType type)
+{
+  f->cb = NULL;
+  f->pKey = key;
+  f->pData = data;
+  f->dataLength = len;
+  f->type = type;
+}
+
+IoT_Error_t app_report_encode(char *buf, size_t len, const app_report_t *report)
+{
+  // the SDK takes non-const data
+  app_report_t r = *report;
+  struct jsonStruct device;
+  struct jsonStruct batt_vol;
+  struct jsonStruct batt_cur;
+  struct jsonStruct batt_chrgcur;
+  struct jsonStruct scale_gain;
+  struct jsonStruct scale_zero_offset;
+  struct jsonStruct scale_value;
+  struct jsonStruct scale_lsb;
+  struct jsonStruct timestamp;
+  IoT_Error_t err;
+
+  if (r.extra_count > APP_REPORT_EXTRA_MAX) {
+    return FAILURE;
+  }
+  app_report_field(&device, "client_id", (void *) r.client_id, strlen(r.client_id),
+                   SHADOW_JSON_STRING);
+  app_report_field(&batt_vol, "voltage_mv", &r.voltage_mv, sizeof(uint16_t), SHADOW_JSON_UINT16);
+  app_report_field(&batt_cur, "current_ma", &r.current_ma, sizeof(uint16_t), SHADOW_JSON_UINT16);
+  app_report_field(&batt_chrgcur, "charge_current_ma", &r.charge_current_ma, sizeof(uint16_t),
+                   SHADOW_JSON_UINT16);
+  app_report_field(&scale_gain, "weight_gain", &r.weight_gain, sizeof(uint16_t),
+                   SHADOW_JSON_UINT16);
+  app_report_field(&scale_zero_offset, "weight_zero_offset", &r.weight_zero_offset,
+                   sizeof(uint32_t), SHADOW_JSON_UINT32);
+  app_report_field(&scale_value, "weight_value", &r.weight_value, sizeof(int32_t),
+                   SHADOW_JSON_INT32);
+  app_report_field(&scale_lsb, "weight_lsb_e9", &r.weight_lsb_e9, sizeof(int32_t),
+                   SHADOW_JSON_INT32);
+  app_report_field(&timestamp, "time", &r.time, sizeof(uint32_t), SHADOW_JSON_UINT32);
+
+  err = aws_iot_shadow_init_json_document(buf, len);
+  if (err != SUCCESS) {
+    return err;
+  }
+  err = aws_iot_shadow_add_reported(buf, len, 9 + r.extra_count,
+                                    &device, &batt_vol, &batt_cur, &batt_chrgcur,
+                                    &scale_gain, &scale_zero_offset, &scale_value, &scale_lsb,
+                                    &timestamp,
+                                    r.extra[0], r.extra[1], r.extra[2], r.extra[3], r.extra[4],
+                                    r.extra[5], r.extra[6], r.extra[7], r.extra[8], r.extra[9],
+                                    r.extra[10], r.extra[11], r.extra[12], r.extra[13]);
+  if (err != SUCCESS) {
+    return err;
+  }
+  return aws_iot_finalize_json_document(buf, len);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aws_iot_error.h"
+#include "aws_iot_shadow_json_data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // APP_SENSORS_JSON_FIELDS_MAX sensors of app_sensors_table and the 6 optional objects of
+  // main.c, e.g. samples
+#define APP_REPORT_EXTRA_MAX 14
+
+  // the reported state of a shadow update, in the fixed-point units of app_sensors
+  typedef struct {
+    const char *client_id;
+    uint16_t voltage_mv;
+    uint16_t current_ma;
+    uint16_t charge_current_ma;
+    uint16_t weight_gain;
+    uint32_t weight_zero_offset;
+    int32_t weight_value;
+    // weight_lsb * 1e9, so no float is formatted
+    int32_t weight_lsb_e9;
+    // seconds since epoch, or since power-on before the first SNTP sync
+    uint32_t time;
+    // reported after the fields above, in this order. the first extra_count are added.
+    struct jsonStruct *extra[APP_REPORT_EXTRA_MAX];
+    uint8_t extra_count;
+  } app_report_t;
+
+  // writes {"state":{"reported":{...}},"clientToken":"..."} with the JSON encoder of the SDK.
+  // it depends on nothing of ESP-IDF, so tools/report_gen.c builds the same document on the host.
+  IoT_Error_t app_report_encode(char *buf, size_t len, const app_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
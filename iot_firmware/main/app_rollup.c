@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_sensors.h"
+#include "app_rollup.h"
+#include "app_time.h"
+
+#define APP_ROLLUP_TAG "app_rollup"
+
+// streaming statistics of one field (Welford)
+typedef struct {
+  float min;
+  float max;
+  float mean;
+  // sum of squared differences from the mean
+  float m2;
+} app_rollup_stat_t;
+
+typedef struct {
+  uint16_t count;
+  // app_time_now_sec() of the first and the last sample
+  uint32_t t0;
+  uint32_t t1;
+  app_rollup_stat_t stat[APP_ROLLUP_FIELD_MAX];
+} app_rollup_window_t;
+
+// kept in RTC slow memory across the wakes of a window
+static RTC_DATA_ATTR app_rollup_window_t s_window = {
+  .count = 0,
+};
+
+// saturated, a variance of the raw weight may not fit
+static int32_t app_rollup_round(float v)
+{
+  if (v >= (float) INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (v <= (float) INT32_MIN) {
+    return INT32_MIN;
+  }
+  return (int32_t)(v + (v < 0 ? -0.5f : 0.5f));
+}
+
+static void app_rollup_stat_add(app_rollup_stat_t *s, uint16_t n, float x)
+{
+  float delta;
+
+  if (n == 1) {
+    s->min = x;
+    s->max = x;
+    s->mean = x;
+    s->m2 = 0.0f;
+    return;
+  }
+  if (x < s->min) {
+    s->min = x;
+  }
+  if (x > s->max) {
+    s->max = x;
+  }
+  delta = x - s->mean;
+  s->mean += delta / n;
+  s->m2 += delta * (x - s->mean);
+}
+
+void app_rollup_add(void)
+{
+  float values[APP_ROLLUP_FIELD_MAX] = {
+    [APP_ROLLUP_ENV_TEMPERATURE] = env.temperature,
+    [APP_ROLLUP_ENV_HUMIDITY] = env.humidity,
+    [APP_ROLLUP_SOIL_TEMPERATURE] = soil.temperature,
+    [APP_ROLLUP_SOIL_HUMIDITY] = soil.humidity,
+    [APP_ROLLUP_LIGHT] = light,
+    [APP_ROLLUP_WATER_LEVEL] = water_level,
+    [APP_ROLLUP_WEIGHT] = weight,
+    [APP_ROLLUP_VOLTAGE] = dev.bat_mv,
+  };
+  uint32_t now = app_time_now_sec();
+
+  if (s_window.count == UINT16_MAX) {
+    BINLOGW(APP_ROLLUP_TAG, "window is full, sample dropped");
+    return;
+  }
+  s_window.count++;
+  if (s_window.count == 1) {
+    s_window.t0 = now;
+  }
+  s_window.t1 = now;
+  for (int i = 0; i < APP_ROLLUP_FIELD_MAX; i++) {
+    app_rollup_stat_add(&s_window.stat[i], s_window.count, values[i]);
+  }
+  BINLOGI(APP_ROLLUP_TAG, "rollup sample %d", s_window.count);
+}
+
+uint16_t app_rollup_count(void)
+{
+  return s_window.count;
+}
+
+void app_rollup_reset(void)
+{
+  s_window.count = 0;
+}
+
+esp_err_t app_rollup_to_json(char *buf, size_t len)
+{
+  size_t pos = 0;
+  int n;
+
+  n = snprintf(buf, len, "{\"t0\":%u,\"t1\":%u,\"n\":%u",
+               s_window.t0, s_window.t1, s_window.count);
+  if (n < 0 || n >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += n;
+  for (int i = 0; i < APP_ROLLUP_FIELD_MAX; i++) {
+    app_rollup_stat_t *s = &s_window.stat[i];
+    // sample variance. 0 for a single sample.
+    float var = (s_window.count > 1) ? s->m2 / (s_window.count - 1) : 0.0f;
+    // integers, so no float formatting is needed
+    n = snprintf(buf + pos, len - pos, ",\"%s\":[%d,%d,%d,%d]",
+                 app_rollup_field_str(i), app_rollup_round(s->min), app_rollup_round(s->max),
+                 app_rollup_round(s->mean), app_rollup_round(var));
+    if (n < 0 || n >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += n;
+  }
+  n = snprintf(buf + pos, len - pos, "}");
+  if (n < 0 || n >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void app_rollup_time_step(int64_t step_us)
+{
+  int64_t step = step_us / 1000000;
+
+  if (step == 0 || s_window.count == 0) {
+    return;
+  }
+  s_window.t0 = (uint32_t)((int64_t) s_window.t0 + step);
+  s_window.t1 = (uint32_t)((int64_t) s_window.t1 + step);
+}
+
+const char *app_rollup_field_str(app_rollup_field_t field)
+{
+  switch (field) {
+  case APP_ROLLUP_ENV_TEMPERATURE:
+    return "env_temperature_x100";
+  case APP_ROLLUP_ENV_HUMIDITY:
+    return "env_humidity_x100";
+  case APP_ROLLUP_SOIL_TEMPERATURE:
+    return "soil_temperature_x100";
+  case APP_ROLLUP_SOIL_HUMIDITY:
+    return "soil_humidity_x100";
+  case APP_ROLLUP_LIGHT:
+    return "env_light";
+  case APP_ROLLUP_WATER_LEVEL:
+    return "water_level";
+  case APP_ROLLUP_WEIGHT:
+    return "weight_value";
+  case APP_ROLLUP_VOLTAGE:
+    return "voltage_mv";
+  default:
+    return "???";
+  }
+}
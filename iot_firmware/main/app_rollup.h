@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  typedef enum {
+    APP_ROLLUP_ENV_TEMPERATURE = 0,
+    APP_ROLLUP_ENV_HUMIDITY,
+    APP_ROLLUP_SOIL_TEMPERATURE,
+    APP_ROLLUP_SOIL_HUMIDITY,
+    APP_ROLLUP_LIGHT,
+    APP_ROLLUP_WATER_LEVEL,
+    APP_ROLLUP_WEIGHT,
+    APP_ROLLUP_VOLTAGE,
+    APP_ROLLUP_FIELD_MAX
+  } app_rollup_field_t;
+
+  // adds the current values of app_sensors to the window
+  void app_rollup_add(void);
+  // number of samples in the window
+  uint16_t app_rollup_count(void);
+  // starts a new window
+  void app_rollup_reset(void);
+  // writes the window summary as a json object of integers in the fixed-point units of app_sensors,
+  // {"t0":first,"t1":last,"n":count,"<field>":[min,max,mean,variance],...}
+  esp_err_t app_rollup_to_json(char *buf, size_t len);
+  // moves the window times by the step of the clock by a time sync
+  void app_rollup_time_step(int64_t step_us);
+  const char *app_rollup_field_str(app_rollup_field_t field);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
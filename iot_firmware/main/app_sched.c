@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_sleep.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_sched.h"
+#include "app_time.h"
+#include "app_wake.h"
+#include "app_sensors.h"
+
+#define APP_SCHED_TAG "app_sched"
+
+#define APP_SCHED_PERIOD_US     ((int64_t) CONFIG_SLEEP_TIMER_TIMEOUT)
+#define APP_SCHED_SLOT_WIDTH_US ((int64_t) CONFIG_APP_WAKE_SLOT_WIDTH_MS * 1000)
+#define APP_SCHED_JITTER_US     ((int64_t) CONFIG_APP_WAKE_JITTER_MS * 1000)
+// a slot which is closer than this is skipped to the next period
+#define APP_SCHED_MIN_SLEEP_US  (1000 * 1000)
+// a sensor due within this time before the wake of the period is read on that wake
+#define APP_SCHED_MERGE_US      ((int64_t) 10 * 1000 * 1000)
+
+static RTC_DATA_ATTR int32_t s_drift_ppm = 0;
+#if !CONFIG_APP_WAKE_SLOTTED
+// next wake of the period on the clock of app_time_now_us()
+static RTC_DATA_ATTR int64_t s_period_due_us = 0;
+#endif // !CONFIG_APP_WAKE_SLOTTED
+
+// FNV-1a. tools/wake_sim.py uses the same hash.
+static uint32_t app_sched_hash(const char *s)
+{
+  uint32_t h = 2166136261u;
+  while (*s) {
+    h ^= (uint8_t) *s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+uint32_t app_sched_slots(void)
+{
+  int64_t n = APP_SCHED_PERIOD_US / APP_SCHED_SLOT_WIDTH_US;
+  return n > 0 ? (uint32_t) n : 1;
+}
+
+uint32_t app_sched_slot(void)
+{
+  return app_sched_hash(CONFIG_AWS_IOT_CLIENT_ID) % app_sched_slots();
+}
+
+// time to sleep until the next wake of the period
+static int64_t app_sched_period_sleep_us(int64_t now)
+{
+#if CONFIG_APP_WAKE_SLOTTED
+  // wall clock time after SNTP, so a fleet shares the slot boundaries
+  int64_t jitter_max = APP_SCHED_JITTER_US;
+  int64_t jitter = 0;
+  int64_t target;
+  int64_t sleep;
+
+  // keep the jitter within the slot
+  if (jitter_max > APP_SCHED_SLOT_WIDTH_US / 2) {
+    jitter_max = APP_SCHED_SLOT_WIDTH_US / 2;
+  }
+  if (jitter_max > 0) {
+    jitter = (int64_t)(esp_random() % (uint32_t)(2 * jitter_max + 1)) - jitter_max;
+  }
+  // aligned to the period on the absolute time, so the awake time and the
+  // timer error do not accumulate from cycle to cycle.
+  target = now - (now % APP_SCHED_PERIOD_US) + app_sched_slot() * APP_SCHED_SLOT_WIDTH_US + jitter;
+  while (target < now + APP_SCHED_MIN_SLEEP_US) {
+    target += APP_SCHED_PERIOD_US;
+  }
+  sleep = target - now;
+  // the sleep timer counts RTC ticks. a fast RTC makes the sleep shorter.
+  sleep += sleep / 1000000 * s_drift_ppm;
+  BINLOGI(APP_SCHED_TAG, "slot %u/%u, jitter %d ms, drift %d ppm, sleep %u ms",
+          app_sched_slot(), app_sched_slots(), (int32_t)(jitter / 1000), s_drift_ppm,
+          (uint32_t)(sleep / 1000));
+  return sleep;
+#else
+  // a sensor wake does not restart the period
+  if (app_wake_mode() != APP_WAKE_MODE_SENSOR || s_period_due_us <= now) {
+    s_period_due_us = now + APP_SCHED_PERIOD_US;
+  }
+  return s_period_due_us - now;
+#endif // CONFIG_APP_WAKE_SLOTTED
+}
+
+uint64_t app_sched_next_sleep_us(void)
+{
+  int64_t now = app_time_now_us();
+  int64_t sleep = app_sched_period_sleep_us(now);
+#if CONFIG_APP_SENSORS_MULTI_RATE
+  int64_t due = app_sensors_next_due_us() - now;
+  bool sensor = false;
+
+  // a sensor due shortly before the wake of the period waits for it
+  if (due < sleep - APP_SCHED_MERGE_US) {
+    sleep = (due > APP_SCHED_MIN_SLEEP_US) ? due : APP_SCHED_MIN_SLEEP_US;
+    sensor = true;
+  }
+  app_wake_set_sensor_next(sensor);
+  BINLOGI(APP_SCHED_TAG, "next wake: %s in %u ms", sensor ? "sensor" : "period",
+          (uint32_t)(sleep / 1000));
+#endif // CONFIG_APP_SENSORS_MULTI_RATE
+  return (uint64_t) sleep;
+}
+
+void app_sched_boot_wait(void)
+{
+#if CONFIG_APP_WAKE_SLOTTED && CONFIG_APP_WAKE_BOOT_SPREAD_MS > 0
+  int64_t slots = (int64_t) CONFIG_APP_WAKE_BOOT_SPREAD_MS * 1000 / APP_SCHED_SLOT_WIDTH_US;
+  int64_t wait;
+
+  if (esp_reset_reason() == ESP_RST_DEEPSLEEP || slots <= 1) {
+    return;
+  }
+  wait = (app_sched_slot() % slots) * APP_SCHED_SLOT_WIDTH_US;
+  if (APP_SCHED_JITTER_US > 0) {
+    wait += esp_random() % (uint32_t) APP_SCHED_JITTER_US;
+  }
+  BINLOGI(APP_SCHED_TAG, "boot slot: wait %u ms", (uint32_t)(wait / 1000));
+  if (wait < APP_SCHED_MIN_SLEEP_US) {
+    return;
+  }
+  esp_sleep_enable_timer_wakeup(wait);
+  esp_light_sleep_start();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+#endif // CONFIG_APP_WAKE_SLOTTED && CONFIG_APP_WAKE_BOOT_SPREAD_MS > 0
+}
+
+void app_sched_set_drift_ppm(int32_t ppm)
+{
+  s_drift_ppm = ppm;
+}
+
+int32_t app_sched_drift_ppm(void)
+{
+  return s_drift_ppm;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // time to sleep until the next wake slot of this device.
+  // the slot is derived from the client ID, so a fleet spreads over the period.
+  uint64_t app_sched_next_sleep_us(void);
+  // after a power-on or reset, sleeps until the boot slot of this device.
+  // the devices of a site which all came up at once do not connect at once.
+  void app_sched_boot_wait(void);
+  // slot of this device and number of slots in the period
+  uint32_t app_sched_slot(void);
+  uint32_t app_sched_slots(void);
+  // deviation of the RTC slow clock, measured against a reference (e.g. SNTP).
+  // positive when the RTC runs fast. kept in RTC memory.
+  void app_sched_set_drift_ppm(int32_t ppm);
+  int32_t app_sched_drift_ppm(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -1,13 +1,20 @@
+#include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <math.h>
 
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/i2c.h"
 #include "nvs_flash.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 
 #include "axp192.h"
 #include "esp_pahub.h"
@@ -15,54 +22,176 @@
 #include "soilsensor.h"
 #include "sht30.h"
 #include "hx711.h"
+#include "binlog.h"
+#include "busstat.h"
 
 #include "main.h"
 #include "app_sensors.h"
+#include "app_pm.h"
+#include "app_sensors_table.h"
+#include "app_topology.h"
+#include "app_acq.h"
+#include "app_time.h"
+#include "app_settings.h"
 
 #define APP_SENSORS_TAG "app_sensors"
 
-#define APP_SENSORS_HX711_KEY_LSB         (char*) "LSB"
-#define APP_SENSORS_HX711_KEY_ZERO_OFFSET (char*) "Z_OFFSET"
-
 #define PORT_A_SDA (GPIO_NUM_32)
 #define PORT_A_SCL (GPIO_NUM_33)
 
 #define APP_SENSORS_HX711_LSB_DEFAULT  (0.001f)
 
-app_sensors_device_t dev;
-app_sensors_data_t env;
-app_sensors_data_t soil;
-uint16_t water_level = 0;
-uint16_t light = 0;
-int32_t weight = 0;
-float weight_lsb = APP_SENSORS_HX711_LSB_DEFAULT;
+#define APP_SENSORS_HX711_DOUT (CONFIG_APP_HX711_DOUT_GPIO)
+#define APP_SENSORS_HX711_SCK  (CONFIG_APP_HX711_SCK_GPIO)
+// 10 SPS + margin
+#define APP_SENSORS_HX711_READY_TIMEOUT_MS (200)
+// averaged for a weight value
+#define APP_SENSORS_HX711_READS (10)
+// the hubs and the HX711 after the 5V output is switched on
+#define APP_SENSORS_RAIL_SETTLE_MS (1000)
+// a SHT30 which NACKs the fetch is still converting, e.g. at a low supply voltage
+#define APP_SENSORS_SHT30_RETRIES (3)
+#define APP_SENSORS_SHT30_RETRY_MS (2)
+// PaHub and PbHub transactions of a table row, for the plan
+#define APP_SENSORS_ROW_IO_MS (2)
+// bounds app_sensors_proc() if a sensor hangs
+#define APP_SENSORS_ACQ_TIMEOUT_MS (10000)
+// a job due within this time runs on this wake. it covers the jitter of the wake slot.
+#define APP_SENSORS_DUE_EARLY_US ((int64_t) 2000 * 1000)
+
+#if CONFIG_APP_SENSORS_MULTI_RATE
+#define APP_SENSORS_PERIOD_BATTERY_S CONFIG_APP_SENSORS_PERIOD_BATTERY_S
+#define APP_SENSORS_PERIOD_PORT_A_S  CONFIG_APP_SENSORS_PERIOD_PORT_A_S
+#define APP_SENSORS_PERIOD_WEIGHT_S  CONFIG_APP_SENSORS_PERIOD_WEIGHT_S
+#else
+// on every wake
+#define APP_SENSORS_PERIOD_BATTERY_S 0
+#define APP_SENSORS_PERIOD_PORT_A_S  0
+#define APP_SENSORS_PERIOD_WEIGHT_S  0
+#endif // CONFIG_APP_SENSORS_MULTI_RATE
 
-static uint32_t weight_initialized = 0;
+// kept in RTC memory: a sensor which is not due reports its last value
+RTC_DATA_ATTR app_sensors_device_t dev;
+RTC_DATA_ATTR app_sensors_data_t env;
+RTC_DATA_ATTR app_sensors_data_t soil;
+RTC_DATA_ATTR uint16_t water_level = 0;
+RTC_DATA_ATTR uint16_t light = 0;
+RTC_DATA_ATTR int32_t weight = 0;
+// the calibration is in app_settings, kept in RTC memory, so sample-only wakes do not need NVS.
+RTC_DATA_ATTR float weight_lsb = APP_SENSORS_HX711_LSB_DEFAULT;
+
+static uint32_t s_hx711_sum = 0;
+static uint8_t s_hx711_reads = 0;
+// end of the wait for the current conversion
+static int64_t s_hx711_ready_deadline_us = 0;
+#if CONFIG_APP_SENSORS_DISCOVERY
+// the topology
 static nvs_handle_t s_app_sensors_nvs_handle = 0;
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+
+#ifdef CONFIG_APP_RETAINED_PERIPHERALS
+// drivers are installed once and only suspended during light sleep
+static const bool s_retained = true;
+#else
+static const bool s_retained = false;
+#endif // CONFIG_APP_RETAINED_PERIPHERALS
+static bool s_pmu_opened = false;
+static bool s_rail_stable = false;
+// the rail and HX711 stay up from app_sensors_weight_open() to app_sensors_weight_close()
+static bool s_rail_held = false;
+static int64_t s_rail_held_us = 0;
+static bool s_i2c_installed = false;
+static bool s_hx711_opened = false;
+static bool s_suspended = false;
+// bits of the rows of app_sensors_table read by the last run of the PORT_A job
+static RTC_DATA_ATTR uint32_t s_rows = 0;
+// bits of the rows read without an error in this cycle
+static uint32_t s_rows_ok = 0;
+// between the steps of the PORT_A job
+static struct {
+  // PaHub channel of each row
+  uint8_t row_ch[APP_SENSORS_ROWS_MAX];
+  // I2C address of the SHT30 rows
+  uint8_t row_addr[APP_SENSORS_ROWS_MAX];
+  // rows with a conversion to collect
+  uint32_t pending_rows;
+  bool pahub;
+  uint8_t pahub_mask;
+  bool ok;
+} s_table;
 
 #ifdef CONFIG_PORT_A_I2C
 static esp_err_t app_sensors_i2c_init(void);
 static esp_err_t app_sensors_i2c_deinit(void);
-static esp_err_t app_sensors_proc_hub(void);
 #endif // CONFIG_PORT_A_I2C
+static void app_sensors_rail_on(void);
+static int32_t app_sensors_battery_step(app_acq_job_t *job);
+static int32_t app_sensors_table_step(app_acq_job_t *job);
+static int32_t app_sensors_hx711_step(app_acq_job_t *job);
+static void app_sensors_table_abort(app_acq_job_t *job);
+static void app_sensors_hx711_abort(app_acq_job_t *job);
+static int32_t app_sensors_hx711_value(uint32_t w);
+static void app_sensors_hx711_calibration(void);
+static int32_t app_sensors_table_start(void);
+static void app_sensors_table_collect(void);
+static void app_sensors_table_finish(void);
+static esp_err_t app_sensors_start(const app_sensors_desc_t *d, bool *pending);
+static esp_err_t app_sensors_collect(const app_sensors_desc_t *d);
+#if CONFIG_APP_SENSORS_DISCOVERY
+static bool app_sensors_found(const app_sensors_desc_t *d, bool anywhere, uint8_t *claimed,
+                              uint8_t *pahub_ch, app_topology_device_t *device);
+static uint32_t app_sensors_match(bool *missed);
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+
+static void app_sensors_pmu_open(void);
+static void app_sensors_pmu_close(void);
+static void app_sensors_hx711_open(void);
+static void app_sensors_hx711_close(void);
+static esp_err_t app_sensors_hx711_ready_init(void);
+static void app_sensors_hx711_ready_deinit(void);
 
-#ifdef CONFIG_PORT_A_EARTH_UNIT
-static esp_err_t app_sensors_proc_earth_unit(void);
-#endif // CONFIG_PORT_A_EARTH_UNIT
+// the acquisition of app_sensors_proc(). the waits of the jobs overlap, see app_acq.
+static app_acq_job_t s_jobs[] = {
+  {
+    .name = "battery", .rails = 0, .bus = APP_ACQ_BUS_INTERNAL,
+    .warmup_ms = 0, .planned_ms = 5,
+    .step = app_sensors_battery_step,
+  },
+  {
+    // start of the conversions, one wait for all of them, collection.
+    // the transactions of the rows are added by app_sensors_run().
+    .name = "port_a", .rails = APP_ACQ_RAIL(APP_ACQ_RAIL_5V), .bus = APP_ACQ_BUS_PORT_A,
+    .warmup_ms = 0, .planned_ms = SHT30_SINGLE_SHOT_MS + 10,
+    .step = app_sensors_table_step, .abort = app_sensors_table_abort,
+  },
+  {
+    // 10 SPS
+    .name = "hx711", .rails = APP_ACQ_RAIL(APP_ACQ_RAIL_5V), .bus = APP_ACQ_BUS_HX711,
+    .warmup_ms = 0, .planned_ms = 100 * (APP_SENSORS_HX711_READS + 1),
+    .step = app_sensors_hx711_step, .abort = app_sensors_hx711_abort,
+  },
+};
+#define APP_SENSORS_JOBS (sizeof(s_jobs) / sizeof(s_jobs[0]))
 
-union conv32 {
-  uint32_t ui32;
-  float f;
+// sampling period [s] of each job of s_jobs, 0 for every wake
+static const uint32_t s_periods_s[] = {
+  APP_SENSORS_PERIOD_BATTERY_S,
+  APP_SENSORS_PERIOD_PORT_A_S,
+  APP_SENSORS_PERIOD_WEIGHT_S,
 };
+// next run of each job on the clock of app_time_now_us(), 0 after power-on
+static RTC_DATA_ATTR int64_t s_due_us[APP_SENSORS_JOBS] = { 0 };
 
 esp_err_t app_sensors_init(void)
 {
-  esp_err_t err;
+  esp_err_t err = ESP_OK;
   int need_reset = 0;
+#if CONFIG_APP_SENSORS_DISCOVERY
   err = nvs_open("app_sensors", NVS_READWRITE, &s_app_sensors_nvs_handle);
   if (err != ESP_OK) {
     s_app_sensors_nvs_handle = 0;
   }
+#endif // CONFIG_APP_SENSORS_DISCOVERY
 
   gpio_config_t reset_config = {
     .pin_bit_mask = ((uint64_t)0x01 << RESET_PIN),
@@ -73,120 +202,539 @@ esp_err_t app_sensors_init(void)
   gpio_config(&reset_config);
   for (int i = 0; i < 10; i++) {
     int j = gpio_get_level(RESET_PIN);
-    ESP_LOGI(TAG, "gpio RESET_PIN level = %d", j);
+    BINLOGD(TAG, "gpio RESET_PIN level = %d", j);
     need_reset += j;
   }
 
-  if (need_reset == 0) {
+  // a press which woke the device from deep sleep is not a reset
+  if (need_reset == 0 && esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_EXT0) {
     // reset all
+    app_settings_clear_hx711();
+#if CONFIG_APP_SENSORS_DISCOVERY
     nvs_erase_all(s_app_sensors_nvs_handle);
+    app_topology_invalidate();
+#endif // CONFIG_APP_SENSORS_DISCOVERY
   }
+#if CONFIG_APP_SENSORS_DISCOVERY
+  app_topology_load(s_app_sensors_nvs_handle);
+#endif // CONFIG_APP_SENSORS_DISCOVERY
 
   gpio_reset_pin(RESET_PIN);
   return err;
 }
 
+static bool app_sensors_due(size_t job, int64_t now)
+{
+  return s_periods_s[job] == 0 || s_due_us[job] <= now + APP_SENSORS_DUE_EARLY_US;
+}
+
+static void app_sensors_reschedule(size_t job, int64_t now)
+{
+  int64_t period = (int64_t) s_periods_s[job] * 1000000;
+
+  if (period == 0) {
+    return;
+  }
+  // on the cadence of the first run, so the wake latency does not add up
+  s_due_us[job] += period;
+  if (s_due_us[job] <= now + APP_SENSORS_DUE_EARLY_US) {
+    s_due_us[job] = now + period;
+  }
+}
+
+int64_t app_sensors_next_due_us(void)
+{
+  int64_t next = INT64_MAX;
+
+  for (size_t i = 0; i < APP_SENSORS_JOBS; i++) {
+    if (s_periods_s[i] > 0 && s_due_us[i] < next) {
+      next = s_due_us[i];
+    }
+  }
+  return next;
+}
+
+void app_sensors_time_step(int64_t step_us)
+{
+  for (size_t i = 0; i < APP_SENSORS_JOBS; i++) {
+    if (s_due_us[i] != 0) {
+      s_due_us[i] += step_us;
+    }
+  }
+}
+
+// the hubs and the HX711 after the 5V output is switched on
+static uint32_t app_sensors_rail_settle_ms(void)
+{
+  int64_t held_ms;
+
+  if (s_rail_stable) {
+    return 0;
+  }
+  if (s_rail_held) {
+    // e.g. the reads of a stream session, only the first one may come early
+    held_ms = (esp_timer_get_time() - s_rail_held_us) / 1000;
+    if (held_ms < APP_SENSORS_RAIL_SETTLE_MS) {
+      return (uint32_t)(APP_SENSORS_RAIL_SETTLE_MS - held_ms);
+    }
+    return 0;
+  }
+  return APP_SENSORS_RAIL_SETTLE_MS;
+}
+
+static esp_err_t app_sensors_run(uint32_t mask)
+{
+  app_acq_rail_t rails[APP_ACQ_RAIL_MAX] = {
+    [APP_ACQ_RAIL_5V] = {
+      .on = app_sensors_rail_on,
+      .settle_ms = app_sensors_rail_settle_ms(),
+    },
+  };
+  app_acq_job_t jobs[APP_SENSORS_JOBS];
+  size_t n = 0;
+  uint8_t need = 0;
+  esp_err_t err = ESP_OK;
+
+  // only these jobs, so a rail or a bus nobody needs is not brought up
+  for (size_t i = 0; i < APP_SENSORS_JOBS; i++) {
+    if (mask & (1u << i)) {
+      jobs[n] = s_jobs[i];
+      if (s_jobs[i].step == app_sensors_table_step) {
+        jobs[n].planned_ms += app_sensors_table_len * APP_SENSORS_ROW_IO_MS;
+      }
+      need |= s_jobs[i].rails;
+      n++;
+    }
+  }
+  if (n == 0) {
+    return ESP_OK;
+  }
+
+  err = app_acq_run(jobs, n, rails, APP_SENSORS_ACQ_TIMEOUT_MS);
+  if (need & APP_ACQ_RAIL(APP_ACQ_RAIL_5V)) {
+    // the rail is not switched off, it stays up across light sleep
+    s_rail_stable = s_retained;
+  }
+  app_pm_bus_acquire();
+  app_sensors_pmu_close();
+  app_pm_bus_release();
+  return err;
+}
+
 esp_err_t app_sensors_proc(void)
 {
-  // PMU
-  axp192_init();
+  uint32_t mask = 0;
+  int64_t now = app_time_now_us();
+
+  for (size_t i = 0; i < APP_SENSORS_JOBS; i++) {
+    if (app_sensors_due(i, now)) {
+      app_sensors_reschedule(i, now);
+      mask |= 1u << i;
+    }
+  }
+  BINLOGI(APP_SENSORS_TAG, "jobs 0x%x due", mask);
+  // a row of a job which is not due keeps its last value, which is not read in this cycle
+  s_rows_ok = 0;
+  return app_sensors_run(mask);
+}
+
+esp_err_t app_sensors_proc_jobs(uint32_t jobs)
+{
+  return app_sensors_run(jobs & ((1u << APP_SENSORS_JOBS) - 1));
+}
+
+esp_err_t app_sensors_weight_open(void)
+{
+  app_pm_bus_acquire();
+  app_sensors_rail_on();
+  app_sensors_hx711_open();
+  app_sensors_hx711_calibration();
+  app_pm_bus_release();
+  if (!s_rail_held) {
+    s_rail_held = true;
+    s_rail_held_us = esp_timer_get_time();
+  }
+  return ESP_OK;
+}
+
+esp_err_t app_sensors_weight_read(uint32_t reads, int32_t *value)
+{
+  uint32_t sum = 0;
+
+  for (uint32_t i = 0; i < reads; i++) {
+    // DOUT goes low when the conversion is ready. the ISR disables the interrupt again.
+    while (gpio_get_level(APP_SENSORS_HX711_DOUT) != 0) {
+      gpio_intr_enable(APP_SENSORS_HX711_DOUT);
+      if (!app_acq_wait_event(APP_SENSORS_HX711_READY_TIMEOUT_MS)) {
+        gpio_intr_disable(APP_SENSORS_HX711_DOUT);
+        BINLOGW(APP_SENSORS_TAG, "HX711 is not ready");
+        return ESP_ERR_TIMEOUT;
+      }
+    }
+    gpio_intr_disable(APP_SENSORS_HX711_DOUT);
+    app_pm_bus_acquire();
+    sum += hx711_measure();
+    app_pm_bus_release();
+  }
+  *value = app_sensors_hx711_value(sum / reads);
+  return ESP_OK;
+}
+
+void app_sensors_weight_close(void)
+{
+  s_rail_held = false;
+  app_pm_bus_acquire();
+  app_sensors_hx711_close();
+  app_sensors_pmu_close();
+  app_pm_bus_release();
+}
+
+static void app_sensors_rail_on(void)
+{
+  app_sensors_pmu_open();
+  axp192_exten(true);
+}
+
+static int32_t app_sensors_battery_step(app_acq_job_t *job)
+{
+  app_sensors_pmu_open();
   axp192_chg_set_target_vol(AXP192_VOL_4_2);
   axp192_chg_set_current(AXP192_CHG_CUR_190);
   axp192_adc_batt_vol_en(true);
   axp192_adc_batt_cur_en(true);
-  dev.bat_vol = axp192_batt_vol_get() * 1.1f / 1000.0f;
-  dev.bat_cur = axp192_batt_dischrg_cur_get() * 0.5f / 1000.0f;
-  dev.bat_chrg_cur = axp192_batt_chrg_cur_get() * 0.5f / 1000.0f;
-  ESP_LOGI(APP_SENSORS_TAG,
-           "battery (voltage, current, charge_current) = (%0.2f, %0.2f, %0.2f)\n",
-           dev.bat_vol, dev.bat_cur, dev.bat_chrg_cur);
-  axp192_exten(true);
-  // wait stable output of 5V
-  vTaskDelay(1000);
-  axp192_deinit();
+  // ADC steps of the AXP192: 1.1 mV and 0.5 mA
+  dev.bat_mv = (uint16_t)(axp192_batt_vol_get() * 11 / 10);
+  dev.bat_ma = (uint16_t)(axp192_batt_dischrg_cur_get() / 2);
+  dev.bat_chrg_ma = (uint16_t)(axp192_batt_chrg_cur_get() / 2);
+  app_pm_phase_current(dev.bat_ma);
+  BINLOGI(APP_SENSORS_TAG,
+          "battery (voltage, current, charge_current) = (%u mV, %u mA, %u mA)",
+          dev.bat_mv, dev.bat_ma, dev.bat_chrg_ma);
+  return APP_ACQ_DONE;
+}
 
-#if defined(CONFIG_PORT_A_I2C)
-  ESP_LOGI(APP_SENSORS_TAG, "init I2C");
-  app_sensors_proc_hub();
-#elif defined(CONFIG_PORT_A_EARTH_UNIT)
-  ESP_LOGI(APP_SENSORS_TAG, "init earth unit");
-  app_sensors_proc_earth_unit();
-#else
-  ESP_LOGI(APP_SENSORS_TAG, "no sensors");
-#endif // CONFIG_PORT_A_I2C
-  axp192_init();
-  axp192_exten(true);
-  axp192_deinit();
+static int32_t app_sensors_table_step(app_acq_job_t *job)
+{
+  int32_t wait_ms;
 
-  hx711_init();
-  // first measurement to set gain.
-  hx711_measure();
-  if (!weight_initialized) {
-    esp_err_t e;
-    uint32_t offset = 0;
-    uint32_t lsb = 0;
-    union conv32 conv;
-    // offset
-    e = nvs_get_u32(s_app_sensors_nvs_handle, APP_SENSORS_HX711_KEY_ZERO_OFFSET, &offset);
-    ESP_LOGI(APP_SENSORS_TAG, "nvs_get_u32 ZERO_OFFSET returns %d", e);
-    if (e != ESP_OK) {
-      ESP_LOGI(APP_SENSORS_TAG, "Calibrate HX711 Zero Offset\n");
-      for (int i = 0; i < 10; i++) {
-        offset += hx711_measure();
-      }
-      offset = 0xffffff&(offset/10);
-      e = nvs_set_u32(s_app_sensors_nvs_handle, APP_SENSORS_HX711_KEY_ZERO_OFFSET, offset);
-      ESP_LOGI(APP_SENSORS_TAG, "nvs_set_u32 for ZERO_OFFSET returns %d", e);
+  if (job->steps == 0) {
+    wait_ms = app_sensors_table_start();
+    if (wait_ms > 0) {
+      return wait_ms;
     }
-    ESP_LOGI(APP_SENSORS_TAG, "HX711 Zero Offset = %d", offset);
-    hx711_set_zero_offset(offset);
+  } else {
+    app_sensors_table_collect();
+  }
+  app_sensors_table_finish();
+  return APP_ACQ_DONE;
+}
+
+static void app_sensors_table_abort(app_acq_job_t *job)
+{
+  // the rows not collected yet are not read
+  s_table.ok = false;
+  app_sensors_table_finish();
+}
+
+// 24-bit two's complement
+static int32_t app_sensors_hx711_value(uint32_t w)
+{
+  if (w > 0x7fffff) {
+    w = ~w & 0xffffff;
+    return -1 * w +1;
+  }
+  return w;
+}
+
+// the DOUT interrupt or the conversion period, whichever comes first
+static int32_t app_sensors_hx711_next(app_acq_job_t *job)
+{
+  s_hx711_ready_deadline_us = esp_timer_get_time() + APP_SENSORS_HX711_READY_TIMEOUT_MS * 1000LL;
+  job->on_event = true;
+  gpio_intr_enable(APP_SENSORS_HX711_DOUT);
+  return APP_SENSORS_HX711_READY_TIMEOUT_MS;
+}
+
+static int32_t app_sensors_hx711_step(app_acq_job_t *job)
+{
+  if (job->steps == 0) {
+    app_sensors_hx711_open();
+    // first measurement to set gain. also the first conversion after power down.
+    hx711_measure();
+    app_sensors_hx711_calibration();
+    s_hx711_sum = 0;
+    s_hx711_reads = 0;
+    return app_sensors_hx711_next(job);
+  }
+  if (gpio_get_level(APP_SENSORS_HX711_DOUT) != 0
+      && esp_timer_get_time() < s_hx711_ready_deadline_us) {
+    // a spurious interrupt, e.g. of GPIO36/39 when wifi or the ADC powers up (ESP32 erratum)
+    job->on_event = true;
+    gpio_intr_enable(APP_SENSORS_HX711_DOUT);
+    return (int32_t)((s_hx711_ready_deadline_us - esp_timer_get_time()) / 1000) + 1;
+  }
+  if (gpio_get_level(APP_SENSORS_HX711_DOUT) != 0) {
+    // no conversion within the timeout. weight keeps its last value.
+    BINLOGW(APP_SENSORS_TAG, "HX711 is not ready");
+    app_sensors_hx711_abort(job);
+    return APP_ACQ_FAILED;
+  }
+  s_hx711_sum += hx711_measure();
+  s_hx711_reads++;
+  if (s_hx711_reads < APP_SENSORS_HX711_READS) {
+    return app_sensors_hx711_next(job);
+  }
+
+  weight = app_sensors_hx711_value(s_hx711_sum / APP_SENSORS_HX711_READS);
+  app_sensors_hx711_close();
+  BINLOGI(APP_SENSORS_TAG, "HX711 returns %d", weight);
+  return APP_ACQ_DONE;
+}
+
+static void app_sensors_hx711_abort(app_acq_job_t *job)
+{
+  gpio_intr_disable(APP_SENSORS_HX711_DOUT);
+  app_sensors_hx711_close();
+}
 
-    // weight scale lsb
-    e = nvs_get_u32(s_app_sensors_nvs_handle, APP_SENSORS_HX711_KEY_LSB, &lsb);
-    if (e != ESP_OK) {
-      ESP_LOGI(APP_SENSORS_TAG, "Failed to load lsb\n");
+static void app_sensors_hx711_calibration(void)
+{
+  // served from RTC memory, NVS is only written when a value is new
+  const app_settings_t *settings = app_settings_get();
+  uint32_t offset = settings->hx711_zero_offset;
+  float lsb = 0;
+
+  if (!(settings->flags & APP_SETTINGS_HX711_ZERO_OFFSET)) {
+    BINLOGI(APP_SENSORS_TAG, "Calibrate HX711 Zero Offset");
+    offset = 0;
+    for (int i = 0; i < 10; i++) {
+      offset += hx711_measure();
+    }
+    offset = 0xffffff&(offset/10);
+  }
+  if (settings->flags & APP_SETTINGS_HX711_LSB) {
+    lsb = settings->hx711_lsb;
+  } else {
 #ifdef CONFIG_WEIGHT_SCALE_PER_BIT
-      weight_lsb = atof(CONFIG_WEIGHT_SCALE_PER_BIT);
-      ESP_LOGI(APP_SENSORS_TAG, "Used CONFIG_WEIGHT_SCALE_PER_BIT as weight_lsb: %02f", (float)weight_lsb);
-      conv.f = weight_lsb;
-      e = nvs_set_u32(s_app_sensors_nvs_handle, APP_SENSORS_HX711_KEY_LSB, conv.ui32);
-      ESP_LOGI(APP_SENSORS_TAG, "nvs_set_u32 for LSB returns %d", e);
-#else
-      weight_lsb = APP_SENSORS_HX711_LSB_DEFAULT;
+    lsb = atof(CONFIG_WEIGHT_SCALE_PER_BIT);
+    // weight_lsb * 1e9, as in the shadow, so no float is formatted
+    BINLOGI(APP_SENSORS_TAG, "Used CONFIG_WEIGHT_SCALE_PER_BIT as weight_lsb_e9: %d",
+            (int32_t)(lsb * 1e9f + 0.5f));
 #endif // CONFIG_WEIGHT_SCALE_PER_BIT
-    } else {
-      if (lsb > 0) {
-        conv.ui32 = lsb;
-        weight_lsb = conv.f;
-      }
-    }
-    weight_initialized = 1;
   }
+  app_settings_set_hx711(offset, lsb);
+  weight_lsb = (lsb > 0) ? lsb : APP_SENSORS_HX711_LSB_DEFAULT;
+  hx711_set_zero_offset(offset);
+}
 
-  ESP_LOGI(APP_SENSORS_TAG, "Wait for HX711 READY...");
-  uint32_t w = 0;
-  for (int i = 0; i < 10; i++) {
-    hx711_wait_for_ready();
-    w += hx711_measure();
+void app_sensors_suspend(void)
+{
+  if (s_suspended) {
+    return;
+  }
+  if (s_hx711_opened) {
+    // DOUT stays low in power down, it must not wake the sleep
+    gpio_wakeup_disable(APP_SENSORS_HX711_DOUT);
+    // SCK high for more than 60us powers HX711 down
+    gpio_set_level(APP_SENSORS_HX711_SCK, 1);
+    gpio_hold_en(APP_SENSORS_HX711_SCK);
+  }
+#ifdef CONFIG_PORT_A_I2C
+  if (s_i2c_installed) {
+    // keep the bus idle, a glitch can leave the hubs in the middle of a transfer
+    gpio_hold_en(PORT_A_SDA);
+    gpio_hold_en(PORT_A_SCL);
+  }
+#endif // CONFIG_PORT_A_I2C
+  s_suspended = true;
+}
+
+void app_sensors_resume(void)
+{
+  if (!s_suspended) {
+    return;
+  }
+#ifdef CONFIG_PORT_A_I2C
+  if (s_i2c_installed) {
+    gpio_hold_dis(PORT_A_SDA);
+    gpio_hold_dis(PORT_A_SCL);
   }
+#endif // CONFIG_PORT_A_I2C
+  if (s_hx711_opened) {
+    // powers HX711 up. gain and the first conversion are set again by the next measurement.
+    gpio_hold_dis(APP_SENSORS_HX711_SCK);
+    gpio_set_level(APP_SENSORS_HX711_SCK, 0);
+    gpio_wakeup_enable(APP_SENSORS_HX711_DOUT, GPIO_INTR_LOW_LEVEL);
+    // the wakeup source may have been disabled after the sleep
+    esp_sleep_enable_gpio_wakeup();
+  }
+  s_suspended = false;
+}
 
-  w = w/10;
-  if (w > 0x7fffff) {
-    w = ~w & 0xffffff;
-    weight = -1 * w +1;
-  } else {
-    weight = w;
+void app_sensors_release(void)
+{
+  // the pads of SCK, SDA and SCL are RTC pads. their holds would last through the deep sleep
+  // and the boot after it, where nothing releases them.
+  if (s_hx711_opened) {
+    gpio_hold_dis(APP_SENSORS_HX711_SCK);
+    app_sensors_hx711_ready_deinit();
+    hx711_deinit();
+    s_hx711_opened = false;
   }
+#ifdef CONFIG_PORT_A_I2C
+  if (s_i2c_installed) {
+    gpio_hold_dis(PORT_A_SDA);
+    gpio_hold_dis(PORT_A_SCL);
+    i2c_driver_delete(I2C_NUM_1);
+    s_i2c_installed = false;
+  }
+#endif // CONFIG_PORT_A_I2C
+  s_suspended = false;
+}
 
+static void app_sensors_pmu_open(void)
+{
+  if (s_pmu_opened) {
+    return;
+  }
+  axp192_init();
+  s_pmu_opened = true;
+}
+
+static void app_sensors_pmu_close(void)
+{
+  if (s_retained || !s_pmu_opened) {
+    return;
+  }
+  axp192_deinit();
+  s_pmu_opened = false;
+}
+
+static void app_sensors_hx711_open(void)
+{
+  if (s_hx711_opened) {
+    return;
+  }
+  hx711_init();
+  app_sensors_hx711_ready_init();
+  s_hx711_opened = true;
+}
+
+static void app_sensors_hx711_close(void)
+{
+  if (s_retained || !s_hx711_opened) {
+    return;
+  }
+  app_sensors_hx711_ready_deinit();
   hx711_deinit();
-  ESP_LOGI(APP_SENSORS_TAG, "HX711 returns %d", weight);
+  s_hx711_opened = false;
+}
+
+static void IRAM_ATTR app_sensors_hx711_ready_isr(void *arg)
+{
+  // level interrupt. it is enabled again by the next step.
+  gpio_intr_disable(APP_SENSORS_HX711_DOUT);
+  app_acq_notify_from_isr();
+}
+
+static esp_err_t app_sensors_hx711_ready_init(void)
+{
+  esp_err_t err;
+  err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    // ESP_ERR_INVALID_STATE: already installed
+    return err;
+  }
+  gpio_set_intr_type(APP_SENSORS_HX711_DOUT, GPIO_INTR_LOW_LEVEL);
+  gpio_intr_disable(APP_SENSORS_HX711_DOUT);
+  gpio_isr_handler_add(APP_SENSORS_HX711_DOUT, app_sensors_hx711_ready_isr, NULL);
+  // DOUT goes low when the conversion is ready. it wakes the cpu from automatic light sleep.
+  gpio_wakeup_enable(APP_SENSORS_HX711_DOUT, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
   return ESP_OK;
 }
 
-/* esp_err_t app_sensors_report_as_json(struct jsonStruct *json) */
-/* { */
-/*   return ESP_OK; */
-/* } */
+static void app_sensors_hx711_ready_deinit(void)
+{
+  gpio_wakeup_disable(APP_SENSORS_HX711_DOUT);
+  gpio_isr_handler_remove(APP_SENSORS_HX711_DOUT);
+}
+
+size_t app_sensors_json_fields(struct jsonStruct *fields, size_t max)
+{
+  size_t n = 0;
+
+  for (size_t i = 0; i < app_sensors_table_len; i++) {
+    const app_sensors_desc_t *d = &app_sensors_table[i];
+    // the other pots are in app_sensors_pots_to_json()
+    if (!(s_rows & (1u << i)) || d->pot > 1) {
+      continue;
+    }
+    for (int j = 0; j < APP_SENSORS_OUT_MAX && d->out[j] != NULL && n < max; j++) {
+      struct jsonStruct *f = &fields[n++];
+      f->cb = NULL;
+      f->pKey = d->keys[j];
+      f->pData = d->out[j];
+      if (d->driver == APP_SENSORS_SHT30 && j == 0) {
+        f->dataLength = sizeof(int16_t);
+        f->type = SHADOW_JSON_INT16;
+      } else {
+        f->dataLength = sizeof(uint16_t);
+        f->type = SHADOW_JSON_UINT16;
+      }
+    }
+  }
+  return n;
+}
+
+esp_err_t app_sensors_pots_to_json(char *buf, size_t len)
+{
+  size_t pos = 0;
+  int n;
+
+  n = snprintf(buf, len, "{");
+  if (n < 0 || n >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += n;
+  for (uint8_t pot = 1; pot <= CONFIG_APP_SENSORS_POTS; pot++) {
+    bool first = true;
+    for (size_t i = 0; i < app_sensors_table_len; i++) {
+      const app_sensors_desc_t *d = &app_sensors_table[i];
+      if (!(s_rows & (1u << i)) || d->pot != pot) {
+        continue;
+      }
+      for (int j = 0; j < APP_SENSORS_OUT_MAX && d->out[j] != NULL; j++) {
+        int32_t v = (d->driver == APP_SENSORS_SHT30 && j == 0)
+          ? *(int16_t *) d->out[j] : *(uint16_t *) d->out[j];
+        if (first) {
+          // opens the object of the pot
+          n = snprintf(buf + pos, len - pos, "%s\"%u\":{\"%s\":%d",
+                       (pos > 1) ? "," : "", pot, d->keys[j], v);
+        } else {
+          n = snprintf(buf + pos, len - pos, ",\"%s\":%d", d->keys[j], v);
+        }
+        if (n < 0 || n >= len - pos) {
+          return ESP_ERR_NO_MEM;
+        }
+        pos += n;
+        first = false;
+      }
+    }
+    if (!first) {
+      n = snprintf(buf + pos, len - pos, "}");
+      if (n < 0 || n >= len - pos) {
+        return ESP_ERR_NO_MEM;
+      }
+      pos += n;
+    }
+  }
+  n = snprintf(buf + pos, len - pos, "}");
+  if (n < 0 || n >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
 
 #ifdef CONFIG_PORT_A_I2C
 static esp_err_t app_sensors_i2c_init(void)
@@ -197,6 +745,9 @@ static esp_err_t app_sensors_i2c_init(void)
 #define APP_SENSORS_PULLUP GPIO_PULLUP_DISABLE
 #endif // CONFIG_I2C_PULLUP_ENABLE
   esp_err_t err;
+  if (s_i2c_installed) {
+    return ESP_OK;
+  }
   i2c_config_t i2c_config = {
     .mode = I2C_MODE_MASTER,
     .sda_io_num = PORT_A_SDA,
@@ -207,17 +758,18 @@ static esp_err_t app_sensors_i2c_init(void)
   };
   err = i2c_param_config(I2C_NUM_1, &i2c_config);
   if (err != ESP_OK) {
-    ESP_LOGI(APP_SENSORS_TAG, "i2c_param_config returns %d\n", err);
+    BINLOGI(APP_SENSORS_TAG, "i2c_param_config returns %d", err);
     return err;
   }
   err = i2c_driver_install(I2C_NUM_1, I2C_MODE_MASTER, 0, 0, 0);
   if (err != ESP_OK) {
-    ESP_LOGI(APP_SENSORS_TAG, "i2c_driver_install returns %d\n", err);
+    BINLOGI(APP_SENSORS_TAG, "i2c_driver_install returns %d", err);
     return err;
   }
+  s_i2c_installed = true;
   err = i2c_set_timeout(I2C_NUM_1, CONFIG_I2C_TIMEOUT);
   if (err != ESP_OK) {
-    ESP_LOGI(APP_SENSORS_TAG, "i2c_set_timeout returns %d\n", err);
+    BINLOGI(APP_SENSORS_TAG, "i2c_set_timeout returns %d", err);
   }
 
   return err;
@@ -225,93 +777,407 @@ static esp_err_t app_sensors_i2c_init(void)
 
 static esp_err_t app_sensors_i2c_deinit(void)
 {
+  if (s_retained || !s_i2c_installed) {
+    return ESP_OK;
+  }
+  s_i2c_installed = false;
   return i2c_driver_delete(I2C_NUM_1);
 }
 #endif // CONFIG_PORT_A_I2C
 
-static esp_err_t app_sensors_proc_hub(void)
+#ifdef APP_SENSORS_USE_PAHUB
+// selects the PaHub channel if it is not selected yet
+static esp_err_t app_sensors_select(uint8_t ch, uint8_t *mask)
+{
+  esp_err_t err;
+
+  if (ch == APP_SENSORS_NO_CH) {
+    // on the trunk, whichever channel is selected
+    busstat_select(BUSSTAT_TRUNK);
+    return ESP_OK;
+  }
+  if (*mask == (1 << ch)) {
+    busstat_select(ch);
+    return ESP_OK;
+  }
+  *mask = 1 << ch;
+  err = pahub_ch(*mask);
+  BINLOGI(APP_SENSORS_TAG, "pahub_ch enable ch%d returns %d", ch, err);
+  return err;
+}
+#endif // APP_SENSORS_USE_PAHUB
+
+bool app_sensors_read_ok(const void *value)
+{
+  for (size_t i = 0; i < app_sensors_table_len && i < APP_SENSORS_ROWS_MAX; i++) {
+    for (size_t k = 0; k < APP_SENSORS_OUT_MAX; k++) {
+      if (app_sensors_table[i].out[k] == value && (s_rows_ok & (1u << i))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+#if defined(APP_SENSORS_USE_PBHUB) && defined(CONFIG_PORT_A_I2C)
+// PaHub channel of the PbHub, APP_SENSORS_NO_CH on the trunk. called with the I2C driver installed.
+// from the topology or the table, which are kept across deep sleep unlike s_table.
+static esp_err_t app_sensors_pbhub_pahub_ch(bool *pahub, uint8_t *pahub_ch)
+{
+  *pahub = false;
+  *pahub_ch = APP_SENSORS_NO_CH;
+#if CONFIG_APP_SENSORS_DISCOVERY
+  uint8_t claimed[APP_TOPOLOGY_TRUNK + 1] = { 0 };
+  app_topology_device_t device;
+
+  if (!app_topology_known()) {
+    app_topology_discover(I2C_NUM_1, s_app_sensors_nvs_handle);
+  }
+  // the PbHub of the analog rows, as app_sensors_match() finds it
+  for (size_t i = 0; i < app_sensors_table_len; i++) {
+    const app_sensors_desc_t *d = &app_sensors_table[i];
+    if (d->driver != APP_SENSORS_PBHUB_ANALOG) {
+      continue;
+    }
+    if (!app_sensors_found(d, false, claimed, pahub_ch, &device)
+        && !app_sensors_found(d, true, claimed, pahub_ch, &device)) {
+      return ESP_ERR_NOT_FOUND;
+    }
+    *pahub = app_topology_has_pahub();
+    return ESP_OK;
+  }
+  return ESP_ERR_NOT_FOUND;
+#else
+  for (size_t i = 0; i < app_sensors_table_len; i++) {
+    if (app_sensors_table[i].driver == APP_SENSORS_PBHUB_ANALOG) {
+#ifdef APP_SENSORS_USE_PAHUB
+      *pahub = true;
+#endif // APP_SENSORS_USE_PAHUB
+      *pahub_ch = app_sensors_table[i].pahub_ch;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NOT_FOUND;
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+}
+#endif // APP_SENSORS_USE_PBHUB && CONFIG_PORT_A_I2C
+
+esp_err_t app_sensors_pbhub_output(uint8_t ch, bool on)
+{
+#if defined(APP_SENSORS_USE_PBHUB) && defined(CONFIG_PORT_A_I2C)
+  bool pahub;
+  uint8_t pahub_ch;
+  esp_err_t err;
+
+  app_pm_bus_acquire();
+  app_sensors_i2c_init();
+  err = app_sensors_pbhub_pahub_ch(&pahub, &pahub_ch);
+#ifdef APP_SENSORS_USE_PAHUB
+  if (err == ESP_OK && pahub) {
+    // whatever the PaHub has selected, e.g. after a power cycle of the 5V rail
+    uint8_t mask = PAHUB_DISABLE_CH_ALL;
+    err = app_sensors_select(pahub_ch, &mask);
+    s_table.pahub_mask = mask;
+  }
+#endif // APP_SENSORS_USE_PAHUB
+  if (err == ESP_OK) {
+    err = pbhub_digital_set((pbhub_channel_t) ch, PBHUB_IO0, on ? 1 : 0);
+  }
+  app_sensors_i2c_deinit();
+  app_pm_bus_release();
+  return err;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif // APP_SENSORS_USE_PBHUB && CONFIG_PORT_A_I2C
+}
+
+// the PaHub channel and the address of a row, before its transactions
+static void app_sensors_row_select(size_t i)
+{
+#ifdef APP_SENSORS_USE_PAHUB
+  if (s_table.pahub) {
+    app_sensors_select(s_table.row_ch[i], &s_table.pahub_mask);
+  }
+#endif // APP_SENSORS_USE_PAHUB
+#ifdef APP_SENSORS_USE_SHT30
+  if (app_sensors_table[i].driver == APP_SENSORS_SHT30) {
+    sht30_set_addr(s_table.row_addr[i]);
+  }
+#endif // APP_SENSORS_USE_SHT30
+}
+
+// starts the conversions of all rows, so the time does not grow with the number of pots.
+// returns the time [ms] until they can be collected, 0 if nothing is to be collected.
+static int32_t app_sensors_table_start(void)
 {
   esp_err_t err = ESP_OK;
+  int64_t deadline_us = 0;
+  int64_t now;
+#if CONFIG_APP_SENSORS_DISCOVERY
+  uint32_t matched;
+  bool missed = false;
+#endif // CONFIG_APP_SENSORS_DISCOVERY
 
+  s_rows = 0;
+  s_rows_ok = 0;
+  s_table.pending_rows = 0;
+  s_table.ok = true;
+  if (app_sensors_table_len == 0) {
+    BINLOGI(APP_SENSORS_TAG, "no sensors");
+    return 0;
+  }
 #ifdef CONFIG_PORT_A_I2C
   app_sensors_i2c_init();
 #endif // CONFIG_PORT_A_I2C
 
-#ifdef CONFIG_I2C_PORT_A_HAS_PAHUB
-  // HUB Init
-  vTaskDelay(pdMS_TO_TICKS(1000));
-  err = pahub_ch(PAHUB_DISABLE_CH_ALL);
-  ESP_LOGI(APP_SENSORS_TAG, "pahub_ch disable ALL returns %d", err);
-
-#ifdef CONFIG_I2C_SHT30_FOR_ENV_ON_CH0_ON_PAHUB_ON_PORT_A
-  err = pahub_ch(PAHUB_ENABLE_CH0);
-  ESP_LOGI(APP_SENSORS_TAG, "pahub_ch enable ch0 returns %d", err);
-  uint16_t temp_raw = 0;
-  uint16_t humidity_raw = 0;
-  uint16_t c = 5;
-  do {
-    err = sht30_read_measured_values(&temp_raw, &humidity_raw);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    c--;
-  } while (c > 0);
-
-  if (err == ESP_OK) {
-    env.temperature = sht30_calc_celsius(temp_raw);
-    env.humidity = sht30_calc_relative_humidity(humidity_raw);
-    ESP_LOGI(APP_SENSORS_TAG, "temperature = %0.2f, humidity = %0.2f", env.temperature, env.humidity);
-  }
-  err = pahub_ch(PAHUB_DISABLE_CH_ALL);
-#endif // CONFIG_I2C_SHT30_FOR_ENV_ON_CH0_ON_PAHUB_ON_PORT_A
-
-#ifdef CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
-  err = pahub_ch(PAHUB_ENABLE_CH1);
-  ESP_LOGI(APP_SENSORS_TAG, "pahub_ch enable ch1 returns %d", err);
-  uint16_t soil_temp_raw = 0;
-  uint16_t soil_humidity_raw = 0;
-  c = 5;
-  do {
-    err = sht30_read_measured_values(&soil_temp_raw, &soil_humidity_raw);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    c--;
-  } while (c > 0);
-
-  if (err == ESP_OK) {
-    soil.temperature = sht30_calc_celsius(soil_temp_raw);
-    soil.humidity = sht30_calc_relative_humidity(soil_humidity_raw);
-    ESP_LOGI(APP_SENSORS_TAG, "soil_temperature = %0.2f, soil_humidity = %0.2f", soil.temperature, soil.humidity);
+#ifdef APP_SENSORS_USE_PAHUB
+  s_table.pahub = true;
+  s_table.pahub_mask = PAHUB_DISABLE_CH_ALL;
+#if CONFIG_APP_SENSORS_DISCOVERY
+  if (!app_topology_known()) {
+    app_topology_discover(I2C_NUM_1, s_app_sensors_nvs_handle);
+  }
+  s_table.pahub = app_topology_has_pahub();
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+  if (s_table.pahub) {
+    err = pahub_ch(PAHUB_DISABLE_CH_ALL);
+    BINLOGI(APP_SENSORS_TAG, "pahub_ch disable ALL returns %d", err);
   }
-  err = pahub_ch(PAHUB_DISABLE_CH_ALL);
-#endif // CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A=y
-#endif // CONFIG_I2C_PORT_A_HAS_PAHUB
+#endif // APP_SENSORS_USE_PAHUB
+#if CONFIG_APP_SENSORS_DISCOVERY
+  matched = app_sensors_match(&missed);
+  // a sensor connected later or missed by the discovery is found by the next one
+  app_topology_missed(missed);
+#endif // CONFIG_APP_SENSORS_DISCOVERY
 
-#ifdef CONFIG_I2C_PORT_A_HAS_PBHUB
-#ifdef CONFIG_I2C_PORT_A_HAS_PAHUB
-  err = pahub_ch(PAHUB_ENABLE_CH5);
-  ESP_LOGI(APP_SENSORS_TAG, "pahub_ch enable ch5 returns %d", err);
-#endif // CONFIG_I2C_PORT_A_HAS_PAHUB
-#ifdef CONFIG_I2C_PORT_A_HAS_LIGHTSENSOR_VIA_CH0_ON_PBHUB
-  light = pbhub_analog_read(PBHUB_CH0);
-#endif // CONFIG_I2C_PORT_A_HAS_LIGHTSENSOR_VIA_CH0_ON_PBHUB
+  for (size_t i = 0; i < app_sensors_table_len && i < APP_SENSORS_ROWS_MAX; i++) {
+    const app_sensors_desc_t *d = &app_sensors_table[i];
+    bool pending = false;
+#if CONFIG_APP_SENSORS_DISCOVERY
+    if (!(matched & (1u << i))) {
+      continue;
+    }
+#else
+    s_table.row_ch[i] = d->pahub_ch;
+    s_table.row_addr[i] = SHT30_I2C_ADDR;
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+    app_sensors_row_select(i);
+    err = app_sensors_start(d, &pending);
+    s_rows |= 1u << i;
+    if (pending) {
+      int64_t t = esp_timer_get_time() + (int64_t) d->warmup_ms * 1000;
+      s_table.pending_rows |= 1u << i;
+      if (t > deadline_us) {
+        deadline_us = t;
+      }
+    } else if (err == ESP_OK) {
+      s_rows_ok |= 1u << i;
+    }
+    s_table.ok = s_table.ok && (err == ESP_OK);
+  }
+  if (s_table.pending_rows == 0) {
+    return 0;
+  }
+  now = esp_timer_get_time();
+  // at least 1 ms, 0 means nothing to collect
+  return (deadline_us > now) ? (int32_t)((deadline_us - now + 999) / 1000) : 1;
+}
 
-#ifdef CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
-  water_level = pbhub_analog_read(PBHUB_CH1);
-#endif // CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+static void app_sensors_table_collect(void)
+{
+  esp_err_t err;
 
-#endif // CONFIG_I2C_PORT_A_HAS_PBHUB
+  for (size_t i = 0; i < app_sensors_table_len && i < APP_SENSORS_ROWS_MAX; i++) {
+    if (!(s_table.pending_rows & (1u << i))) {
+      continue;
+    }
+    app_sensors_row_select(i);
+    err = app_sensors_collect(&app_sensors_table[i]);
+    if (err == ESP_OK) {
+      s_rows_ok |= 1u << i;
+    }
+    s_table.ok = s_table.ok && (err == ESP_OK);
+  }
+}
 
+static void app_sensors_table_finish(void)
+{
+  if (app_sensors_table_len == 0) {
+    return;
+  }
+#if CONFIG_APP_SENSORS_DISCOVERY
+  // a sensor which stopped answering is dropped by the next discovery
+  app_topology_result(s_table.ok);
+#endif // CONFIG_APP_SENSORS_DISCOVERY
+  BINLOGI(APP_SENSORS_TAG, "rows 0x%x read, ok %d", s_rows, s_table.ok);
 #ifdef CONFIG_PORT_A_I2C
   // HUB Deinit
-  err = app_sensors_i2c_deinit();
+  app_sensors_i2c_deinit();
 #endif // CONFIG_PORT_A_I2C
+}
+
+// called with the bus acquired. pending is set if the value is collected by app_sensors_collect()
+static esp_err_t app_sensors_start(const app_sensors_desc_t *d, bool *pending)
+{
+  esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+
+  switch (d->driver) {
+#ifdef APP_SENSORS_USE_SHT30
+  case APP_SENSORS_SHT30:
+    err = sht30_start_single_shot();
+    *pending = (err == ESP_OK);
+    break;
+#endif // APP_SENSORS_USE_SHT30
+#ifdef APP_SENSORS_USE_PBHUB
+  case APP_SENSORS_PBHUB_ANALOG:
+    err = pbhub_analog_get((pbhub_channel_t) d->pbhub_ch, (uint16_t *) d->out[0]);
+    BINLOGI(APP_SENSORS_TAG, "pot %d: %s = %u, returns %d", d->pot, d->keys[0],
+            *(uint16_t *) d->out[0], err);
+    break;
+#endif // APP_SENSORS_USE_PBHUB
+#ifdef APP_SENSORS_USE_EARTH_UNIT
+  case APP_SENSORS_EARTH_UNIT:
+    soilsensor_init();
+    *(uint16_t *) d->out[0] = soilsensor_get_value();
+    BINLOGI(APP_SENSORS_TAG, "pot %d: %s = %u", d->pot, d->keys[0], *(uint16_t *) d->out[0]);
+    err = ESP_OK;
+    break;
+#endif // APP_SENSORS_USE_EARTH_UNIT
+  default:
+    break;
+  }
   return err;
+}
 
+// called with the bus acquired, warmup_ms after app_sensors_start()
+static esp_err_t app_sensors_collect(const app_sensors_desc_t *d)
+{
+  esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+
+  switch (d->driver) {
+#ifdef APP_SENSORS_USE_SHT30
+  case APP_SENSORS_SHT30: {
+    uint16_t temp_raw = 0;
+    uint16_t humidity_raw = 0;
+    err = sht30_fetch_single_shot(&temp_raw, &humidity_raw);
+    for (int r = 0; err == ESP_FAIL && r < APP_SENSORS_SHT30_RETRIES; r++) {
+      busstat_retry(BUSSTAT_SHT30);
+      // at least a tick
+      vTaskDelay(pdMS_TO_TICKS(APP_SENSORS_SHT30_RETRY_MS) + 1);
+      err = sht30_fetch_single_shot(&temp_raw, &humidity_raw);
+    }
+    if (err == ESP_OK) {
+      *(int16_t *) d->out[0] = sht30_calc_centi_celsius(temp_raw);
+      *(uint16_t *) d->out[1] = sht30_calc_centi_relative_humidity(humidity_raw);
+      BINLOGI(APP_SENSORS_TAG, "pot %d: %s = %d, %s = %u", d->pot, d->keys[0],
+              *(int16_t *) d->out[0], d->keys[1], *(uint16_t *) d->out[1]);
+    } else {
+      BINLOGW(APP_SENSORS_TAG, "pot %d: %s returns %d", d->pot, d->keys[0], err);
+    }
+    break;
+  }
+#endif // APP_SENSORS_USE_SHT30
+  default:
+    break;
+  }
+  return err;
 }
 
-#ifdef CONFIG_PORT_A_EARTH_UNIT
-static esp_err_t app_sensors_proc_earth_unit(void)
+#if CONFIG_APP_SENSORS_DISCOVERY
+// the devices which serve a row, in the order they are taken. 0 if not on I2C.
+static size_t app_sensors_devices(const app_sensors_desc_t *d, app_topology_device_t *devices)
 {
-  soilsensor_init();
-  water_level = soilsensor_get_value();
-  return ESP_OK;
+  switch (d->driver) {
+  case APP_SENSORS_SHT30:
+    devices[0] = APP_TOPOLOGY_SHT30;
+    devices[1] = APP_TOPOLOGY_SHT30_ALT;
+    return 2;
+  case APP_SENSORS_PBHUB_ANALOG:
+    devices[0] = APP_TOPOLOGY_PBHUB;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// takes a device of the row on ch, a PaHub channel or APP_TOPOLOGY_TRUNK, which no other row took.
+// the channels of a PbHub are shared by its rows.
+static bool app_sensors_take(const app_sensors_desc_t *d, uint8_t ch, uint8_t *claimed,
+                             app_topology_device_t *device)
+{
+  app_topology_device_t devices[2];
+  size_t n = app_sensors_devices(d, devices);
+
+  for (size_t k = 0; k < n; k++) {
+    if (!app_topology_has(ch, devices[k]) || (claimed[ch] & (1 << devices[k]))) {
+      continue;
+    }
+    if (d->driver != APP_SENSORS_PBHUB_ANALOG) {
+      claimed[ch] |= 1 << devices[k];
+    }
+    *device = devices[k];
+    return true;
+  }
+  return false;
+}
+
+// true if a device of the row was found on its channel of the table, or on any channel if
+// anywhere. pahub_ch is APP_SENSORS_NO_CH for a device on the trunk.
+static bool app_sensors_found(const app_sensors_desc_t *d, bool anywhere, uint8_t *claimed,
+                              uint8_t *pahub_ch, app_topology_device_t *device)
+{
+  uint8_t ch = APP_TOPOLOGY_TRUNK;
+
+  if (!anywhere) {
+    if (app_topology_has_pahub() && d->pahub_ch != APP_SENSORS_NO_CH) {
+      ch = d->pahub_ch;
+    }
+    if (!app_sensors_take(d, ch, claimed, device)) {
+      return false;
+    }
+  } else {
+    // the PaHub channels in order, then the trunk
+    ch = app_topology_has_pahub() ? 0 : APP_TOPOLOGY_TRUNK;
+    while (ch <= APP_TOPOLOGY_TRUNK && !app_sensors_take(d, ch, claimed, device)) {
+      ch++;
+    }
+    if (ch > APP_TOPOLOGY_TRUNK) {
+      return false;
+    }
+  }
+  *pahub_ch = (ch == APP_TOPOLOGY_TRUNK) ? APP_SENSORS_NO_CH : ch;
+  return true;
+}
+
+// assigns the devices found to the rows: first the rows whose device is on their channel of
+// the table, then the others to the devices left, e.g. an SHT30 on another channel or at 0x45.
+// missed is set if a row on I2C has no device.
+static uint32_t app_sensors_match(bool *missed)
+{
+  uint8_t claimed[APP_TOPOLOGY_TRUNK + 1] = { 0 };
+  app_topology_device_t devices[2];
+  app_topology_device_t device;
+  uint32_t matched = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < app_sensors_table_len && i < APP_SENSORS_ROWS_MAX; i++) {
+      const app_sensors_desc_t *d = &app_sensors_table[i];
+      if (matched & (1u << i)) {
+        continue;
+      }
+      if (app_sensors_devices(d, devices) == 0) {
+        s_table.row_ch[i] = d->pahub_ch;
+        matched |= 1u << i;
+        continue;
+      }
+      if (app_sensors_found(d, pass > 0, claimed, &s_table.row_ch[i], &device)) {
+        s_table.row_addr[i] = (device == APP_TOPOLOGY_SHT30_ALT) ? SHT30_I2C_ADDR_ALT : SHT30_I2C_ADDR;
+        matched |= 1u << i;
+      } else if (pass > 0) {
+        *missed = true;
+      }
+    }
+  }
+  return matched;
 }
-#endif // CONFIG_PORT_A_EARTH_UNIT
+#endif // CONFIG_APP_SENSORS_DISCOVERY
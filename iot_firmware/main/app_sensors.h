@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "esp_err.h"
 
 #include "aws_iot_shadow_json.h"
@@ -8,28 +11,74 @@
 extern "C" {
 #endif // __cplusplus
 
+  // fixed-point values. the conversion to float is left to the backend.
   typedef struct app_sensors_device {
-    float bat_vol;
-    float bat_cur;
-    float bat_chrg_cur;
+    uint16_t bat_mv;
+    uint16_t bat_ma;
+    uint16_t bat_chrg_ma;
   } app_sensors_device_t;
 
   typedef struct app_sensors_data {
-    float temperature;
-    float humidity;
+    // [0.01 degC]
+    int16_t temperature;
+    // [0.01 %RH]
+    uint16_t humidity;
   } app_sensors_data_t;
 
+  // sensors of a pot, see CONFIG_APP_SENSORS_POTS
+  typedef struct app_sensors_pot {
+    app_sensors_data_t soil;
+    uint16_t water_level;
+  } app_sensors_pot_t;
+
   extern app_sensors_device_t dev;
   extern app_sensors_data_t env;
+  // pot 1
   extern app_sensors_data_t soil;
   extern uint16_t light;
+  // pot 1
   extern uint16_t water_level;
+  // raw HX711 value, weight_lsb per bit. weight_lsb is the calibration of app_settings.
   extern int32_t weight;
   extern float weight_lsb;
 
+#define APP_SENSORS_JSON_FIELDS_MAX 8
+
   esp_err_t app_sensors_init(void);
+  // runs the jobs which are due, see CONFIG_APP_SENSORS_MULTI_RATE
   esp_err_t app_sensors_proc(void);
-  // esp_err_t app_sensors_report_as_json(struct jsonStruct *json);
+  // jobs of app_sensors_proc()
+#define APP_SENSORS_JOB_BATTERY (1u << 0)
+#define APP_SENSORS_JOB_PORT_A  (1u << 1)
+#define APP_SENSORS_JOB_WEIGHT  (1u << 2)
+  // runs the jobs now, whatever their period
+  esp_err_t app_sensors_proc_jobs(uint32_t jobs);
+  // HX711 and the 5V rail stay powered between the reads, for streaming. app_sensors_proc_jobs()
+  // does not wait for the rail to settle again until app_sensors_weight_close().
+  esp_err_t app_sensors_weight_open(void);
+  // the raw value like weight, averaged over reads conversions at the data rate of HX711
+  esp_err_t app_sensors_weight_read(uint32_t reads, int32_t *value);
+  void app_sensors_weight_close(void);
+  // true if a row of app_sensors_table with value as its output was read without an error by
+  // app_sensors_proc() or app_sensors_proc_jobs() in this cycle, e.g. &water_level
+  bool app_sensors_read_ok(const void *value);
+  // drives IO0 of a PbHub channel, e.g. a pump. the PbHub keeps the output until the next call.
+  // the PaHub channel of the PbHub is taken from the topology or the table.
+  esp_err_t app_sensors_pbhub_output(uint8_t ch, bool on);
+  // earliest next run of a job with a period on the clock of app_time_now_us(), INT64_MAX if none
+  int64_t app_sensors_next_due_us(void);
+  // shifts the due times by the step of the clock on a sync
+  void app_sensors_time_step(int64_t step_us);
+  // with CONFIG_APP_RETAINED_PERIPHERALS, drivers stay installed and are only suspended during sleep
+  void app_sensors_suspend(void);
+  void app_sensors_resume(void);
+  // closes the drivers like without CONFIG_APP_RETAINED_PERIPHERALS, before a deep sleep
+  void app_sensors_release(void);
+  // fills the shadow fields of the sensors in app_sensors_table. returns the number of fields.
+  size_t app_sensors_json_fields(struct jsonStruct *fields, size_t max);
+  // writes the sensors of all pots as a json object keyed by pot ID,
+  // {"1":{"soil_temperature_x100":2150,"soil_humidity_x100":4210,"water_level":1800},"2":{...}}
+  esp_err_t app_sensors_pots_to_json(char *buf, size_t len);
 
 #ifdef __cplusplus
 }
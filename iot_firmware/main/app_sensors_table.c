@@ -0,0 +1,101 @@
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+
+#include "sht30.h"
+
+#include "app_sensors.h"
+#include "app_sensors_table.h"
+
+#if CONFIG_APP_SENSORS_POTS > 1
+// pots from 2 on. pot 1 is soil and water_level. kept in RTC memory like the values of pot 1.
+static RTC_DATA_ATTR app_sensors_pot_t s_pots[CONFIG_APP_SENSORS_POTS - 1];
+#endif // CONFIG_APP_SENSORS_POTS > 1
+
+// pot n: SHT30 on PaHub channel n, analog probe on PbHub channel n
+#define APP_SENSORS_POT_SHT30(n)                                        \
+  {                                                                     \
+    .driver = APP_SENSORS_SHT30, .pot = n, .pahub_ch = n, .pbhub_ch = APP_SENSORS_NO_CH, \
+    .warmup_ms = SHT30_SINGLE_SHOT_MS,                                  \
+    .out = { &s_pots[n - 2].soil.temperature, &s_pots[n - 2].soil.humidity }, \
+    .keys = { "soil_temperature_x100", "soil_humidity_x100" },          \
+  }
+#define APP_SENSORS_POT_PROBE(n)                                        \
+  {                                                                     \
+    .driver = APP_SENSORS_PBHUB_ANALOG, .pot = n, .pahub_ch = 5, .pbhub_ch = n, .warmup_ms = 0, \
+    .out = { &s_pots[n - 2].water_level },                              \
+    .keys = { "water_level" },                                          \
+  }
+
+// the sensor layout. a row per sensor, selected by the PORT_A configuration or, with
+// CONFIG_APP_SENSORS_DISCOVERY, by the devices found on the bus.
+const app_sensors_desc_t app_sensors_table[] = {
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_ENV_ON_CH0_ON_PAHUB_ON_PORT_A
+  {
+    .driver = APP_SENSORS_SHT30, .pot = 0, .pahub_ch = 0, .pbhub_ch = APP_SENSORS_NO_CH,
+    .warmup_ms = SHT30_SINGLE_SHOT_MS,
+    .out = { &env.temperature, &env.humidity },
+    .keys = { "env_temperature_x100", "env_humidity_x100" },
+  },
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_ENV_ON_CH0_ON_PAHUB_ON_PORT_A
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
+  {
+    .driver = APP_SENSORS_SHT30, .pot = 1, .pahub_ch = 1, .pbhub_ch = APP_SENSORS_NO_CH,
+    .warmup_ms = SHT30_SINGLE_SHOT_MS,
+    .out = { &soil.temperature, &soil.humidity },
+    .keys = { "soil_temperature_x100", "soil_humidity_x100" },
+  },
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_LIGHTSENSOR_VIA_CH0_ON_PBHUB
+  {
+    .driver = APP_SENSORS_PBHUB_ANALOG, .pot = 0, .pahub_ch = 5, .pbhub_ch = 0, .warmup_ms = 0,
+    .out = { &light },
+    .keys = { "env_light" },
+  },
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_LIGHTSENSOR_VIA_CH0_ON_PBHUB
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+  {
+    .driver = APP_SENSORS_PBHUB_ANALOG, .pot = 1, .pahub_ch = 5, .pbhub_ch = 1, .warmup_ms = 0,
+    .out = { &water_level },
+    .keys = { "water_level" },
+  },
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+#if CONFIG_PORT_A_EARTH_UNIT
+  {
+    .driver = APP_SENSORS_EARTH_UNIT, .pot = 1, .pahub_ch = APP_SENSORS_NO_CH, .pbhub_ch = APP_SENSORS_NO_CH,
+    .warmup_ms = 0,
+    .out = { &water_level },
+    .keys = { "water_level" },
+  },
+#endif // CONFIG_PORT_A_EARTH_UNIT
+  // the other pots take the options of pot 1
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
+#if CONFIG_APP_SENSORS_POTS >= 2
+  APP_SENSORS_POT_SHT30(2),
+#endif
+#if CONFIG_APP_SENSORS_POTS >= 3
+  APP_SENSORS_POT_SHT30(3),
+#endif
+#if CONFIG_APP_SENSORS_POTS >= 4
+  APP_SENSORS_POT_SHT30(4),
+#endif
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+#if CONFIG_APP_SENSORS_POTS >= 2
+  APP_SENSORS_POT_PROBE(2),
+#endif
+#if CONFIG_APP_SENSORS_POTS >= 3
+  APP_SENSORS_POT_PROBE(3),
+#endif
+#if CONFIG_APP_SENSORS_POTS >= 4
+  APP_SENSORS_POT_PROBE(4),
+#endif
+#if CONFIG_APP_SENSORS_POTS >= 5
+  APP_SENSORS_POT_PROBE(5),
+#endif
+#endif // CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+};
+
+const size_t app_sensors_table_len = sizeof(app_sensors_table) / sizeof(app_sensors_table[0]);
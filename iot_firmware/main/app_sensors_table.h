@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  typedef enum {
+    // temperature [0.01 degC] to out[0] (int16_t), humidity [0.01 %RH] to out[1] (uint16_t)
+    APP_SENSORS_SHT30 = 0,
+    // analog value of a PbHub channel to out[0] (uint16_t)
+    APP_SENSORS_PBHUB_ANALOG,
+    // earth unit directly on port A to out[0] (uint16_t)
+    APP_SENSORS_EARTH_UNIT,
+  } app_sensors_driver_t;
+
+#define APP_SENSORS_NO_CH 0xff
+#define APP_SENSORS_OUT_MAX 2
+  // the rows read are kept as bits
+#define APP_SENSORS_ROWS_MAX 32
+
+  // a sensor and where it is. acquisition and report follow the table in its order.
+  typedef struct {
+    app_sensors_driver_t driver;
+    // pot ID from 1, 0 for the device (env)
+    uint8_t pot;
+    // PaHub channel in front of the sensor, APP_SENSORS_NO_CH if none
+    uint8_t pahub_ch;
+    // PbHub channel of analog sensors
+    uint8_t pbhub_ch;
+    // time from the start of the conversion to the collection. the conversions of all rows
+    // are started before any is collected.
+    uint16_t warmup_ms;
+    void *out[APP_SENSORS_OUT_MAX];
+    // keys in the shadow document
+    const char *keys[APP_SENSORS_OUT_MAX];
+  } app_sensors_desc_t;
+
+  extern const app_sensors_desc_t app_sensors_table[];
+  extern const size_t app_sensors_table_len;
+
+  // drivers used by the table, the others are not compiled.
+  // with discovery, all I2C rows are built in and the rows found are used.
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_SHT30_FOR_ENV_ON_CH0_ON_PAHUB_ON_PORT_A || CONFIG_I2C_SHT30_FOR_SOIL_ON_CH1_ON_PAHUB_ON_PORT_A
+#define APP_SENSORS_USE_SHT30 1
+#endif
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_LIGHTSENSOR_VIA_CH0_ON_PBHUB || CONFIG_I2C_PORT_A_HAS_EARTH_SENSOR_VIA_CH1_ON_PBHUB
+#define APP_SENSORS_USE_PBHUB 1
+#endif
+#if CONFIG_APP_SENSORS_DISCOVERY || CONFIG_I2C_PORT_A_HAS_PAHUB
+#define APP_SENSORS_USE_PAHUB 1
+#endif
+#if CONFIG_PORT_A_EARTH_UNIT
+#define APP_SENSORS_USE_EARTH_UNIT 1
+#endif
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
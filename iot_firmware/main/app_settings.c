@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_settings.h"
+
+#define APP_SETTINGS_TAG "app_settings"
+
+#define APP_SETTINGS_NAMESPACE "settings"
+#define APP_SETTINGS_KEY (char*) "BLOB"
+// changes with the layout of app_settings_t
+#define APP_SETTINGS_VERSION 1
+
+// kept in RTC slow memory, so a wake does not read NVS. the CRC tells a valid copy.
+static RTC_DATA_ATTR app_settings_t s_settings;
+// a change which could not be stored yet
+static RTC_DATA_ATTR bool s_dirty = false;
+// NVS is initialized
+static bool s_nvs_ready = false;
+
+static uint32_t app_settings_crc(const app_settings_t *s)
+{
+  return esp_rom_crc32_le(0, (const uint8_t *) s, offsetof(app_settings_t, crc));
+}
+
+static bool app_settings_valid(const app_settings_t *s)
+{
+  return s->version == APP_SETTINGS_VERSION && s->size == sizeof(*s) && s->crc == app_settings_crc(s);
+}
+
+static void app_settings_seal(void)
+{
+  s_settings.version = APP_SETTINGS_VERSION;
+  s_settings.size = sizeof(s_settings);
+  s_settings.crc = app_settings_crc(&s_settings);
+}
+
+static esp_err_t app_settings_store(void)
+{
+  nvs_handle_t nvs;
+  esp_err_t err;
+
+  if (!s_nvs_ready) {
+    s_dirty = true;
+    return ESP_ERR_INVALID_STATE;
+  }
+  err = nvs_open(APP_SETTINGS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    // the blob is replaced as a whole. an interrupted write leaves the previous one.
+    err = nvs_set_blob(nvs, APP_SETTINGS_KEY, &s_settings, sizeof(s_settings));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+  }
+  s_dirty = (err != ESP_OK);
+  BINLOGI(APP_SETTINGS_TAG, "settings stored, flags 0x%x, returns %d", s_settings.flags, err);
+  return err;
+}
+
+// the keys of the firmware before the blob, read once
+static void app_settings_import(void)
+{
+  nvs_handle_t nvs;
+  uint32_t u32;
+  size_t len;
+
+  memset(&s_settings, 0, sizeof(s_settings));
+  if (nvs_open("app_sensors", NVS_READONLY, &nvs) == ESP_OK) {
+    if (nvs_get_u32(nvs, "Z_OFFSET", &u32) == ESP_OK) {
+      s_settings.hx711_zero_offset = u32;
+      s_settings.flags |= APP_SETTINGS_HX711_ZERO_OFFSET;
+    }
+    // the bits of the float
+    if (nvs_get_u32(nvs, "LSB", &u32) == ESP_OK && u32 != 0) {
+      memcpy(&s_settings.hx711_lsb, &u32, sizeof(u32));
+      s_settings.flags |= APP_SETTINGS_HX711_LSB;
+    }
+    nvs_close(nvs);
+  }
+  if (nvs_open("wificlient", NVS_READONLY, &nvs) == ESP_OK) {
+    len = sizeof(s_settings.wifi.ssid);
+    if (nvs_get_str(nvs, "SSID", (char *) s_settings.wifi.ssid, &len) == ESP_OK) {
+      len = sizeof(s_settings.wifi.password);
+      if (nvs_get_str(nvs, "PASSWORD", (char *) s_settings.wifi.password, &len) == ESP_OK) {
+        s_settings.flags |= APP_SETTINGS_WIFI;
+      }
+    }
+    // the BSSID was stored as a string and is not imported
+    if (!(s_settings.flags & APP_SETTINGS_WIFI)) {
+      memset(&s_settings.wifi, 0, sizeof(s_settings.wifi));
+    }
+    nvs_close(nvs);
+  }
+  BINLOGI(APP_SETTINGS_TAG, "imported flags 0x%x", s_settings.flags);
+}
+
+esp_err_t app_settings_load(void)
+{
+  app_settings_t t;
+  size_t len = sizeof(t);
+  nvs_handle_t nvs;
+  esp_err_t err;
+
+  s_nvs_ready = true;
+  if (app_settings_valid(&s_settings)) {
+    return s_dirty ? app_settings_store() : ESP_OK;
+  }
+  err = nvs_open(APP_SETTINGS_NAMESPACE, NVS_READONLY, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_get_blob(nvs, APP_SETTINGS_KEY, &t, &len);
+    nvs_close(nvs);
+  }
+  if (err == ESP_OK && len == sizeof(t) && app_settings_valid(&t)) {
+    s_settings = t;
+    s_dirty = false;
+    BINLOGI(APP_SETTINGS_TAG, "settings loaded, flags 0x%x", s_settings.flags);
+    return ESP_OK;
+  }
+  BINLOGW(APP_SETTINGS_TAG, "no valid settings in NVS, returns %d", err);
+  app_settings_import();
+  app_settings_seal();
+  return app_settings_store();
+}
+
+const app_settings_t *app_settings_get(void)
+{
+  return &s_settings;
+}
+
+esp_err_t app_settings_set_hx711(uint32_t zero_offset, float lsb)
+{
+  uint32_t flags = APP_SETTINGS_HX711_ZERO_OFFSET | ((lsb > 0) ? APP_SETTINGS_HX711_LSB : 0);
+
+  if ((s_settings.flags & flags) == flags && s_settings.hx711_zero_offset == zero_offset
+      && (lsb <= 0 || s_settings.hx711_lsb == lsb)) {
+    return ESP_OK;
+  }
+  s_settings.hx711_zero_offset = zero_offset;
+  if (lsb > 0) {
+    s_settings.hx711_lsb = lsb;
+  }
+  s_settings.flags |= flags;
+  app_settings_seal();
+  return app_settings_store();
+}
+
+void app_settings_set_wifi(const wificlient_credentials_t *wifi)
+{
+  if ((s_settings.flags & APP_SETTINGS_WIFI)
+      && memcmp(&s_settings.wifi, wifi, sizeof(*wifi)) == 0) {
+    return;
+  }
+  s_settings.wifi = *wifi;
+  s_settings.flags |= APP_SETTINGS_WIFI;
+  app_settings_seal();
+  app_settings_store();
+}
+
+esp_err_t app_settings_clear_hx711(void)
+{
+  s_settings.hx711_zero_offset = 0;
+  s_settings.hx711_lsb = 0;
+  s_settings.flags &= ~(APP_SETTINGS_HX711_ZERO_OFFSET | APP_SETTINGS_HX711_LSB);
+  app_settings_seal();
+  return app_settings_store();
+}
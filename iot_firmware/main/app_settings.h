@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "wificlient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // bits of app_settings_t.flags
+#define APP_SETTINGS_HX711_ZERO_OFFSET (1 << 0)
+#define APP_SETTINGS_HX711_LSB         (1 << 1)
+#define APP_SETTINGS_WIFI              (1 << 2)
+
+  // one NVS blob. the layout changes with APP_SETTINGS_VERSION of app_settings.c.
+  typedef struct {
+    uint16_t version;
+    uint16_t size;
+    uint32_t flags;
+    uint32_t hx711_zero_offset;
+    float hx711_lsb;
+    wificlient_credentials_t wifi;
+    // zero, the CRC is aligned
+    uint8_t reserved[3];
+    // CRC32 of the bytes above
+    uint32_t crc;
+  } app_settings_t;
+
+  // restores the settings into RTC memory after power-on, from the blob or, the first time,
+  // from the keys of the older firmware. a later call only checks the CRC of the RTC copy.
+  // NVS must be initialized.
+  esp_err_t app_settings_load(void);
+  // the RTC copy. the flags tell which values are set.
+  const app_settings_t *app_settings_get(void);
+  // stored with nvs_commit() if a value changed. without NVS (e.g. a sample-only wake)
+  // the change is kept in RTC memory and stored by the next app_settings_load().
+  // lsb 0 leaves the LSB unset, so the default of the firmware is used.
+  esp_err_t app_settings_set_hx711(uint32_t zero_offset, float lsb);
+  void app_settings_set_wifi(const wificlient_credentials_t *wifi);
+  // forgets the weight calibration, on a reset by RESET_PIN
+  esp_err_t app_settings_clear_hx711(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -1,20 +1,60 @@
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "sdkconfig.h"
 
+#include "esp_attr.h"
 #include "esp_sleep.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_task_wdt.h"
 #include "driver/gpio.h"
 #include "driver/rtc_io.h"
+#include "driver/uart.h"
+
+#include "binlog.h"
 
 #include "main.h"
 #include "app_sleep.h"
+#include "app_wake.h"
+#include "app_pm.h"
+#include "app_sensors.h"
+#include "app_diag.h"
+#include "app_sched.h"
+#include "app_time.h"
 
+#define APP_SLEEP_TAG "app_sleep"
+
+// weight of a new wake charge is 1/n
+#define APP_SLEEP_EWMA_DIV 4
+
+typedef enum {
+  APP_SLEEP_LIGHT = 0,
+  APP_SLEEP_DEEP,
+  APP_SLEEP_TYPE_MAX
+} app_sleep_type_t;
+
+typedef struct {
+  // measured charge[uAh] of a wake after each type of sleep, per wake mode. 0 if not yet.
+  float wake_uah[APP_SLEEP_TYPE_MAX][APP_WAKE_MODE_MAX];
+  // the last sleep. false after power-on.
+  bool slept;
+  uint8_t type;
+  int64_t start_us;
+  // time in light sleep, measured on return
+  int64_t light_us;
+  float predicted_uah;
+} app_sleep_state_t;
+
+// kept in RTC slow memory, so a deep sleep learns from the wake which follows it
+static RTC_DATA_ATTR app_sleep_state_t s_rtc_sleep = {
+  .slept = false,
+};
+
+static bool s_booted = false;
+static uint64_t s_sleep_us = 0;
 
-#ifdef CONFIG_SLEEP_TIMER_TIMEOUT
-static const uint64_t s_wakeup_time_sec_us = CONFIG_SLEEP_TIMER_TIMEOUT;
-#else
-static const uint64_t s_wakeup_time_sec_us = 10 * 60 * 1000 * 1000;
-#endif // CONFIG_SLEEP_TIMER_TIMEOUT
 
 #ifdef CONFIG_M5STACK_CORE2
 static void app_before_sleep_core2(void);
@@ -30,8 +70,10 @@ static void app_log_wakeup_cause(void);
 
 void app_before_sleep(void)
 {
-  //  wake from timer
-  esp_sleep_enable_timer_wakeup(s_wakeup_time_sec_us);
+  //  wake from timer, in the slot of this device
+  s_sleep_us = app_sched_next_sleep_us();
+  esp_sleep_enable_timer_wakeup(s_sleep_us);
+  app_sensors_suspend();
 #if defined(CONFIG_M5STICK_C_PLUS)
   app_before_sleep_stickcplus();
 #elif defined(CONFIG_M5STACK_CORE2)
@@ -39,25 +81,149 @@ void app_before_sleep(void)
 #endif // CONFIG_M5STICK_C_PLUS
 }
 
+static const char *app_sleep_type_str(app_sleep_type_t type)
+{
+  return (type == APP_SLEEP_DEEP) ? "deep" : "light";
+}
+
+// charge[uAh] of the floor current over a sleep. the PMU can not measure it while
+// the cpu sleeps, so it is the current measured on the bench.
+static float app_sleep_floor_uah(app_sleep_type_t type, int64_t us)
+{
+  float ua = (type == APP_SLEEP_DEEP) ? CONFIG_APP_SLEEP_FLOOR_DEEP_UA : CONFIG_APP_SLEEP_FLOOR_LIGHT_UA;
+  // uA * us -> uAh
+  return ua * us / 3600000000.0f;
+}
+
+// charge[uAh] of ROM and bootloader after deep sleep, before esp_timer and the phase timeline start
+static float app_sleep_boot_uah(app_sleep_type_t type)
+{
+  if (type != APP_SLEEP_DEEP) {
+    return 0;
+  }
+  // mA * ms -> uAh
+  return (float)CONFIG_APP_PM_CURRENT_IDLE_MA * CONFIG_APP_SLEEP_BOOT_MS / 3600.0f;
+}
+
+static float app_sleep_predict(app_sleep_type_t type, app_wake_mode_t mode, int64_t us)
+{
+  float wake_uah = s_rtc_sleep.wake_uah[type][mode];
+
+  if (wake_uah == 0) {
+    // not measured yet: as after the other type. app_sleep_choose() takes it once to measure it,
+    // the charge of the other type's re-init would otherwise keep it from ever being chosen.
+    wake_uah = s_rtc_sleep.wake_uah[!type][mode];
+  }
+  return app_sleep_floor_uah(type, us) + app_sleep_boot_uah(type) + wake_uah;
+}
+
+// the charge of the wake, which ends now, belongs to the last sleep
+static void app_sleep_learn(float cycle_uah)
+{
+  app_wake_mode_t mode = app_wake_mode();
+  app_sleep_type_t type = s_rtc_sleep.type;
+  float *wake_uah;
+  int64_t slept_us;
+
+  if (!s_booted) {
+    s_booted = true;
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+      // power on or crash: the first wake does more than a wake after sleep
+      s_rtc_sleep.slept = false;
+    }
+  }
+  if (!s_rtc_sleep.slept || type >= APP_SLEEP_TYPE_MAX) {
+    return;
+  }
+  if (type == APP_SLEEP_DEEP) {
+    // esp_timer starts from 0 at boot
+    slept_us = app_time_now_us() - s_rtc_sleep.start_us - esp_timer_get_time()
+      - CONFIG_APP_SLEEP_BOOT_MS * 1000LL;
+  } else {
+    slept_us = s_rtc_sleep.light_us;
+  }
+  if (slept_us < 0) {
+    // the clock was set by SNTP in between
+    slept_us = 0;
+  }
+  // in nAh, no float is formatted
+  BINLOGI(APP_SLEEP_TAG, "last sleep: %s for %u ms, predicted %u nAh, actual %u nAh",
+          app_sleep_type_str(type), (uint32_t)(slept_us / 1000),
+          (uint32_t)(s_rtc_sleep.predicted_uah * 1000 + 0.5f),
+          (uint32_t)((app_sleep_floor_uah(type, slept_us) + app_sleep_boot_uah(type) + cycle_uah)
+                     * 1000 + 0.5f));
+
+  wake_uah = &s_rtc_sleep.wake_uah[type][mode];
+  if (*wake_uah == 0) {
+    *wake_uah = cycle_uah;
+  } else {
+    *wake_uah += (cycle_uah - *wake_uah) / APP_SLEEP_EWMA_DIV;
+  }
+}
+
+static app_sleep_type_t app_sleep_choose(int64_t us)
+{
+  app_wake_mode_t mode = app_wake_next_mode();
+  float light_uah = app_sleep_predict(APP_SLEEP_LIGHT, mode, us);
+  float deep_uah = app_sleep_predict(APP_SLEEP_DEEP, mode, us);
+  app_sleep_type_t type;
+
+#if defined(CONFIG_SLEEP_TYPE_AUTO)
+  bool light_measured = (s_rtc_sleep.wake_uah[APP_SLEEP_LIGHT][mode] != 0);
+  bool deep_measured = (s_rtc_sleep.wake_uah[APP_SLEEP_DEEP][mode] != 0);
+
+  if (light_measured != deep_measured) {
+    // explore: one cycle measures the wake after the other type
+    type = light_measured ? APP_SLEEP_DEEP : APP_SLEEP_LIGHT;
+  } else {
+    // a deep sleep saves floor current and pays for the boot and the re-init of the next wake
+    type = (deep_uah < light_uah) ? APP_SLEEP_DEEP : APP_SLEEP_LIGHT;
+  }
+#elif defined(CONFIG_SLEEP_TYPE_DEEP)
+  type = APP_SLEEP_DEEP;
+#else
+  type = APP_SLEEP_LIGHT;
+#endif // CONFIG_SLEEP_TYPE_AUTO
+  BINLOGI(APP_SLEEP_TAG, "%s sleep for %u ms before a %s wake: light %u nAh, deep %u nAh",
+          app_sleep_type_str(type), (uint32_t)(us / 1000), app_wake_mode_str(mode),
+          (uint32_t)(light_uah * 1000 + 0.5f), (uint32_t)(deep_uah * 1000 + 0.5f));
+  s_rtc_sleep.predicted_uah = (type == APP_SLEEP_DEEP) ? deep_uah : light_uah;
+  return type;
+}
+
 void app_goto_sleep(void)
 {
-  ESP_LOGI(TAG, "entering sleep");
-  // wait logging finished
-  vTaskDelay(pdMS_TO_TICKS(100));
+  app_sleep_type_t type;
+
+  app_wake_end();
+  app_pm_phase(APP_PM_PHASE_IDLE);
+  app_sleep_learn(app_pm_report());
+  app_diag_report();
+  type = app_sleep_choose(s_sleep_us);
+  BINLOGI(TAG, "entering sleep");
+  // wait until the console output is drained. most logs go to binlog, so this is short.
+  uart_wait_tx_idle_polling(CONFIG_ESP_CONSOLE_UART_NUM);
 
+  s_rtc_sleep.slept = true;
+  s_rtc_sleep.type = type;
+  s_rtc_sleep.start_us = app_time_now_us();
   // sleep
-#if defined(CONFIG_SLEEP_TYPE_LIGHT)
+  if (type == APP_SLEEP_DEEP) {
+    // the drivers are installed again after the boot
+    app_sensors_release();
+    // does not return, app_main() starts again after the wake
+    esp_deep_sleep_start();
+  }
   esp_light_sleep_start();
-#elif defined(CONFIG_SLEEP_TYPE_DEEP)
-  esp_deep_sleep_start();
-#endif // CONFIG_SLEEP_TYPE_LIGHT
+  s_rtc_sleep.light_us = app_time_now_us() - s_rtc_sleep.start_us;
 }
 
 void app_after_wakeup(void)
 {
   // disable wake from timer
   esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
-  ESP_LOGI(TAG, "exiting sleep");
+  BINLOGI(TAG, "exiting sleep");
+  app_pm_wakeup();
 
 #if defined(CONFIG_M5STICK_C_PLUS)
   app_after_wakeup_stickcplus();
@@ -65,7 +231,9 @@ void app_after_wakeup(void)
   app_after_wakeup_core2();
 #endif // CONFIG_M5STICK_C_PLUS
 
+  app_sensors_resume();
   app_log_wakeup_cause();
+  app_wake_begin();
 }
 
 
@@ -106,16 +274,19 @@ static void app_log_wakeup_cause()
   esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
   switch (cause) {
   case ESP_SLEEP_WAKEUP_TIMER:
-    ESP_LOGI(TAG, "wake cause by timer");
+    BINLOGI(TAG, "wake cause by timer");
     break;
   case ESP_SLEEP_WAKEUP_GPIO:
-    ESP_LOGI(TAG, "wake cause by GPIO");
+    BINLOGI(TAG, "wake cause by GPIO");
+    break;
+  case ESP_SLEEP_WAKEUP_EXT0:
+    BINLOGI(TAG, "wake cause by button");
     break;
   case ESP_SLEEP_WAKEUP_WIFI:
-    ESP_LOGI(TAG, "wake cause by WIFI");
+    BINLOGI(TAG, "wake cause by WIFI");
     break;
   default:
-    ESP_LOGI(TAG, "wake cause by ???");
+    BINLOGI(TAG, "wake cause by ???");
     break;
   }
 }
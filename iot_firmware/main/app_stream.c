@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "awsclient.h"
+#include "binlog.h"
+
+#include "main.h"
+#include "app_stream.h"
+#include "app_sensors.h"
+#include "app_pm.h"
+#include "app_time.h"
+
+#define APP_STREAM_TAG "app_stream"
+
+#define APP_STREAM_TOPIC_TEMPLATE "be_bonsai/%s/stream"
+// the other sensors are read once per message
+#define APP_STREAM_BATCH_MS 1000
+// MQTT header and topic have to fit in the TX buffer as well
+#define APP_STREAM_MSG_MAX_LENGTH ((CONFIG_AWS_IOT_MQTT_TX_BUF_LEN - 64 < 512) \
+                                   ? (CONFIG_AWS_IOT_MQTT_TX_BUF_LEN - 64) : 512)
+// PUBACK of the previous message
+#define APP_STREAM_PUBLISH_WAIT_MS 5000
+
+#ifdef CONFIG_APP_STREAM
+// conversions averaged into one weight sample
+#define APP_STREAM_DECIMATION ((CONFIG_APP_STREAM_HX711_SPS > CONFIG_APP_STREAM_WEIGHT_HZ) \
+                               ? (CONFIG_APP_STREAM_HX711_SPS / CONFIG_APP_STREAM_WEIGHT_HZ) : 1)
+
+static char s_stream_topic[64];
+// one message is filled while the other waits for its PUBACK
+static char s_stream_msg[2][APP_STREAM_MSG_MAX_LENGTH];
+static int32_t s_stream_weights[CONFIG_APP_STREAM_WEIGHT_HZ];
+static uint32_t s_stream_failed = 0;
+
+static void app_stream_publish_done(IoT_Error_t err, void *ctx)
+{
+  if (err != SUCCESS) {
+    s_stream_failed++;
+  }
+}
+
+// {"time":1700000000,"ms":123,"hz":10,"weight_value":[...],"voltage_mv":4012,...} with the
+// fields of the shadow update. time and ms are of the first weight sample.
+// no %lld with the newlib nano format.
+static esp_err_t app_stream_to_json(char *buf, size_t len, int64_t t_ms, const int32_t *w, size_t n)
+{
+  struct jsonStruct fields[APP_SENSORS_JSON_FIELDS_MAX];
+  size_t count = app_sensors_json_fields(fields, APP_SENSORS_JSON_FIELDS_MAX);
+  size_t pos = 0;
+  int r;
+
+  r = snprintf(buf, len, "{\"time\":%u,\"ms\":%u,\"hz\":%d,\"weight_value\":[",
+               (uint32_t)(t_ms / 1000), (uint32_t)(t_ms % 1000), CONFIG_APP_STREAM_WEIGHT_HZ);
+  if (r < 0 || r >= len) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += r;
+  for (size_t i = 0; i < n; i++) {
+    r = snprintf(buf + pos, len - pos, "%s%d", (i > 0) ? "," : "", w[i]);
+    if (r < 0 || r >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += r;
+  }
+  r = snprintf(buf + pos, len - pos, "],\"voltage_mv\":%u,\"current_ma\":%u",
+               dev.bat_mv, dev.bat_ma);
+  if (r < 0 || r >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  pos += r;
+  for (size_t i = 0; i < count; i++) {
+    int32_t v = (fields[i].type == SHADOW_JSON_INT16)
+      ? *(int16_t *) fields[i].pData : *(uint16_t *) fields[i].pData;
+    r = snprintf(buf + pos, len - pos, ",\"%s\":%d", fields[i].pKey, v);
+    if (r < 0 || r >= len - pos) {
+      return ESP_ERR_NO_MEM;
+    }
+    pos += r;
+  }
+  r = snprintf(buf + pos, len - pos, "}");
+  if (r < 0 || r >= len - pos) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+#endif // CONFIG_APP_STREAM
+
+void app_stream_run(awsclient_config_t *config)
+{
+#ifdef CONFIG_APP_STREAM
+  int64_t end_us = esp_timer_get_time() + CONFIG_APP_STREAM_DURATION_S * 1000000LL;
+  uint32_t sent = 0;
+  uint8_t cur = 0;
+
+  snprintf(s_stream_topic, sizeof(s_stream_topic), APP_STREAM_TOPIC_TEMPLATE,
+           config->shadow_connect_params.pMyThingName);
+  s_stream_failed = 0;
+  BINLOGI(APP_STREAM_TAG, "streaming for %u s, weight at %u Hz of %u conversions",
+          CONFIG_APP_STREAM_DURATION_S, CONFIG_APP_STREAM_WEIGHT_HZ, APP_STREAM_DECIMATION);
+  app_sensors_weight_open();
+  while (esp_timer_get_time() < end_us) {
+    int64_t batch_end_us = esp_timer_get_time() + APP_STREAM_BATCH_MS * 1000LL;
+    int64_t t_ms = app_time_now_us() / 1000;
+    size_t n = 0;
+    int64_t now;
+
+    app_pm_phase(APP_PM_PHASE_SENSOR);
+    while (n < CONFIG_APP_STREAM_WEIGHT_HZ && esp_timer_get_time() < batch_end_us) {
+      if (app_sensors_weight_read(APP_STREAM_DECIMATION, &s_stream_weights[n]) != ESP_OK) {
+        break;
+      }
+      n++;
+    }
+    // the SHT30 conversions are short next to the weight samples
+    app_sensors_proc_jobs(APP_SENSORS_JOB_BATTERY | APP_SENSORS_JOB_PORT_A);
+
+    app_pm_phase(APP_PM_PHASE_COMPUTE);
+    if (app_stream_to_json(s_stream_msg[cur], sizeof(s_stream_msg[cur]), t_ms,
+                           s_stream_weights, n) != ESP_OK) {
+      BINLOGW(APP_STREAM_TAG, "stream message does not fit in %u bytes",
+              (uint32_t) APP_STREAM_MSG_MAX_LENGTH);
+      break;
+    }
+    // the other buffer is free once its publish completed
+    if (awsclient_flush(pdMS_TO_TICKS(APP_STREAM_PUBLISH_WAIT_MS)) != ESP_OK) {
+      BINLOGW(APP_STREAM_TAG, "stream publish stalled");
+      break;
+    }
+    awsclient_publish_async(s_stream_topic, s_stream_msg[cur], strlen(s_stream_msg[cur]),
+                            app_stream_publish_done, NULL);
+    sent++;
+    cur ^= 1;
+
+    app_pm_phase(APP_PM_PHASE_IDLE);
+    now = esp_timer_get_time();
+    if (now < batch_end_us) {
+      // the reads were faster than the batch, e.g. no HX711
+      vTaskDelay(pdMS_TO_TICKS((batch_end_us - now) / 1000) + 1);
+    }
+  }
+  awsclient_flush(pdMS_TO_TICKS(APP_STREAM_PUBLISH_WAIT_MS));
+  app_sensors_weight_close();
+  BINLOGI(APP_STREAM_TAG, "stream done: %u messages, %u failed", sent, s_stream_failed);
+#endif // CONFIG_APP_STREAM
+}
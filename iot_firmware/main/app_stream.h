@@ -0,0 +1,16 @@
+#pragma once
+
+#include "awsclient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // publishes the sensors to be_bonsai/<thing name>/stream for CONFIG_APP_STREAM_DURATION_S,
+  // one message per second with the weight at CONFIG_APP_STREAM_WEIGHT_HZ.
+  // call while the awsclient network task runs.
+  void app_stream_run(awsclient_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sntp.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_time.h"
+#include "app_sched.h"
+
+#define APP_TIME_TAG "app_time"
+
+// shorter intervals do not resolve the drift
+#define APP_TIME_DRIFT_MIN_INTERVAL_US (60LL * 60 * 1000000)
+// beyond this the sync or the previous one was wrong
+#define APP_TIME_DRIFT_MAX_PPM 2000
+
+typedef struct {
+  bool synced;
+  // corrected time [us] of the last sync. the drift applies from here.
+  int64_t last_sync_us;
+  // connections since the last sync
+  uint32_t connections;
+} app_time_state_t;
+
+// kept in RTC slow memory, lost on power-on with the time itself
+static RTC_DATA_ATTR app_time_state_t s_rtc_time = {
+  .synced = false,
+  .last_sync_us = 0,
+  .connections = 0,
+};
+
+// the raw clock and esp_timer when SNTP was started, to know the raw clock
+// right before SNTP sets it
+static int64_t s_start_raw_us;
+static int64_t s_start_timer_us;
+static volatile bool s_sync_done;
+static int64_t s_sync_raw_us;
+static int64_t s_sync_ref_us;
+
+static int64_t app_time_raw_us(void)
+{
+  struct timeval tv;
+  // RTC based. it keeps counting in light and deep sleep.
+  gettimeofday(&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int64_t app_time_correct(int64_t raw)
+{
+  if (!s_rtc_time.synced) {
+    return raw;
+  }
+  // a fast RTC (positive ppm) runs ahead of the reference since the last sync
+  return raw - (raw - s_rtc_time.last_sync_us) / 1000000 * app_sched_drift_ppm();
+}
+
+int64_t app_time_now_us(void)
+{
+  return app_time_correct(app_time_raw_us());
+}
+
+uint32_t app_time_now_sec(void)
+{
+  return (uint32_t)(app_time_now_us() / 1000000);
+}
+
+bool app_time_synced(void)
+{
+  return s_rtc_time.synced;
+}
+
+// called by SNTP after it set the clock
+static void app_time_sync_cb(struct timeval *tv)
+{
+  s_sync_raw_us = s_start_raw_us + (esp_timer_get_time() - s_start_timer_us);
+  s_sync_ref_us = (int64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+  s_sync_done = true;
+}
+
+static void app_time_update_drift(int64_t raw, int64_t ref)
+{
+  int64_t ref_elapsed = ref - s_rtc_time.last_sync_us;
+  int64_t raw_elapsed = raw - s_rtc_time.last_sync_us;
+  int64_t ppm;
+
+  if (ref_elapsed < APP_TIME_DRIFT_MIN_INTERVAL_US) {
+    return;
+  }
+  // the raw clock also started at last_sync_us, it was set to the reference then
+  ppm = (raw_elapsed - ref_elapsed) * 1000000 / ref_elapsed;
+  if (ppm > APP_TIME_DRIFT_MAX_PPM || ppm < -APP_TIME_DRIFT_MAX_PPM) {
+    BINLOGW(APP_TIME_TAG, "drift %d ppm out of range, ignored", (int32_t) ppm);
+    return;
+  }
+  app_sched_set_drift_ppm((int32_t) ppm);
+}
+
+int64_t app_time_sync_if_due(void)
+{
+  int64_t corrected;
+  int64_t step;
+
+  s_rtc_time.connections++;
+  if (s_rtc_time.synced && s_rtc_time.connections < CONFIG_APP_TIME_SYNC_EVERY_N_CONNECTIONS) {
+    return 0;
+  }
+
+  s_sync_done = false;
+  s_start_raw_us = app_time_raw_us();
+  s_start_timer_us = esp_timer_get_time();
+  sntp_setoperatingmode(SNTP_OPMODE_POLL);
+  sntp_setservername(0, CONFIG_APP_TIME_SNTP_SERVER);
+  sntp_set_time_sync_notification_cb(app_time_sync_cb);
+  sntp_init();
+  for (int i = 0; i < CONFIG_APP_TIME_SYNC_TIMEOUT_MS / 100 && !s_sync_done; i++) {
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+  sntp_stop();
+  if (!s_sync_done) {
+    // tried again on the next connection
+    BINLOGW(APP_TIME_TAG, "sntp timeout");
+    return 0;
+  }
+
+  corrected = app_time_correct(s_sync_raw_us);
+  step = s_sync_ref_us - corrected;
+  if (s_rtc_time.synced) {
+    app_time_update_drift(s_sync_raw_us, s_sync_ref_us);
+    BINLOGI(APP_TIME_TAG, "synced, step %d ms, drift %d ppm",
+            (int32_t)(step / 1000), app_sched_drift_ppm());
+  } else {
+    // from the time since power-on to the wall clock
+    BINLOGI(APP_TIME_TAG, "synced, first since power-on");
+  }
+  s_rtc_time.synced = true;
+  s_rtc_time.last_sync_us = s_sync_ref_us;
+  s_rtc_time.connections = 0;
+  return step;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // current time [us since epoch], corrected by the measured RTC drift since the last sync.
+  // before the first sync it is the time since power-on.
+  int64_t app_time_now_us(void);
+  uint32_t app_time_now_sec(void);
+  // true once SNTP has set the clock since power-on
+  bool app_time_synced(void);
+  // counts a connection and runs SNTP on the first one and then every
+  // APP_TIME_SYNC_EVERY_N_CONNECTIONS. wifi must be connected.
+  // returns the step of the corrected clock [us] by the sync, 0 without sync.
+  int64_t app_time_sync_if_due(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
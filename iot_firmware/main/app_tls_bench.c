@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_pm.h"
+#include "app_tls_bench.h"
+
+#ifdef CONFIG_APP_TLS_BENCH
+
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+#define APP_TLS_BENCH_TAG "app_tls_bench"
+
+typedef enum {
+  // parsed for every handshake, as the esp-aws-iot wrapper does
+  APP_TLS_BENCH_PEM = 0,
+  APP_TLS_BENCH_DER,
+  // parsed once, then only the handshake
+  APP_TLS_BENCH_CACHED,
+  APP_TLS_BENCH_MAX
+} app_tls_bench_mode_t;
+
+typedef struct {
+  mbedtls_x509_crt cacert;
+  mbedtls_x509_crt clicert;
+  mbedtls_pk_context pkey;
+} app_tls_bench_creds_t;
+
+static const char *s_mode_str[APP_TLS_BENCH_MAX] = {
+  [APP_TLS_BENCH_PEM] = "pem",
+  [APP_TLS_BENCH_DER] = "der",
+  [APP_TLS_BENCH_CACHED] = "cached",
+};
+
+static bool s_done = false;
+static mbedtls_entropy_context s_entropy;
+static mbedtls_ctr_drbg_context s_ctr_drbg;
+static app_tls_bench_creds_t s_creds;
+
+static void app_tls_bench_creds_free(app_tls_bench_creds_t *c)
+{
+  mbedtls_x509_crt_free(&c->cacert);
+  mbedtls_x509_crt_free(&c->clicert);
+  mbedtls_pk_free(&c->pkey);
+}
+
+static int app_tls_bench_creds_parse(app_tls_bench_creds_t *c, bool der)
+{
+  int ret;
+
+  mbedtls_x509_crt_init(&c->cacert);
+  mbedtls_x509_crt_init(&c->clicert);
+  mbedtls_pk_init(&c->pkey);
+  if (der) {
+#ifdef CONFIG_APP_TLS_BENCH_DER
+    ret = mbedtls_x509_crt_parse_der(&c->cacert, aws_root_ca_der_start,
+                                     aws_root_ca_der_end - aws_root_ca_der_start);
+    if (ret == 0) {
+      ret = mbedtls_x509_crt_parse_der(&c->clicert, certificate_der_crt_start,
+                                       certificate_der_crt_end - certificate_der_crt_start);
+    }
+    if (ret == 0) {
+      ret = mbedtls_pk_parse_key(&c->pkey, private_der_key_start,
+                                 private_der_key_end - private_der_key_start, NULL, 0);
+    }
+#else
+    ret = MBEDTLS_ERR_X509_FEATURE_UNAVAILABLE;
+#endif // CONFIG_APP_TLS_BENCH_DER
+  } else {
+    // PEM has to include the terminating NUL
+    ret = mbedtls_x509_crt_parse(&c->cacert, aws_root_ca_pem_start,
+                                 strlen((const char *)aws_root_ca_pem_start) + 1);
+    if (ret == 0) {
+      ret = mbedtls_x509_crt_parse(&c->clicert, certificate_pem_crt_start,
+                                   strlen((const char *)certificate_pem_crt_start) + 1);
+    }
+    if (ret == 0) {
+      ret = mbedtls_pk_parse_key(&c->pkey, private_pem_key_start,
+                                 strlen((const char *)private_pem_key_start) + 1, NULL, 0);
+    }
+  }
+  if (ret != 0) {
+    app_tls_bench_creds_free(c);
+  }
+  return ret;
+}
+
+static int app_tls_bench_handshake(app_tls_bench_creds_t *c, int64_t *us)
+{
+  int ret;
+  char port[8];
+  mbedtls_net_context net;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+
+  mbedtls_net_init(&net);
+  mbedtls_ssl_init(&ssl);
+  mbedtls_ssl_config_init(&conf);
+
+  ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret != 0) {
+    goto exit;
+  }
+  // the stand-in server is self-signed. the chain is still verified, only the result is ignored.
+  mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_OPTIONAL);
+  mbedtls_ssl_conf_ca_chain(&conf, &c->cacert, NULL);
+  mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &s_ctr_drbg);
+  ret = mbedtls_ssl_conf_own_cert(&conf, &c->clicert, &c->pkey);
+  if (ret != 0) {
+    goto exit;
+  }
+  ret = mbedtls_ssl_setup(&ssl, &conf);
+  if (ret != 0) {
+    goto exit;
+  }
+  snprintf(port, sizeof(port), "%d", CONFIG_APP_TLS_BENCH_PORT);
+  ret = mbedtls_net_connect(&net, CONFIG_APP_TLS_BENCH_HOST, port, MBEDTLS_NET_PROTO_TCP);
+  if (ret != 0) {
+    goto exit;
+  }
+  mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+  int64_t start = esp_timer_get_time();
+  do {
+    ret = mbedtls_ssl_handshake(&ssl);
+  } while (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+  *us = esp_timer_get_time() - start;
+  if (ret == 0) {
+    mbedtls_ssl_close_notify(&ssl);
+  }
+
+exit:
+  mbedtls_net_free(&net);
+  mbedtls_ssl_free(&ssl);
+  mbedtls_ssl_config_free(&conf);
+  return ret;
+}
+
+static void app_tls_bench_mode(app_tls_bench_mode_t mode)
+{
+  int ret;
+  int64_t parse_us = 0;
+  int64_t handshake_us = 0;
+  int64_t t;
+  uint32_t ok = 0;
+  bool der = (mode == APP_TLS_BENCH_DER);
+
+  if (mode == APP_TLS_BENCH_CACHED) {
+    t = esp_timer_get_time();
+    ret = app_tls_bench_creds_parse(&s_creds, false);
+    parse_us = esp_timer_get_time() - t;
+    if (ret != 0) {
+      BINLOGE(APP_TLS_BENCH_TAG, "%s: parse failed: -0x%x", s_mode_str[mode], -ret);
+      return;
+    }
+    BINLOGI(APP_TLS_BENCH_TAG, "device key: %s %u bits",
+            mbedtls_pk_get_name(&s_creds.pkey), (uint32_t)mbedtls_pk_get_bitlen(&s_creds.pkey));
+  }
+  for (int i = 0; i < CONFIG_APP_TLS_BENCH_COUNT; i++) {
+    if (mode != APP_TLS_BENCH_CACHED) {
+      t = esp_timer_get_time();
+      ret = app_tls_bench_creds_parse(&s_creds, der);
+      parse_us += esp_timer_get_time() - t;
+      if (ret != 0) {
+        BINLOGE(APP_TLS_BENCH_TAG, "%s: parse failed: -0x%x", s_mode_str[mode], -ret);
+        return;
+      }
+    }
+    ret = app_tls_bench_handshake(&s_creds, &t);
+    if (ret == 0) {
+      handshake_us += t;
+      ok++;
+    } else {
+      BINLOGW(APP_TLS_BENCH_TAG, "%s: handshake failed: -0x%x", s_mode_str[mode], -ret);
+    }
+    if (mode != APP_TLS_BENCH_CACHED) {
+      app_tls_bench_creds_free(&s_creds);
+    }
+  }
+  if (mode == APP_TLS_BENCH_CACHED) {
+    app_tls_bench_creds_free(&s_creds);
+  }
+  BINLOGI(APP_TLS_BENCH_TAG, "%s: parse %u us total, handshake avg %u ms (%u/%u ok)",
+          s_mode_str[mode], (uint32_t)parse_us,
+          (uint32_t)(ok > 0 ? handshake_us / ok / 1000 : 0), ok, CONFIG_APP_TLS_BENCH_COUNT);
+}
+
+void app_tls_bench_run(void)
+{
+  if (s_done) {
+    return;
+  }
+  s_done = true;
+
+  mbedtls_entropy_init(&s_entropy);
+  mbedtls_ctr_drbg_init(&s_ctr_drbg);
+  if (mbedtls_ctr_drbg_seed(&s_ctr_drbg, mbedtls_entropy_func, &s_entropy, NULL, 0) != 0) {
+    BINLOGE(APP_TLS_BENCH_TAG, "ctr_drbg_seed failed");
+    goto exit;
+  }
+  // measured at the frequency the real handshake runs at
+  app_pm_phase(APP_PM_PHASE_COMPUTE);
+  for (int mode = 0; mode < APP_TLS_BENCH_MAX; mode++) {
+#ifndef CONFIG_APP_TLS_BENCH_DER
+    if (mode == APP_TLS_BENCH_DER) {
+      continue;
+    }
+#endif // CONFIG_APP_TLS_BENCH_DER
+    app_tls_bench_mode(mode);
+  }
+
+exit:
+  mbedtls_ctr_drbg_free(&s_ctr_drbg);
+  mbedtls_entropy_free(&s_entropy);
+}
+
+#else
+
+void app_tls_bench_run(void)
+{
+}
+
+#endif // CONFIG_APP_TLS_BENCH
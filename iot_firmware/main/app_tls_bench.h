@@ -0,0 +1,14 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // handshakes with the local stand-in server (tools/tls_bench_server.sh) using the embedded
+  // credentials, once per boot. logs the parse and handshake time of PEM, DER and a CA chain
+  // parsed only once. does nothing without CONFIG_APP_TLS_BENCH.
+  void app_tls_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "driver/i2c.h"
+#include "nvs.h"
+
+#include "esp_pahub.h"
+#include "binlog.h"
+
+#include "main.h"
+#include "app_topology.h"
+
+#define APP_TOPOLOGY_TAG "app_topology"
+
+#define APP_TOPOLOGY_KEY (char*) "TOPOLOGY"
+// changes with the layout of app_topology_t
+#define APP_TOPOLOGY_VERSION 1
+#define APP_TOPOLOGY_PAHUB_ADDR 0x70
+// an absent device does not ACK, so this only bounds a stuck bus
+#define APP_TOPOLOGY_PROBE_TIMEOUT_MS 20
+#define APP_TOPOLOGY_CMD_LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(1)
+
+#ifndef CONFIG_APP_SENSORS_REDISCOVER_ERRORS
+#define CONFIG_APP_SENSORS_REDISCOVER_ERRORS 3
+#endif // CONFIG_APP_SENSORS_REDISCOVER_ERRORS
+#ifndef CONFIG_APP_SENSORS_REDISCOVER_MISSES
+#define CONFIG_APP_SENSORS_REDISCOVER_MISSES 36
+#endif // CONFIG_APP_SENSORS_REDISCOVER_MISSES
+
+typedef struct {
+  // 0 if unknown
+  uint8_t version;
+  uint8_t pahub;
+  // bits of app_topology_device_t per PaHub channel, then APP_TOPOLOGY_TRUNK
+  uint8_t found[APP_TOPOLOGY_PAHUB_CH_MAX + 1];
+} app_topology_t;
+
+static const uint8_t s_addr[APP_TOPOLOGY_DEVICE_MAX] = {
+  [APP_TOPOLOGY_SHT30] = 0x44,
+  [APP_TOPOLOGY_SHT30_ALT] = 0x45,
+  [APP_TOPOLOGY_PBHUB] = 0x61,
+  [APP_TOPOLOGY_BMP280] = 0x76,
+  [APP_TOPOLOGY_BH1750] = 0x23,
+};
+
+// kept in RTC slow memory, so a wake does not read NVS
+static RTC_DATA_ATTR app_topology_t s_topology = {
+  .version = 0,
+};
+// false if discovered before NVS was opened
+static RTC_DATA_ATTR bool s_stored = false;
+static RTC_DATA_ATTR uint8_t s_errors = 0;
+static RTC_DATA_ATTR uint8_t s_misses = 0;
+// the topology in NVS is not loaded, a discovery replaces it
+static RTC_DATA_ATTR bool s_rediscover = false;
+
+static bool app_topology_probe(i2c_port_t port, uint8_t addr)
+{
+  uint8_t link[APP_TOPOLOGY_CMD_LINK_SIZE] = { 0 };
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+  esp_err_t err;
+
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_stop(cmd);
+  err = i2c_master_cmd_begin(port, cmd, pdMS_TO_TICKS(APP_TOPOLOGY_PROBE_TIMEOUT_MS));
+  i2c_cmd_link_delete_static(cmd);
+  return err == ESP_OK;
+}
+
+static uint8_t app_topology_probe_all(i2c_port_t port)
+{
+  uint8_t found = 0;
+
+  for (int i = 0; i < APP_TOPOLOGY_DEVICE_MAX; i++) {
+    if (app_topology_probe(port, s_addr[i])) {
+      found |= 1 << i;
+    }
+  }
+  return found;
+}
+
+static void app_topology_store(nvs_handle_t nvs)
+{
+  esp_err_t err;
+
+  if (nvs == 0) {
+    return;
+  }
+  err = nvs_set_blob(nvs, APP_TOPOLOGY_KEY, &s_topology, sizeof(s_topology));
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs);
+  }
+  BINLOGI(APP_TOPOLOGY_TAG, "topology stored, returns %d", err);
+  s_stored = (err == ESP_OK);
+}
+
+bool app_topology_known(void)
+{
+  return s_topology.version == APP_TOPOLOGY_VERSION;
+}
+
+esp_err_t app_topology_load(nvs_handle_t nvs)
+{
+  app_topology_t t;
+  size_t len = sizeof(t);
+  esp_err_t err;
+
+  if (app_topology_known()) {
+    if (!s_stored) {
+      app_topology_store(nvs);
+    }
+    return ESP_OK;
+  }
+  if (nvs == 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (s_rediscover) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  err = nvs_get_blob(nvs, APP_TOPOLOGY_KEY, &t, &len);
+  if (err != ESP_OK || len != sizeof(t) || t.version != APP_TOPOLOGY_VERSION) {
+    BINLOGI(APP_TOPOLOGY_TAG, "no topology in NVS, returns %d", err);
+    return ESP_ERR_NOT_FOUND;
+  }
+  s_topology = t;
+  s_stored = true;
+  s_errors = 0;
+  s_misses = 0;
+  return ESP_OK;
+}
+
+esp_err_t app_topology_discover(i2c_port_t port, nvs_handle_t nvs)
+{
+  // what NVS holds, if it is stored
+  app_topology_t stored = s_topology;
+
+  memset(&s_topology, 0, sizeof(s_topology));
+  s_topology.pahub = app_topology_probe(port, APP_TOPOLOGY_PAHUB_ADDR);
+  if (s_topology.pahub) {
+    pahub_ch(PAHUB_DISABLE_CH_ALL);
+  }
+  s_topology.found[APP_TOPOLOGY_TRUNK] = app_topology_probe_all(port);
+  BINLOGI(APP_TOPOLOGY_TAG, "pahub %d, trunk 0x%02x",
+          s_topology.pahub, s_topology.found[APP_TOPOLOGY_TRUNK]);
+  if (s_topology.pahub) {
+    for (int ch = 0; ch < APP_TOPOLOGY_PAHUB_CH_MAX; ch++) {
+      if (pahub_ch(1 << ch) != ESP_OK) {
+        continue;
+      }
+      // the trunk answers on every channel
+      s_topology.found[ch] = app_topology_probe_all(port) & ~s_topology.found[APP_TOPOLOGY_TRUNK];
+      BINLOGI(APP_TOPOLOGY_TAG, "pahub ch%d 0x%02x", ch, s_topology.found[ch]);
+    }
+    pahub_ch(PAHUB_DISABLE_CH_ALL);
+  }
+  s_topology.version = APP_TOPOLOGY_VERSION;
+  s_errors = 0;
+  s_misses = 0;
+  s_rediscover = false;
+  // the same devices again, e.g. after misses of sensors which are not connected
+  stored.version = APP_TOPOLOGY_VERSION;
+  if (s_stored && memcmp(&stored, &s_topology, sizeof(s_topology)) == 0) {
+    return ESP_OK;
+  }
+  s_stored = false;
+  app_topology_store(nvs);
+  return ESP_OK;
+}
+
+void app_topology_invalidate(void)
+{
+  s_topology.version = 0;
+  s_stored = false;
+  s_errors = 0;
+  s_misses = 0;
+}
+
+void app_topology_rediscover(void)
+{
+  // NVS is written again only if the devices changed
+  s_topology.version = 0;
+  s_rediscover = true;
+  s_errors = 0;
+  s_misses = 0;
+}
+
+bool app_topology_has_pahub(void)
+{
+  return s_topology.pahub;
+}
+
+bool app_topology_has(uint8_t ch, app_topology_device_t device)
+{
+  if (ch > APP_TOPOLOGY_TRUNK || device >= APP_TOPOLOGY_DEVICE_MAX) {
+    return false;
+  }
+  return (s_topology.found[ch] >> device) & 1;
+}
+
+void app_topology_result(bool ok)
+{
+  if (ok) {
+    s_errors = 0;
+    return;
+  }
+  s_errors++;
+  BINLOGW(APP_TOPOLOGY_TAG, "sensor errors on %d wakes", s_errors);
+  if (s_errors >= CONFIG_APP_SENSORS_REDISCOVER_ERRORS) {
+    app_topology_rediscover();
+  }
+}
+
+void app_topology_missed(bool missed)
+{
+  if (!missed) {
+    s_misses = 0;
+    return;
+  }
+  s_misses++;
+  if (s_misses >= CONFIG_APP_SENSORS_REDISCOVER_MISSES) {
+    BINLOGI(APP_TOPOLOGY_TAG, "sensors of the table not found on %d wakes", s_misses);
+    app_topology_rediscover();
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "driver/i2c.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  // devices probed by app_topology_discover()
+  typedef enum {
+    APP_TOPOLOGY_SHT30 = 0,
+    APP_TOPOLOGY_SHT30_ALT,
+    APP_TOPOLOGY_PBHUB,
+    APP_TOPOLOGY_BMP280,
+    APP_TOPOLOGY_BH1750,
+    APP_TOPOLOGY_DEVICE_MAX
+  } app_topology_device_t;
+
+#define APP_TOPOLOGY_PAHUB_CH_MAX 6
+  // devices on PORT_A itself, in front of the PaHub or without one
+#define APP_TOPOLOGY_TRUNK APP_TOPOLOGY_PAHUB_CH_MAX
+
+  // true if the topology is in RTC memory
+  bool app_topology_known(void);
+  // restores the topology from NVS after power-on, or stores one found before NVS was opened
+  esp_err_t app_topology_load(nvs_handle_t nvs);
+  // probes the known addresses on PORT_A and on each PaHub channel. the I2C driver must be installed.
+  // stored to NVS if nvs is not 0.
+  esp_err_t app_topology_discover(i2c_port_t port, nvs_handle_t nvs);
+  // forgets the topology, it is discovered again on the next app_sensors_proc()
+  void app_topology_invalidate(void);
+  // the same, but NVS is not written if the discovery finds the same devices
+  void app_topology_rediscover(void);
+  bool app_topology_has_pahub(void);
+  // ch is a PaHub channel or APP_TOPOLOGY_TRUNK
+  bool app_topology_has(uint8_t ch, app_topology_device_t device);
+  // counts the wakes with sensor errors. the topology is discovered again after
+  // CONFIG_APP_SENSORS_REDISCOVER_ERRORS of them in a row.
+  void app_topology_result(bool ok);
+  // counts the wakes on which rows of the table had no device, e.g. a sensor connected after
+  // the discovery or missed by it. discovered again after CONFIG_APP_SENSORS_REDISCOVER_MISSES.
+  void app_topology_missed(bool missed);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp32/rom/ets_sys.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+
+#include "binlog.h"
+
+#include "main.h"
+#include "app_wake.h"
+
+#define APP_WAKE_TAG "app_wake"
+
+#ifdef CONFIG_APP_UPLOAD_EVERY_N_WAKES
+#define APP_WAKE_UPLOAD_EVERY_N CONFIG_APP_UPLOAD_EVERY_N_WAKES
+#else
+#define APP_WAKE_UPLOAD_EVERY_N 1
+#endif // CONFIG_APP_UPLOAD_EVERY_N_WAKES
+
+typedef struct {
+  uint64_t last_us;
+  uint64_t total_us;
+  uint32_t count;
+} app_wake_trace_t;
+
+typedef struct {
+  // next/current wake mode, decided by app_wake_decide()
+  uint8_t mode;
+  // number of completed sample-only wakes since the last full cycle
+  uint16_t since_upload;
+  // the next wake is APP_WAKE_MODE_SENSOR
+  bool sensor_next;
+  // RTC slow clock ticks when the wake stub ran
+  uint64_t stub_ticks;
+  app_wake_trace_t trace[APP_WAKE_MODE_MAX];
+} app_wake_state_t;
+
+// kept in RTC slow memory. it survives deep sleep and is readable from the wake stub.
+static RTC_DATA_ATTR app_wake_state_t s_rtc_wake = {
+  .mode = APP_WAKE_MODE_FULL,
+  .since_upload = 0,
+  .sensor_next = false,
+};
+
+static bool s_booted = false;
+static int64_t s_wake_start_us = 0;
+
+// must stay in RTC fast memory: they are called from the deep sleep wake stub
+// before the flash cache is enabled.
+static app_wake_mode_t RTC_IRAM_ATTR app_wake_next(void)
+{
+  if (s_rtc_wake.sensor_next) {
+    return APP_WAKE_MODE_SENSOR;
+  } else if (s_rtc_wake.since_upload + 1 >= APP_WAKE_UPLOAD_EVERY_N) {
+    return APP_WAKE_MODE_FULL;
+  } else {
+    return APP_WAKE_MODE_SAMPLE_ONLY;
+  }
+}
+
+static void RTC_IRAM_ATTR app_wake_decide(void)
+{
+  s_rtc_wake.mode = app_wake_next();
+}
+
+// as rtc_time_get(), which is in IRAM and not loaded yet when the wake stub runs
+static uint64_t RTC_IRAM_ATTR app_wake_rtc_ticks(void)
+{
+  uint64_t ticks;
+
+  SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+  while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_VALID) == 0) {
+    // up to one slow clock period
+    ets_delay_us(1);
+  }
+  SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+  ticks = READ_PERI_REG(RTC_CNTL_TIME0_REG);
+  ticks |= ((uint64_t)READ_PERI_REG(RTC_CNTL_TIME1_REG)) << 32;
+  return ticks;
+}
+
+#if defined(CONFIG_SLEEP_TYPE_DEEP) || defined(CONFIG_SLEEP_TYPE_AUTO)
+// only decides the mode. the stub can not read the sensors, their drivers are in flash, so
+// every wake still runs the bootloader and the start of the app.
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+  s_rtc_wake.stub_ticks = app_wake_rtc_ticks();
+  esp_default_wake_deep_sleep();
+  app_wake_decide();
+}
+#endif // CONFIG_SLEEP_TYPE_DEEP || CONFIG_SLEEP_TYPE_AUTO
+
+// time since the wake stub: the bootloader and the start of the app, before esp_timer started
+static int64_t app_wake_boot_us(void)
+{
+  uint64_t now = app_wake_rtc_ticks();
+
+  if (s_rtc_wake.stub_ticks == 0 || s_rtc_wake.stub_ticks > now) {
+    return 0;
+  }
+  // the calibration of the slow clock, as esp_clk_slowclk_cal_get()
+  return (int64_t)rtc_time_slowclk_to_us(now - s_rtc_wake.stub_ticks,
+                                         REG_READ(RTC_SLOW_CLK_CAL_REG));
+}
+
+app_wake_mode_t app_wake_mode(void)
+{
+  return (app_wake_mode_t) s_rtc_wake.mode;
+}
+
+app_wake_mode_t app_wake_next_mode(void)
+{
+  return app_wake_next();
+}
+
+const char *app_wake_mode_str(app_wake_mode_t mode)
+{
+  switch (mode) {
+  case APP_WAKE_MODE_FULL:
+    return "full";
+  case APP_WAKE_MODE_SAMPLE_ONLY:
+    return "sample-only";
+  case APP_WAKE_MODE_SENSOR:
+    return "sensor";
+  case APP_WAKE_MODE_STREAM:
+    return "stream";
+  default:
+    return "???";
+  }
+}
+
+void app_wake_begin(void)
+{
+  s_wake_start_us = esp_timer_get_time();
+  if (!s_booted) {
+    s_booted = true;
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+      // power on or crash: RTC state can not be trusted, do a full cycle.
+      s_rtc_wake.mode = APP_WAKE_MODE_FULL;
+      s_rtc_wake.since_upload = 0;
+      s_rtc_wake.sensor_next = false;
+    } else {
+      // the wake stub has already decided. the boot since the stub is part of the wake, the
+      // ROM before the stub is not measured.
+      s_wake_start_us -= app_wake_boot_us();
+    }
+    s_rtc_wake.stub_ticks = 0;
+  } else {
+    // woken from light sleep. there is no wake stub.
+    app_wake_decide();
+  }
+#if CONFIG_APP_STREAM
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+    // the wake button
+    s_rtc_wake.mode = APP_WAKE_MODE_STREAM;
+  }
+#endif // CONFIG_APP_STREAM
+  BINLOGI(APP_WAKE_TAG, "wake mode = %s", app_wake_mode_str(app_wake_mode()));
+}
+
+void app_wake_end(void)
+{
+  app_wake_mode_t mode = app_wake_mode();
+  app_wake_trace_t *trace = &s_rtc_wake.trace[mode];
+
+  trace->last_us = esp_timer_get_time() - s_wake_start_us;
+  trace->total_us += trace->last_us;
+  trace->count++;
+  BINLOGI(APP_WAKE_TAG, "wake trace: %s wake took %u ms (avg %u ms over %u wakes)",
+          app_wake_mode_str(mode), (uint32_t)(trace->last_us / 1000),
+          (uint32_t)(trace->total_us / trace->count / 1000), trace->count);
+
+  if (mode == APP_WAKE_MODE_FULL || mode == APP_WAKE_MODE_STREAM) {
+    s_rtc_wake.since_upload = 0;
+  } else if (mode == APP_WAKE_MODE_SAMPLE_ONLY) {
+    s_rtc_wake.since_upload++;
+  }
+}
+
+void app_wake_set_sensor_next(bool sensor)
+{
+  s_rtc_wake.sensor_next = sensor;
+}
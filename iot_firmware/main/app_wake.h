@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+  typedef enum {
+    // sensors + wifi + shadow update
+    APP_WAKE_MODE_FULL = 0,
+    // sensors only, the sample is banked in RTC memory
+    APP_WAKE_MODE_SAMPLE_ONLY,
+    // only the sensors which are due, between the wakes of the period.
+    // the sample is banked, it does not count as a wake of the upload cycle.
+    APP_WAKE_MODE_SENSOR,
+    // a full cycle, then the sensors are streamed for a while. woken by the button.
+    APP_WAKE_MODE_STREAM,
+    APP_WAKE_MODE_MAX
+  } app_wake_mode_t;
+
+  app_wake_mode_t app_wake_mode(void);
+  // mode of the next wake, as app_wake_begin() will decide it. valid after app_wake_end().
+  app_wake_mode_t app_wake_next_mode(void);
+  const char *app_wake_mode_str(app_wake_mode_t mode);
+
+  // called when the cpu starts running after reset or light sleep
+  void app_wake_begin(void);
+  // called just before entering sleep
+  void app_wake_end(void);
+  // true if the next wake is only for a due sensor, decided by app_sched_next_sleep_us()
+  void app_wake_set_sensor_next(bool sensor);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -11,6 +11,7 @@
 #include "esp_task_wdt.h"
 #include "esp_pm.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "driver/rtc_io.h"
 
@@ -22,12 +23,57 @@
 #include "esp_pbhub.h"
 #include "sht30.h"
 #include "hx711.h"
+#include "binlog.h"
+#include "busstat.h"
 
 #include "main.h"
 #include "app_sensors.h"
 #include "app_sleep.h"
+#include "app_wake.h"
+#include "app_bank.h"
+#include "app_log.h"
+#include "app_pm.h"
+#include "app_tls_bench.h"
+#include "app_sched.h"
+#include "app_time.h"
+#include "app_rollup.h"
+#include "app_settings.h"
+#include "app_stream.h"
+#include "app_irrigation.h"
+#include "app_report.h"
 
-#define JSON_BUFFER_MAX_LENGTH 511
+#if APP_SENSORS_JSON_FIELDS_MAX + 6 > APP_REPORT_EXTRA_MAX
+#error "APP_REPORT_EXTRA_MAX has no room for the sensors and the 6 optional objects"
+#endif
+
+#if CONFIG_APP_BANK_TSCODEC
+// base64 of the compressed bank, quoted
+#define JSON_SAMPLES_MAX_LENGTH (4 * ((CONFIG_APP_BANK_TSCODEC_SIZE + 2) / 3) + 3)
+#define JSON_SAMPLES_KEY "samples_z"
+#else
+#define JSON_SAMPLES_MAX_LENGTH (64 * CONFIG_APP_UPLOAD_EVERY_N_WAKES)
+#define JSON_SAMPLES_KEY "samples"
+#endif // CONFIG_APP_BANK_TSCODEC
+#define JSON_SAMPLE_TIMES_MAX_LENGTH (12 + 11 * CONFIG_APP_UPLOAD_EVERY_N_WAKES)
+#define JSON_ROLLUP_MAX_LENGTH 640
+#if CONFIG_APP_SENSORS_POTS > 1
+#define JSON_POTS_MAX_LENGTH (2 + 88 * CONFIG_APP_SENSORS_POTS)
+#else
+#define JSON_POTS_MAX_LENGTH 1
+#endif // CONFIG_APP_SENSORS_POTS > 1
+#if CONFIG_APP_BUS_STATS_REPORT
+// a few devices and channels, the field is left out if they do not fit
+#define JSON_BUS_MAX_LENGTH 512
+#else
+#define JSON_BUS_MAX_LENGTH 1
+#endif // CONFIG_APP_BUS_STATS_REPORT
+#if CONFIG_APP_IRRIGATION
+// 8 events of up to 64 bytes
+#define JSON_IRRIGATION_MAX_LENGTH 520
+#else
+#define JSON_IRRIGATION_MAX_LENGTH 1
+#endif // CONFIG_APP_IRRIGATION
+#define JSON_BUFFER_MAX_LENGTH (559 + JSON_SAMPLES_MAX_LENGTH + JSON_SAMPLE_TIMES_MAX_LENGTH + JSON_ROLLUP_MAX_LENGTH + JSON_POTS_MAX_LENGTH + JSON_BUS_MAX_LENGTH + JSON_IRRIGATION_MAX_LENGTH)
 
 wificlient_config_t wc_config = {
   // .power_save = WIFI_PS_NONE,
@@ -55,30 +101,82 @@ awsclient_config_t awsconfig = {
 };
 
 char jsonDocumentBuffer[JSON_BUFFER_MAX_LENGTH];
+char jsonSamplesBuffer[JSON_SAMPLES_MAX_LENGTH];
+char jsonSampleTimesBuffer[JSON_SAMPLE_TIMES_MAX_LENGTH];
+char jsonRollupBuffer[JSON_ROLLUP_MAX_LENGTH];
+char jsonPotsBuffer[JSON_POTS_MAX_LENGTH];
+char jsonBusBuffer[JSON_BUS_MAX_LENGTH];
+char jsonIrrigationBuffer[JSON_IRRIGATION_MAX_LENGTH];
+
+static volatile IoT_Error_t s_shadow_update_err = FAILURE;
 
-static void app_pm_config(void);
+static void app_shadow_update_done(IoT_Error_t err, void *ctx)
+{
+  s_shadow_update_err = err;
+}
+
+// a sample of the current values goes to the rollup window and/or the bank
+static void app_keep_sample(bool bank)
+{
+#if CONFIG_APP_ROLLUP
+  app_rollup_add();
+#if !CONFIG_APP_ROLLUP_RAW_SAMPLES
+  bank = false;
+#endif // !CONFIG_APP_ROLLUP_RAW_SAMPLES
+#endif // CONFIG_APP_ROLLUP
+  if (bank) {
+    app_bank_push();
+  }
+}
 
 void app_main(void)
 {
   esp_err_t err;
-  ESP_LOGI(TAG, "app_main: started.");
-  err = nvs_flash_init();
-  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-    // NVS partition was truncated and needs to be erased
-    // Retry nvs_flash_init
-    ESP_ERROR_CHECK(nvs_flash_erase());
-    err = nvs_flash_init();
-  }
+  bool initialized = false;
+  app_log_init();
+  BINLOGI(TAG, "app_main: started.");
+  app_sched_boot_wait();
+  app_wake_begin();
+
+  while (true) {
+
+    if (app_wake_mode() != APP_WAKE_MODE_FULL && app_wake_mode() != APP_WAKE_MODE_STREAM) {
+      // only bank a sample. NVS and wifi are not touched.
+      // power management is needed for automatic light sleep during the sensor waits.
+      app_pm_config();
+      app_pm_phase(APP_PM_PHASE_SENSOR);
+      app_sensors_proc();
+      app_irrigation_proc();
+      app_keep_sample(true);
+      app_before_sleep();
+      app_goto_sleep();
+      app_after_wakeup();
+      continue;
+    }
 
-  // Power Mgmt
-  app_pm_config();
+    if (!initialized) {
+      err = nvs_flash_init();
+      if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // NVS partition was truncated and needs to be erased
+        // Retry nvs_flash_init
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+      }
+      // settings into RTC memory, NVS is read once after power-on
+      app_settings_load();
+      wc_config.credentials = &app_settings_get()->wifi;
+      wc_config.store_credentials = app_settings_set_wifi;
 
-  // init app_sensors
-  app_sensors_init();
+      // Power Mgmt
+      app_pm_config();
 
-  while (true) {
+      // init app_sensors
+      app_sensors_init();
+      initialized = true;
+    }
 
     // WIFI
+    app_pm_phase(APP_PM_PHASE_NETWORK);
     esp_err_t rtn;
     uint8_t retry = 0;
     wificlient_deinit();
@@ -94,125 +192,135 @@ void app_main(void)
     if (rtn != ESP_OK) {
       continue;
     }
+    app_tls_bench_run();
+    // SNTP on some connections only. the banked times follow the clock.
+    int64_t time_step = app_time_sync_if_due();
+    app_bank_time_step(time_step);
+    app_rollup_time_step(time_step);
+    app_sensors_time_step(time_step);
 
     // process sensors
+    app_pm_phase(APP_PM_PHASE_SENSOR);
     app_sensors_proc();
+    app_irrigation_proc();
+    uint32_t reading_time = app_time_now_sec();
+    // the current values are reported as they are, not banked
+    app_keep_sample(false);
 
-    char *client_id = CONFIG_AWS_IOT_CLIENT_ID;
-
-    struct jsonStruct device;
-    device.cb = NULL;
-    device.pData = client_id;
-    device.pKey = "client_id";
-    device.dataLength = strlen(client_id);
-    device.type = SHADOW_JSON_STRING;
-    struct jsonStruct waterlevel;
-    waterlevel.cb = NULL;
-    waterlevel.pData = &water_level;
-    waterlevel.dataLength = sizeof(uint16_t);
-    waterlevel.pKey = "water_level";
-    waterlevel.type = SHADOW_JSON_UINT16;
-    struct jsonStruct env_light;
-    env_light.cb = NULL;
-    env_light.pData = &light;
-    env_light.dataLength = sizeof(uint16_t);
-    env_light.pKey = "env_light";
-    env_light.type = SHADOW_JSON_UINT16;
-    struct jsonStruct env_temp;
-    env_temp.cb = NULL;
-    env_temp.pData = &env.temperature;
-    env_temp.dataLength = sizeof(float);
-    env_temp.pKey = "env_temperature";
-    env_temp.type = SHADOW_JSON_FLOAT;
-    struct jsonStruct env_hum;
-    env_hum.cb = NULL;
-    env_hum.pData = &env.humidity;
-    env_hum.dataLength = sizeof(float);
-    env_hum.pKey = "env_humidity";
-    env_hum.type = SHADOW_JSON_FLOAT;
-    struct jsonStruct soil_temp;
-    soil_temp.cb = NULL;
-    soil_temp.pData = &soil.temperature;
-    soil_temp.dataLength = sizeof(float);
-    soil_temp.pKey = "soil_temperature";
-    soil_temp.type = SHADOW_JSON_FLOAT;
-    struct jsonStruct soil_hum;
-    soil_hum.cb = NULL;
-    soil_hum.pData = &soil.humidity;
-    soil_hum.dataLength = sizeof(float);
-    soil_hum.pKey = "soil_humidity";
-    soil_hum.type = SHADOW_JSON_FLOAT;
-    struct jsonStruct scale_value;
-    scale_value.cb = NULL;
-    scale_value.pData = &weight;
-    scale_value.dataLength = sizeof(int32_t);
-    scale_value.pKey = "weight_value";
-    scale_value.type = SHADOW_JSON_INT32;
-    struct jsonStruct scale_zero_offset;
-    uint32_t zero_offset = hx711_get_zero_offset();
-    scale_zero_offset.cb = NULL;
-    scale_zero_offset.pData = &zero_offset;
-    scale_zero_offset.dataLength = sizeof(uint32_t);
-    scale_zero_offset.pKey = "weight_zero_offset";
-    scale_zero_offset.type = SHADOW_JSON_UINT32;
-    struct jsonStruct scale_gain;
-    uint16_t _scale_gain = 27;
-    scale_gain.cb = NULL;
-    scale_gain.pData = &_scale_gain;
-    scale_gain.dataLength = sizeof(uint16_t);
-    scale_gain.pKey = "weight_gain";
-    scale_gain.type = SHADOW_JSON_UINT16;
-    struct jsonStruct scale_lsb;
-    float lsb = weight_lsb;
-    scale_lsb.cb = NULL;
-    scale_lsb.pData = &lsb;
-    scale_lsb.dataLength = sizeof(float);
-    scale_lsb.pKey = "weight_lsb";
-    scale_lsb.type = SHADOW_JSON_FLOAT;
-    struct jsonStruct batt_vol;
-    batt_vol.pKey = "voltage";
-    batt_vol.pData = &dev.bat_vol;
-    batt_vol.dataLength = sizeof(float);
-    batt_vol.type = SHADOW_JSON_FLOAT;
-    batt_vol.cb = NULL;
-    struct jsonStruct batt_cur;
-    batt_cur.pKey = "current";
-    batt_cur.pData = &dev.bat_cur;
-    batt_cur.dataLength = sizeof(float);
-    batt_cur.type = SHADOW_JSON_FLOAT;
-    batt_cur.cb = NULL;
-    struct jsonStruct batt_chrgcur;
-    batt_chrgcur.pKey = "charge_current";
-    batt_chrgcur.pData = &dev.bat_chrg_cur;
-    batt_chrgcur.dataLength = sizeof(float);
-    batt_chrgcur.type = SHADOW_JSON_FLOAT;
-    batt_chrgcur.cb = NULL;
+    app_pm_phase(APP_PM_PHASE_COMPUTE);
 
+    app_report_t report = {
+      .client_id = CONFIG_AWS_IOT_CLIENT_ID,
+      .voltage_mv = dev.bat_mv,
+      .current_ma = dev.bat_ma,
+      .charge_current_ma = dev.bat_chrg_ma,
+      .weight_gain = 27,
+      .weight_zero_offset = hx711_get_zero_offset(),
+      .weight_value = weight,
+      .weight_lsb_e9 = (int32_t)(weight_lsb * 1e9f + 0.5f),
+      .time = reading_time,
+    };
+    // the sensors of app_sensors_table
+    struct jsonStruct sensor_fields[APP_SENSORS_JSON_FIELDS_MAX];
+    size_t sensor_count = app_sensors_json_fields(sensor_fields, APP_SENSORS_JSON_FIELDS_MAX);
+    struct jsonStruct samples;
+    samples.cb = NULL;
+    samples.pData = jsonSamplesBuffer;
+    samples.dataLength = sizeof(jsonSamplesBuffer);
+    samples.pKey = JSON_SAMPLES_KEY;
+    samples.type = SHADOW_JSON_OBJECT;
+    struct jsonStruct samples_time;
+    samples_time.cb = NULL;
+    samples_time.pData = jsonSampleTimesBuffer;
+    samples_time.dataLength = sizeof(jsonSampleTimesBuffer);
+    samples_time.pKey = "samples_time";
+    samples_time.type = SHADOW_JSON_OBJECT;
+    struct jsonStruct rollup;
+    rollup.cb = NULL;
+    rollup.pData = jsonRollupBuffer;
+    rollup.dataLength = sizeof(jsonRollupBuffer);
+    rollup.pKey = "rollup";
+    rollup.type = SHADOW_JSON_OBJECT;
+    struct jsonStruct pots;
+    pots.cb = NULL;
+    pots.pData = jsonPotsBuffer;
+    pots.dataLength = sizeof(jsonPotsBuffer);
+    pots.pKey = "pots";
+    pots.type = SHADOW_JSON_OBJECT;
+    struct jsonStruct bus;
+    bus.cb = NULL;
+    bus.pData = jsonBusBuffer;
+    bus.dataLength = sizeof(jsonBusBuffer);
+    bus.pKey = "bus";
+    bus.type = SHADOW_JSON_OBJECT;
+    struct jsonStruct irrigation;
+    irrigation.cb = NULL;
+    irrigation.pData = jsonIrrigationBuffer;
+    irrigation.dataLength = sizeof(jsonIrrigationBuffer);
+    irrigation.pKey = "irrigation";
+    irrigation.type = SHADOW_JSON_OBJECT;
+    // the sensors and the optional fields
+    for (size_t i = 0; i < sensor_count; i++) {
+      report.extra[report.extra_count++] = &sensor_fields[i];
+    }
+    if (app_bank_count() > 0
+        && app_bank_to_json(jsonSamplesBuffer, sizeof(jsonSamplesBuffer)) == ESP_OK) {
+      report.extra[report.extra_count++] = &samples;
+      // the compressed bank has the times inside
+      if (app_bank_times_to_json(jsonSampleTimesBuffer, sizeof(jsonSampleTimesBuffer)) == ESP_OK) {
+        report.extra[report.extra_count++] = &samples_time;
+      }
+    }
+    if (app_rollup_count() > 0
+        && app_rollup_to_json(jsonRollupBuffer, sizeof(jsonRollupBuffer)) == ESP_OK) {
+      report.extra[report.extra_count++] = &rollup;
+    }
+#if CONFIG_APP_SENSORS_POTS > 1
+    if (app_sensors_pots_to_json(jsonPotsBuffer, sizeof(jsonPotsBuffer)) == ESP_OK) {
+      report.extra[report.extra_count++] = &pots;
+    }
+#endif // CONFIG_APP_SENSORS_POTS > 1
+#if CONFIG_APP_BUS_STATS_REPORT
+    if (busstat_to_json(jsonBusBuffer, sizeof(jsonBusBuffer)) == ESP_OK) {
+      report.extra[report.extra_count++] = &bus;
+    }
+#endif // CONFIG_APP_BUS_STATS_REPORT
+    if (app_irrigation_event_count() > 0
+        && app_irrigation_to_json(jsonIrrigationBuffer, sizeof(jsonIrrigationBuffer)) == ESP_OK) {
+      report.extra[report.extra_count++] = &irrigation;
+    }
     // AWS
     awsclient_shadow_init(&awsconfig);
+    app_log_register(&awsconfig);
+    // acks and deltas are processed by the network task from here on
+    awsclient_start(&awsconfig);
     // create json objects
-    size_t jsonDocumentBufferSize = sizeof(jsonDocumentBuffer)/sizeof(char);
-    aws_iot_shadow_init_json_document(jsonDocumentBuffer,
-                                      jsonDocumentBufferSize);
-
-    aws_iot_shadow_add_reported(jsonDocumentBuffer,
-                                jsonDocumentBufferSize,
-                                14,
-                                &device, &env_temp, &env_hum, &env_light,
-                                &soil_temp, &soil_hum,
-                                &batt_vol, &batt_cur, &batt_chrgcur,
-                                &waterlevel,
-                                &scale_gain, &scale_zero_offset, &scale_value, &scale_lsb);
-    aws_iot_finalize_json_document(jsonDocumentBuffer,
-                                   jsonDocumentBufferSize);
-    ESP_LOGI(TAG, "json = %s", jsonDocumentBuffer);
-    // AWS update shadow
-    awsclient_shadow_update(&awsconfig, jsonDocumentBuffer, jsonDocumentBufferSize);
-    ESP_LOGI(TAG, "awsclient_shadow_update returns %d\n", awsclient_err());
-    if (awsclient_err() == NETWORK_SSL_WRITE_ERROR) {
-      awsclient_shadow_init(&awsconfig);
-      awsclient_shadow_update(&awsconfig, jsonDocumentBuffer, jsonDocumentBufferSize);
-    } else if (awsclient_err() == NETWORK_ERR_NET_UNKNOWN_HOST) {
+    int64_t encode_start = esp_timer_get_time();
+    IoT_Error_t encode_err = app_report_encode(jsonDocumentBuffer, sizeof(jsonDocumentBuffer),
+                                               &report);
+    if (encode_err != SUCCESS) {
+      BINLOGE(TAG, "app_report_encode returns %d", encode_err);
+    }
+    BINLOGI(TAG, "json: %u bytes, encoded in %d us", (uint32_t) strlen(jsonDocumentBuffer),
+            (int32_t)(esp_timer_get_time() - encode_start));
+    ESP_LOGD(TAG, "json = %s", jsonDocumentBuffer);
+    // AWS update shadow. the delivery is confirmed by the ack before sleep.
+    s_shadow_update_err = FAILURE;
+    awsclient_shadow_update_async(jsonDocumentBuffer, app_shadow_update_done, NULL);
+    awsclient_flush(pdMS_TO_TICKS(CONFIG_APP_SHADOW_ACK_WAIT_MS));
+    BINLOGI(TAG, "shadow update returns %d", s_shadow_update_err);
+    if (s_shadow_update_err == SUCCESS) {
+      app_bank_clear();
+      app_rollup_reset();
+      app_irrigation_clear();
+      app_log_upload_if_requested(&awsconfig);
+    }
+    if (app_wake_mode() == APP_WAKE_MODE_STREAM) {
+      // MQTT stays connected for the session
+      app_stream_run(&awsconfig);
+    }
+    awsclient_stop();
+    if (awsclient_err() == NETWORK_ERR_NET_UNKNOWN_HOST) {
       wificlient_deinit();
       vTaskDelay(pdMS_TO_TICKS(1000));
       wificlient_init(&wc_config);
@@ -220,6 +328,7 @@ void app_main(void)
 
     awsclient_shadow_deinit(&awsconfig);
     wificlient_deinit();
+    app_pm_phase(APP_PM_PHASE_IDLE);
 
     // before sleep
     app_before_sleep();
@@ -229,27 +338,3 @@ void app_main(void)
     app_after_wakeup();
   }
 }
-
-static void app_pm_config(void)
-{
-#if CONFIG_PM_ENABLE
-  // Configure dynamic frequency scaling:
-  // maximum and minimum frequencies are set in sdkconfig,
-  // automatic light sleep is enabled if tickless idle support is enabled.
-#if CONFIG_IDF_TARGET_ESP32
-  esp_pm_config_esp32_t pm_config = {
-#elif CONFIG_IDF_TARGET_ESP32S2
-  esp_pm_config_esp32s2_t pm_config = {
-#elif CONFIG_IDF_TARGET_ESP32C3
-  esp_pm_config_esp32c3_t pm_config = {
-#endif
-    .max_freq_mhz = CONFIG_EXAMPLE_MAX_CPU_FREQ_MHZ,
-    .min_freq_mhz = CONFIG_EXAMPLE_MIN_CPU_FREQ_MHZ,
-#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
-    .light_sleep_enable = true
-#endif
-  };
-  ESP_ERROR_CHECK( esp_pm_configure(&pm_config) );
-#endif // CONFIG_PM_ENABLE
-}
-
@@ -13,3 +13,10 @@ extern const uint8_t certificate_pem_crt_start[] asm("_binary_certificate_pem_cr
 extern const uint8_t certificate_pem_crt_end[] asm("_binary_certificate_pem_crt_end");
 extern const uint8_t private_pem_key_start[] asm("_binary_private_pem_key_start");
 extern const uint8_t private_pem_key_end[] asm("_binary_private_pem_key_end");
+// embedded with CONFIG_APP_TLS_BENCH_DER, see tools/certs_to_der.sh
+extern const uint8_t aws_root_ca_der_start[] asm("_binary_aws_root_ca_der_start");
+extern const uint8_t aws_root_ca_der_end[] asm("_binary_aws_root_ca_der_end");
+extern const uint8_t certificate_der_crt_start[] asm("_binary_certificate_der_crt_start");
+extern const uint8_t certificate_der_crt_end[] asm("_binary_certificate_der_crt_end");
+extern const uint8_t private_der_key_start[] asm("_binary_private_der_key_start");
+extern const uint8_t private_der_key_end[] asm("_binary_private_der_key_end");
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Prints the acquisition makespan of a sensor topology with the scheduler of main/app_acq.c.
+
+The jobs are read from s_jobs of main/app_sensors.c, with the constants of its #defines and of
+components/sht30/include/sht30.h: the battery on the PMU I2C, the SHT30s and PbHub channels of
+the table on PORT_A and the HX711 reads. A job starts when its rails are stable, its warm-up is
+over and its bus is free, like app_acq_plan(). The serial time is the same jobs one after the
+other, like app_acq_plan_serial(), and the legacy time is the firmware before the scheduler,
+which waited for the 5V rail once more for the PaHub, read each SHT30 5 times 500 ms apart and
+polled the HX711. That firmware is not in the tree anymore, so its constants are kept here.
+
+    python tools/acq_sim.py --pots 3 --pahub --pbhub --hx711-reads 10
+    python tools/acq_sim.py --rail stable --sps 80
+"""
+import argparse
+import os
+import re
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+APP_SENSORS_C = os.path.join(ROOT, 'main', 'app_sensors.c')
+SHT30_H = os.path.join(ROOT, 'components', 'sht30', 'include', 'sht30.h')
+
+# the firmware before the scheduler
+LEGACY_HX711_POLL_MS = 100
+LEGACY_SHT30_READS = 5
+LEGACY_SHT30_READ_MS = 500
+
+# data rate of the planned time of the hx711 job
+PLANNED_SPS = 10
+
+DEFINE = re.compile(r'^#define\s+(\w+)\s+\(?\s*(\d+)\s*\)?\s*$', re.M)
+JOB = re.compile(r'\.name\s*=\s*"(\w+)",\s*\.rails\s*=\s*([^,]+),\s*\.bus\s*=\s*APP_ACQ_BUS_(\w+),'
+                 r'\s*\.warmup_ms\s*=\s*([^,]+),\s*\.planned_ms\s*=\s*([^,]+),')
+EXPR = re.compile(r'^[\w\s()+*/-]+$')
+
+
+class Job(object):
+    def __init__(self, name, rail, bus, warmup_ms, planned_ms):
+        self.name = name
+        self.rail = rail
+        self.bus = bus
+        self.warmup_ms = warmup_ms
+        self.planned_ms = planned_ms
+
+
+def c_defines(*paths):
+    defines = {}
+    for path in paths:
+        with open(path) as f:
+            defines.update((k, int(v)) for k, v in DEFINE.findall(f.read()))
+    return defines
+
+
+def c_eval(expr, defines):
+    if not EXPR.match(expr):
+        raise ValueError('not a constant expression: %s' % expr)
+    return int(eval(expr, {'__builtins__': {}}, defines))
+
+
+def c_jobs(defines):
+    with open(APP_SENSORS_C) as f:
+        src = f.read()
+    table = src[src.index('s_jobs[] = {'):]
+    table = table[:table.index('\n};')]
+    jobs = []
+    for name, rails, bus, warmup, planned in JOB.findall(table):
+        jobs.append(Job(name, rails.strip() != '0', bus.lower(), c_eval(warmup, defines),
+                        c_eval(planned, defines)))
+    if not jobs:
+        raise ValueError('no job in s_jobs of %s' % APP_SENSORS_C)
+    return jobs
+
+
+def jobs_of(args, defines):
+    rows = args.pots * (2 if args.pbhub else 1) + (1 if args.pbhub else 0)
+    defines = dict(defines, APP_SENSORS_HX711_READS=args.hx711_reads)
+    jobs = []
+    for job in c_jobs(defines):
+        if job.bus == 'port_a':
+            # added by app_sensors_run()
+            job.planned_ms += rows * defines['APP_SENSORS_ROW_IO_MS']
+        elif job.bus == 'hx711':
+            if args.hx711_reads == 0:
+                continue
+            job.planned_ms = int(job.planned_ms * PLANNED_SPS / args.sps)
+        jobs.append(job)
+    return jobs
+
+
+def plan(jobs, settle_ms):
+    bus_free = {}
+    timeline = []
+    for job in jobs:
+        start = (settle_ms if job.rail else 0) + job.warmup_ms
+        start = max(start, bus_free.get(job.bus, 0))
+        end = start + job.planned_ms
+        bus_free[job.bus] = end
+        timeline.append((job, start, end))
+    return timeline
+
+
+def serial(jobs, settle_ms):
+    return settle_ms + sum(job.warmup_ms + job.planned_ms for job in jobs)
+
+
+def legacy(jobs, args, settle_ms, defines):
+    # the PaHub waited for its own 1 s after the PMU, each SHT30 (the environment and the soil
+    # of each pot) was read 5 times with 500 ms between, the HX711 was polled every 100 ms
+    t = serial(jobs, settle_ms)
+    if args.pahub:
+        t += defines['APP_SENSORS_RAIL_SETTLE_MS']
+        sht30s = 1 + args.pots
+        t += sht30s * LEGACY_SHT30_READS * LEGACY_SHT30_READ_MS
+    for job in jobs:
+        if job.bus == 'hx711':
+            t += (args.hx711_reads + 1) * LEGACY_HX711_POLL_MS - job.planned_ms
+    return t
+
+
+def main():
+    p = argparse.ArgumentParser(description='acquisition makespan of a topology')
+    p.add_argument('--pots', type=int, default=1, help='APP_SENSORS_POTS')
+    p.add_argument('--pahub', action='store_true', help='SHT30s behind a PaHub')
+    p.add_argument('--pbhub', action='store_true', help='light and water level on a PbHub')
+    p.add_argument('--hx711-reads', type=int, default=None,
+                   help='0 without a scale, APP_SENSORS_HX711_READS by default')
+    p.add_argument('--sps', type=float, default=PLANNED_SPS, help='HX711 data rate, 10 or 80')
+    p.add_argument('--rail', choices=('cold', 'stable'), default='cold',
+                   help='stable if the 5V rail is retained in light sleep')
+    args = p.parse_args()
+
+    defines = c_defines(APP_SENSORS_C, SHT30_H)
+    if args.hx711_reads is None:
+        args.hx711_reads = defines['APP_SENSORS_HX711_READS']
+    settle_ms = defines['APP_SENSORS_RAIL_SETTLE_MS'] if args.rail == 'cold' else 0
+    jobs = jobs_of(args, defines)
+    timeline = plan(jobs, settle_ms)
+    for job, start, end in timeline:
+        print('%-8s %-9s from %5d ms for %5d ms' % (job.name, job.bus, start, end - start))
+    makespan = max(end for _, _, end in timeline)
+    print('makespan %d ms, serial %d ms, legacy %d ms'
+          % (makespan, serial(jobs, settle_ms), legacy(jobs, args, settle_ms, defines)))
+
+
+if __name__ == '__main__':
+    main()
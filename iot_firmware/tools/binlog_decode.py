@@ -0,0 +1,109 @@
+#!/usr/bin/env python
+#
+# Decode a binlog dump with the format strings stored in the firmware ELF.
+#
+#   python tools/binlog_decode.py build/iot_firmware.elf dump.bin
+#
+# The dump is the payload published on "be_bonsai/<thing name>/binlog".
+# Several dumps can be concatenated into one file.
+#
+# Requires pyelftools (installed with ESP-IDF python requirements).
+
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+DUMP_MAGIC = 0x31474c42
+REC_MAGIC = 0xb1
+REC_HDR_WORDS = 4
+LEVELS = {1: 'E', 2: 'W', 3: 'I', 4: 'D', 5: 'V'}
+CONV = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXcsfFeEgGp%])')
+
+
+class Strings(object):
+    def __init__(self, elf_path):
+        self.sections = []
+        with open(elf_path, 'rb') as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if sec['sh_addr'] == 0 or sec['sh_type'] == 'SHT_NOBITS':
+                    continue
+                self.sections.append((sec['sh_addr'], sec.data()))
+
+    def get(self, addr):
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b'\0', addr - base)
+                return data[addr - base:end].decode('utf-8', 'replace')
+        return '<0x%08x>' % addr
+
+
+def format_record(strings, fmt, args):
+    args = list(args)
+    out = []
+    pos = 0
+    for m in CONV.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, conv = m.group(1), m.group(3)
+        if conv == '%':
+            out.append('%')
+            continue
+        v = args.pop(0) if args else 0
+        if conv in 'di':
+            v = struct.unpack('<i', struct.pack('<I', v))[0]
+        elif conv in 'fFeEgG':
+            v = struct.unpack('<f', struct.pack('<I', v))[0]
+        elif conv == 's':
+            v = strings.get(v)
+        elif conv == 'p':
+            conv, v = 'x', v
+            flags = '#' + flags
+        out.append(('%' + flags + conv) % v)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(strings, data, out):
+    words = struct.unpack('<%dI' % (len(data) // 4), data[:len(data) // 4 * 4])
+    i = 0
+    while i < len(words):
+        w = words[i]
+        if w == DUMP_MAGIC:
+            if i + 1 < len(words) and words[i + 1]:
+                out.write('--- %d records dropped\n' % words[i + 1])
+            i += 2
+            continue
+        if (w >> 24) != REC_MAGIC:
+            i += 1
+            continue
+        level = (w >> 20) & 0x0f
+        nargs = (w >> 16) & 0x0f
+        boot = w & 0xffff
+        if i + REC_HDR_WORDS + nargs > len(words):
+            break
+        tag = strings.get(words[i + 1])
+        fmt = strings.get(words[i + 2])
+        ts = words[i + 3]
+        args = words[i + REC_HDR_WORDS:i + REC_HDR_WORDS + nargs]
+        out.write('%s [%d] (%d) %s: %s\n' % (LEVELS.get(level, '?'), boot, ts, tag,
+                                            format_record(strings, fmt, args)))
+        i += REC_HDR_WORDS + nargs
+
+
+def main():
+    parser = argparse.ArgumentParser(description='decode binlog dump')
+    parser.add_argument('elf', help='firmware ELF file (build/iot_firmware.elf)')
+    parser.add_argument('dump', help='binlog dump file')
+    args = parser.parse_args()
+
+    strings = Strings(args.elf)
+    with open(args.dump, 'rb') as f:
+        decode(strings, f.read(), sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
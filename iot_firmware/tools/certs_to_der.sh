@@ -0,0 +1,9 @@
+#!/bin/sh
+# Converts the PEM credentials in main/certs to DER for CONFIG_APP_TLS_BENCH_DER.
+#   sh tools/certs_to_der.sh
+set -e
+cd "$(dirname "$0")/../main/certs"
+openssl x509 -in aws-root-ca.pem -outform DER -out aws-root-ca.der
+openssl x509 -in certificate.pem.crt -outform DER -out certificate.der.crt
+openssl pkey -in private.pem.key -outform DER -out private.der.key
+ls -l aws-root-ca.der certificate.der.crt private.der.key
@@ -0,0 +1,17 @@
+#!/bin/sh
+# Creates an ECDSA P-256 device key and a CSR. Signing with P-256 is much faster than
+# RSA-2048 at low cpu frequencies. Register the CSR with AWS IoT:
+#   sh tools/ecdsa_csr.sh <thing name>
+#   aws iot create-certificate-from-csr --set-as-active \
+#     --certificate-signing-request file://main/certs/device.csr \
+#     --query certificatePem --output text > main/certs/certificate.pem.crt
+# then attach the certificate to the thing and its policy.
+set -e
+if [ -z "$1" ]; then
+  echo "usage: $0 <thing name>" >&2
+  exit 1
+fi
+cd "$(dirname "$0")/../main/certs"
+openssl ecparam -name prime256v1 -genkey -noout -out private.pem.key
+openssl req -new -key private.pem.key -subj "/CN=$1" -out device.csr
+echo "created main/certs/private.pem.key and main/certs/device.csr"
@@ -0,0 +1,484 @@
+#!/usr/bin/env python3
+"""Fleet load simulator for the reporting path.
+
+Simulated devices wake on the schedule of main/app_sched.c, connect over TCP (optionally TLS)
+and replay the MQTT packets of a report by components/awsclient: CONNECT, the eight shadow
+subscriptions of awsclient_shadow_subscribe_topics() (QoS1, one SUBACK at a time), the
+update/accepted and update/rejected subscriptions the SDK adds for the ack of
+aws_iot_shadow_update() (QoS0), the shadow update built like main.c with QoS1, the wait for
+update/accepted, and DISCONNECT. It reports the latency percentiles of each step, the packets
+per report and the CPU usage of the broker process.
+
+This is a Python replay of that sequence, not awsclient itself. The SDK ships a linux platform
+port, but awsclient runs on FreeRTOS tasks and ESP-IDF services (esp_log, the TLS arena) and
+is not built for the host here, so a change to awsclient has to be mirrored in device() below.
+The payload is built in Python by default. With --report-gen it is encoded by main/app_report.c
+and the JSON encoder of the SDK, built for the host as tools/report_gen.c (see its header):
+
+    python tools/fleet_sim.py run --port 1883 --payload batch --report-gen ./report_gen
+The client TLS is Python's OpenSSL, not mbedTLS, so the handshake cost on the broker side is
+comparable but the device side is not. Keep-alive pings, reconnects and the retries of the SDK
+are not modelled.
+
+A minimal broker stand-in is included, for when no MQTT broker is at hand:
+
+    python tools/fleet_sim.py broker --port 1883 &
+    python tools/fleet_sim.py run --port 1883 --devices 1000 --broker-pid $!
+
+With TLS (e.g. certificates made by tools/tls_bench_server.sh or for mosquitto):
+
+    python tools/fleet_sim.py broker --port 8883 --cert server.pem --key server.key &
+    python tools/fleet_sim.py run --port 8883 --tls --cafile server.pem --devices 500
+
+The period is scaled by --time-scale, the network work is not. Compare payloads with
+--payload single|batch and schedules with --policy fixed|slotted.
+"""
+import argparse
+import asyncio
+import json
+import os
+import random
+import ssl
+import struct
+import subprocess
+import sys
+import time
+
+from wake_sim import fnv1a
+
+MQTT_CONNECT = 0x10
+MQTT_CONNACK = 0x20
+MQTT_PUBLISH = 0x30
+MQTT_PUBACK = 0x40
+MQTT_SUBSCRIBE = 0x82
+MQTT_SUBACK = 0x90
+MQTT_PINGREQ = 0xc0
+MQTT_DISCONNECT = 0xe0
+
+# awsclient_shadow_subscribe_topics(), in order, all QoS1
+SHADOW_TOPICS = ("delete/accepted", "delete/rejected", "get/accepted", "get/rejected",
+                 "update/accepted", "update/rejected", "update/delta", "update/documents")
+# subscribed again by aws_iot_shadow_update() to get its ack, QoS0
+SHADOW_ACK_TOPICS = ("update/accepted", "update/rejected")
+
+
+def mqtt_remaining_length(n):
+    out = bytearray()
+    while True:
+        b = n % 128
+        n //= 128
+        out.append(b | (0x80 if n > 0 else 0))
+        if n == 0:
+            return bytes(out)
+
+
+def mqtt_string(s):
+    b = s.encode()
+    return struct.pack(">H", len(b)) + b
+
+
+def mqtt_packet(ptype, body):
+    return bytes([ptype]) + mqtt_remaining_length(len(body)) + body
+
+
+async def mqtt_read_packet(reader):
+    header = (await reader.readexactly(1))[0]
+    n = 0
+    shift = 0
+    while True:
+        b = (await reader.readexactly(1))[0]
+        n |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            break
+    body = await reader.readexactly(n) if n > 0 else b""
+    return header, body
+
+
+def shadow_document(rng, client_id, seq, samples, report_gen=None):
+    # the fields of main.c, fixed-point. encoded by the firmware's encoder with --report-gen
+    reported = {
+        "client_id": client_id,
+        "env_temperature_x100": rng.randrange(1500, 3000),
+        "env_humidity_x100": rng.randrange(3000, 8000),
+        "env_light": rng.randrange(4096),
+        "soil_temperature_x100": rng.randrange(1500, 2500),
+        "soil_humidity_x100": rng.randrange(2000, 6000),
+        "voltage_mv": rng.randrange(3700, 4200),
+        "current_ma": rng.randrange(50, 200),
+        "charge_current_ma": 0,
+        "water_level": rng.randrange(4096),
+        "weight_gain": 27,
+        "weight_zero_offset": 8388608,
+        "weight_value": rng.randrange(-1000, 100000),
+        "weight_lsb_e9": 1000000,
+        "time": int(time.time()),
+    }
+    if samples > 0:
+        reported["samples"] = [
+            [rng.randrange(1500, 3000), rng.randrange(3000, 8000),
+             rng.randrange(1500, 2500), rng.randrange(2000, 6000),
+             rng.randrange(4096), rng.randrange(4096), rng.randrange(100000)]
+            for _ in range(samples)]
+        reported["samples_time"] = [int(time.time()) - 600 * samples] + [600] * (samples - 1)
+    if report_gen is not None:
+        return report_gen.encode(reported)
+    doc = {"state": {"reported": reported}, "clientToken": "%s-%d" % (client_id, seq)}
+    return json.dumps(doc, separators=(",", ":")).encode()
+
+
+class ReportGen:
+    """Encodes the reports with main/app_report.c, through tools/report_gen.c."""
+
+    def __init__(self, path):
+        self.proc = subprocess.Popen([path], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def encode(self, reported):
+        fields = [reported["client_id"]]
+        for key, value in reported.items():
+            if key != "client_id":
+                fields.append("%s=%s" % (key, json.dumps(value, separators=(",", ":"))))
+        self.proc.stdin.write((" ".join(fields) + "\n").encode())
+        self.proc.stdin.flush()
+        doc = self.proc.stdout.readline().rstrip(b"\n")
+        if not doc:
+            raise RuntimeError("report_gen exits with %s" % self.proc.wait())
+        return doc
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+class Stats:
+    def __init__(self):
+        self.connect = []
+        self.subscribe = []
+        self.puback = []
+        self.accepted = []
+        self.failures = 0
+        self.bytes = 0
+        self.packets = 0
+        self.active = 0
+        self.peak_active = 0
+
+
+class Session:
+    """MQTT client side of one connection, counts the packets both ways."""
+
+    def __init__(self, reader, writer, timeout):
+        self.reader = reader
+        self.writer = writer
+        self.timeout = timeout
+        self.packets = 0
+        self.pid = 0
+        self.received = set()
+
+    def next_pid(self):
+        self.pid = self.pid % 0xffff + 1
+        return self.pid
+
+    def send(self, ptype, body):
+        self.writer.write(mqtt_packet(ptype, body))
+        self.packets += 1
+
+    async def expect(self, ptype, pid=None, topic=None):
+        # the messages of the subscriptions arrive in between, QoS1 ones are acknowledged
+        if ptype == MQTT_PUBLISH and topic in self.received:
+            return None
+        while True:
+            header, body = await asyncio.wait_for(mqtt_read_packet(self.reader), self.timeout)
+            self.packets += 1
+            if header & 0xf0 == MQTT_PUBLISH:
+                topic_len = struct.unpack(">H", body[:2])[0]
+                if (header >> 1) & 0x03:
+                    self.send(MQTT_PUBACK, body[2 + topic_len:4 + topic_len])
+                received = body[2:2 + topic_len].decode()
+                if ptype == MQTT_PUBLISH and received == topic:
+                    return body
+                self.received.add(received)
+                continue
+            if header != ptype:
+                raise ConnectionError("expected %02x, got %02x %s" % (ptype, header, body.hex()))
+            if pid is not None and struct.unpack(">H", body[:2])[0] != pid:
+                raise ConnectionError("packet id %s, expected %d" % (body[:2].hex(), pid))
+            return body
+
+    async def subscribe(self, topic, qos):
+        pid = self.next_pid()
+        self.send(MQTT_SUBSCRIBE, struct.pack(">H", pid) + mqtt_string(topic) + bytes([qos]))
+        body = await self.expect(MQTT_SUBACK, pid)
+        if body[2] & 0x80:
+            raise ConnectionError("SUBACK %s refused" % topic)
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def next_wake(args, slot, now, rng):
+    # main/app_sched.c, in simulated seconds
+    if args.policy == "fixed":
+        return now + args.period
+    jitter_max = min(args.jitter, args.slot_width / 2)
+    target = now - (now % args.period) + slot * args.slot_width + rng.uniform(-jitter_max, jitter_max)
+    while target < now + 1.0:
+        target += args.period
+    return target
+
+
+async def device(args, index, stats, start, ssl_ctx, report_gen):
+    rng = random.Random(args.seed * 100003 + index)
+    client_id = "pot-%05d" % index
+    slots = max(1, int(args.period // args.slot_width))
+    slot = fnv1a(client_id) % slots
+    shadow = "$aws/things/%s/shadow/" % client_id
+    # power-on of the whole fleet at once
+    sim_t = rng.uniform(0, 0.5)
+    if args.policy == "slotted":
+        boot_slots = int(args.boot_spread // args.slot_width)
+        if boot_slots > 1:
+            sim_t += (slot % boot_slots) * args.slot_width + rng.uniform(0, args.jitter)
+    seq = 0
+    while True:
+        if sim_t / args.time_scale > args.duration:
+            return
+        wait = start + sim_t / args.time_scale - time.monotonic()
+        if wait > 0:
+            await asyncio.sleep(wait)
+        seq += 1
+        samples = args.batch if args.payload == "batch" else 0
+        payload = shadow_document(rng, client_id, seq, samples, report_gen)
+        stats.active += 1
+        stats.peak_active = max(stats.peak_active, stats.active)
+        writer = None
+        try:
+            t0 = time.monotonic()
+            reader, writer = await asyncio.wait_for(
+                asyncio.open_connection(args.host, args.port, ssl=ssl_ctx), args.timeout)
+            session = Session(reader, writer, args.timeout)
+            connect = mqtt_string("MQTT") + bytes([4, 0x02]) + struct.pack(">H", 60) + mqtt_string(client_id)
+            session.send(MQTT_CONNECT, connect)
+            body = await session.expect(MQTT_CONNACK)
+            if len(body) < 2 or body[1] != 0:
+                raise ConnectionError("CONNACK %s" % body.hex())
+            t1 = time.monotonic()
+            if args.subscriptions == "firmware":
+                for name in SHADOW_TOPICS:
+                    await session.subscribe(shadow + name, 1)
+                if args.log_upload:
+                    # aws_iot_shadow_register_delta() of app_log.c
+                    await session.subscribe(shadow + "update/delta", 0)
+                for name in SHADOW_ACK_TOPICS:
+                    await session.subscribe(shadow + name, 0)
+            t2 = time.monotonic()
+            pid = session.next_pid()
+            session.send(MQTT_PUBLISH | 0x02, mqtt_string(shadow + "update") + struct.pack(">H", pid) + payload)
+            await session.expect(MQTT_PUBACK, pid)
+            t3 = time.monotonic()
+            if args.subscriptions == "firmware":
+                # the update is done for awsclient when the ack arrives
+                await session.expect(MQTT_PUBLISH, topic=shadow + "update/accepted")
+            t4 = time.monotonic()
+            session.send(MQTT_DISCONNECT, b"")
+            await writer.drain()
+            stats.connect.append(t1 - t0)
+            stats.subscribe.append(t2 - t1)
+            stats.puback.append(t3 - t2)
+            stats.accepted.append(t4 - t2)
+            stats.bytes += len(payload)
+            stats.packets += session.packets
+        except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError, ConnectionError, ssl.SSLError):
+            stats.failures += 1
+        finally:
+            stats.active -= 1
+            if writer is not None:
+                writer.close()
+        # the awake time is real, the sleep is scaled
+        sim_t += (time.monotonic() - t0) * args.time_scale
+        sim_t = next_wake(args, slot, sim_t, rng)
+
+
+def cpu_seconds(pid):
+    try:
+        with open("/proc/%d/stat" % pid) as f:
+            fields = f.read().rsplit(")", 1)[1].split()
+        # utime and stime
+        return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+    except (OSError, IndexError, ValueError):
+        return None
+
+
+async def run(args):
+    ssl_ctx = None
+    if args.tls:
+        ssl_ctx = ssl.create_default_context(cafile=args.cafile)
+        ssl_ctx.check_hostname = False
+        if not args.cafile:
+            ssl_ctx.verify_mode = ssl.CERT_NONE
+        if args.cert:
+            ssl_ctx.load_cert_chain(args.cert, args.key)
+    stats = Stats()
+    cpu0 = cpu_seconds(args.broker_pid) if args.broker_pid else None
+    report_gen = ReportGen(args.report_gen) if args.report_gen else None
+    start = time.monotonic()
+    try:
+        await asyncio.gather(*(device(args, i, stats, start, ssl_ctx, report_gen) for i in range(args.devices)))
+    finally:
+        if report_gen is not None:
+            report_gen.close()
+    elapsed = time.monotonic() - start
+    cpu1 = cpu_seconds(args.broker_pid) if args.broker_pid else None
+
+    n = len(stats.connect)
+    print("devices %d, policy %s, payload %s, %.1f s" % (args.devices, args.policy, args.payload, elapsed))
+    print("reports %d, failures %d, peak concurrent %d, avg payload %d bytes, %.1f packets per report"
+          % (n, stats.failures, stats.peak_active, stats.bytes // n if n else 0,
+             stats.packets / n if n else 0))
+    steps = [("connect", stats.connect), ("puback", stats.puback)]
+    if args.subscriptions == "firmware":
+        steps[1:1] = [("subscribe", stats.subscribe)]
+        steps.append(("accepted", stats.accepted))
+    for name, values in steps:
+        print("%-9s p50 %7.1f ms  p90 %7.1f ms  p99 %7.1f ms  max %7.1f ms"
+              % (name, percentile(values, 50) * 1000, percentile(values, 90) * 1000,
+                 percentile(values, 99) * 1000, max(values, default=0) * 1000))
+    if cpu0 is not None and cpu1 is not None:
+        print("broker cpu %.1f %%" % ((cpu1 - cpu0) / elapsed * 100))
+
+
+def shadow_response(topic, payload, version):
+    # the documents of AWS IoT for an accepted update, without the metadata
+    thing = topic.split("/")[2]
+    try:
+        doc = json.loads(payload)
+    except ValueError:
+        return [("$aws/things/%s/shadow/update/rejected" % thing,
+                 json.dumps({"code": 400, "message": "Payload contains invalid json"}).encode())]
+    now = int(time.time())
+    accepted = {"state": doc.get("state", {}), "metadata": {}, "version": version, "timestamp": now}
+    if "clientToken" in doc:
+        accepted["clientToken"] = doc["clientToken"]
+    documents = {"previous": None, "current": {"state": doc.get("state", {}), "version": version},
+                 "timestamp": now}
+    return [("$aws/things/%s/shadow/update/accepted" % thing, json.dumps(accepted).encode()),
+            ("$aws/things/%s/shadow/update/documents" % thing, json.dumps(documents).encode())]
+
+
+async def broker_client(reader, writer):
+    # accepts everything: CONNACK, SUBACK, PUBACK for QoS1, PINGRESP, and answers shadow
+    # updates on the accepted and documents topics of the connection if it subscribed to them
+    subscriptions = {}
+    pid = 0
+    version = 0
+    try:
+        while True:
+            header, body = await mqtt_read_packet(reader)
+            ptype = header & 0xf0
+            if ptype == MQTT_CONNECT:
+                writer.write(mqtt_packet(MQTT_CONNACK, b"\x00\x00"))
+            elif header == MQTT_SUBSCRIBE:
+                granted = bytearray()
+                pos = 2
+                while pos < len(body):
+                    topic_len = struct.unpack(">H", body[pos:pos + 2])[0]
+                    topic = body[pos + 2:pos + 2 + topic_len].decode()
+                    qos = min(body[pos + 2 + topic_len], 1)
+                    # the same filter again replaces the subscription
+                    subscriptions[topic] = qos
+                    granted.append(qos)
+                    pos += 3 + topic_len
+                writer.write(mqtt_packet(MQTT_SUBACK, body[:2] + bytes(granted)))
+            elif ptype == MQTT_PUBLISH:
+                qos = (header >> 1) & 0x03
+                topic_len = struct.unpack(">H", body[:2])[0]
+                topic = body[2:2 + topic_len].decode()
+                payload = body[2 + topic_len + (2 if qos > 0 else 0):]
+                if qos > 0:
+                    writer.write(mqtt_packet(MQTT_PUBACK, body[2 + topic_len:4 + topic_len]))
+                if topic.startswith("$aws/things/") and topic.endswith("/shadow/update"):
+                    version += 1
+                    for out_topic, out_payload in shadow_response(topic, payload, version):
+                        if out_topic not in subscriptions:
+                            continue
+                        if subscriptions[out_topic] > 0:
+                            pid = pid % 0xffff + 1
+                            writer.write(mqtt_packet(MQTT_PUBLISH | 0x02, mqtt_string(out_topic)
+                                                     + struct.pack(">H", pid) + out_payload))
+                        else:
+                            writer.write(mqtt_packet(MQTT_PUBLISH, mqtt_string(out_topic) + out_payload))
+            elif ptype == MQTT_PINGREQ:
+                writer.write(b"\xd0\x00")
+            elif ptype == MQTT_DISCONNECT:
+                break
+            await writer.drain()
+    except (asyncio.IncompleteReadError, OSError):
+        pass
+    finally:
+        writer.close()
+
+
+async def broker(args):
+    ssl_ctx = None
+    if args.cert:
+        ssl_ctx = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+        ssl_ctx.load_cert_chain(args.cert, args.key)
+    server = await asyncio.start_server(broker_client, args.host, args.port, ssl=ssl_ctx, backlog=4096)
+    print("broker stand-in on %s:%d (pid %d)" % (args.host, args.port, os.getpid()), flush=True)
+    async with server:
+        await server.serve_forever()
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="command", required=True)
+
+    b = sub.add_parser("broker", help="run the broker stand-in")
+    b.add_argument("--host", default="127.0.0.1")
+    b.add_argument("--port", type=int, default=1883)
+    b.add_argument("--cert", help="server certificate (PEM) to enable TLS")
+    b.add_argument("--key", help="server key (PEM)")
+
+    r = sub.add_parser("run", help="run the simulated fleet")
+    r.add_argument("--host", default="127.0.0.1")
+    r.add_argument("--port", type=int, default=1883)
+    r.add_argument("--tls", action="store_true")
+    r.add_argument("--cafile", help="CA of the broker. not verified if omitted")
+    r.add_argument("--cert", help="device certificate (PEM)")
+    r.add_argument("--key", help="device key (PEM)")
+    r.add_argument("--devices", type=int, default=100)
+    r.add_argument("--duration", type=float, default=60.0, help="real seconds")
+    r.add_argument("--time-scale", type=float, default=60.0, help="simulated seconds per real second")
+    r.add_argument("--period", type=float, default=600.0, help="SLEEP_TIMER_TIMEOUT [s]")
+    r.add_argument("--policy", choices=("fixed", "slotted"), default="slotted")
+    r.add_argument("--slot-width", type=float, default=5.0, help="APP_WAKE_SLOT_WIDTH_MS [s]")
+    r.add_argument("--jitter", type=float, default=1.0, help="APP_WAKE_JITTER_MS [s]")
+    r.add_argument("--boot-spread", type=float, default=60.0, help="APP_WAKE_BOOT_SPREAD_MS [s]")
+    r.add_argument("--payload", choices=("single", "batch"), default="single")
+    r.add_argument("--batch", type=int, default=6, help="banked samples per report with --payload batch")
+    r.add_argument("--report-gen", help="tools/report_gen.c binary to encode the shadow update like the firmware")
+    r.add_argument("--subscriptions", choices=("firmware", "none"), default="firmware",
+                   help="subscribe to the shadow topics as awsclient does, or only publish")
+    r.add_argument("--log-upload", action="store_true",
+                   help="also subscribe to update/delta, as with APP_LOG_UPLOAD_ON_REQUEST")
+    r.add_argument("--timeout", type=float, default=10.0)
+    r.add_argument("--broker-pid", type=int, help="pid of the broker to measure its cpu usage")
+    r.add_argument("--seed", type=int, default=1)
+
+    args = p.parse_args()
+    if args.command == "broker":
+        asyncio.run(broker(args))
+    else:
+        if args.devices > 500 and sys.platform != "win32":
+            import resource
+            soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+            resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+        asyncio.run(run(args))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,174 @@
+/*
+ * Runs components/irrigation against simulated pots on the host.
+ *
+ *   cc -Icomponents/irrigation/include components/irrigation/irrigation.c \
+ *      tools/irrigation_sim.c -o irrigation_sim
+ *   ./irrigation_sim [-v] [scenario]
+ *
+ * Each scenario simulates a pot for a few days, steps the controller like the firmware does
+ * (every wake, every poll_ms while the pump runs) and checks the events and the dose limits.
+ * The exit status is non-zero if a check fails.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "irrigation.h"
+
+#define SIM_WAKE_MS (600 * 1000)
+#define SIM_DAYS 3
+
+typedef struct {
+  const char *name;
+  // water in the soil [g] and its level reading at 0 and at capacity
+  double water;
+  double capacity;
+  double level_dry;
+  double level_wet;
+  // level reading does not go above this, e.g. a sensor placed too high
+  double level_clip;
+  // pump flow [g/s], 0 for an empty reservoir
+  double flow;
+  // loss [g/h] by the plant and evaporation
+  double uptake;
+  // the sensors fail from this time [ms] while pumping, 0 for never
+  uint32_t fail_ms;
+  // expected first stop event
+  irrigation_event_t expect;
+} sim_pot_t;
+
+static const irrigation_config_t s_config = {
+  .level_on = 1200,
+  .level_off = 2400,
+  .uptake_start = 150,
+  .dose_max_ms = 60 * 1000,
+  .dose_max_weight = 250,
+  .watchdog_ms = 10 * 1000,
+  .level_response = 50,
+  .weight_response = 20,
+  .soak_ms = 30 * 60 * 1000,
+  .poll_ms = 500,
+};
+
+static const sim_pot_t s_pots[] = {
+  {
+    .name = "dry", .water = 150, .capacity = 600, .level_dry = 400, .level_wet = 3600,
+    .level_clip = 4095, .flow = 8, .uptake = 6, .expect = IRRIGATION_EVENT_STOP_LEVEL,
+  },
+  {
+    // the level does not reach level_off, the weight limits the dose
+    .name = "dose", .water = 100, .capacity = 600, .level_dry = 400, .level_wet = 3600,
+    .level_clip = 2000, .flow = 8, .uptake = 6, .expect = IRRIGATION_EVENT_STOP_DOSE,
+  },
+  {
+    .name = "empty", .water = 100, .capacity = 600, .level_dry = 400, .level_wet = 3600,
+    .level_clip = 4095, .flow = 0, .uptake = 6, .expect = IRRIGATION_EVENT_STOP_WATCHDOG,
+  },
+  {
+    .name = "sensor", .water = 100, .capacity = 600, .level_dry = 400, .level_wet = 3600,
+    .level_clip = 4095, .flow = 8, .uptake = 6, .fail_ms = 5000,
+    .expect = IRRIGATION_EVENT_STOP_SENSOR,
+  },
+  {
+    // a coarse level sensor which stays above level_on, the uptake starts the dose
+    .name = "uptake", .water = 400, .capacity = 600, .level_dry = 1800, .level_wet = 2600,
+    .level_clip = 4095, .flow = 8, .uptake = 6, .expect = IRRIGATION_EVENT_STOP_LEVEL,
+  },
+};
+
+static bool s_verbose = false;
+
+static int sim_run(const sim_pot_t *pot)
+{
+  irrigation_t ctl;
+  irrigation_input_t in;
+  double water = pot->water;
+  uint32_t now = 0;
+  uint32_t start = 0;
+  irrigation_event_t first = IRRIGATION_EVENT_NONE;
+  int starts = 0;
+  int failures = 0;
+
+  irrigation_init(&ctl, &s_config);
+  while (now < SIM_DAYS * 24 * 3600 * 1000u) {
+    irrigation_event_t e;
+    uint32_t step;
+    double level = pot->level_dry + (pot->level_wet - pot->level_dry) * water / pot->capacity;
+
+    in.now_ms = now;
+    in.level = (int32_t)((level < pot->level_clip) ? level : pot->level_clip);
+    // the pot without water weighs 1000 g
+    in.weight = (int32_t)(1000 + water);
+    in.valid = !(pot->fail_ms > 0 && irrigation_pump_on(&ctl) && now - start >= pot->fail_ms);
+    e = irrigation_step(&ctl, &in);
+    if (e != IRRIGATION_EVENT_NONE) {
+      if (s_verbose || e != IRRIGATION_EVENT_START) {
+        printf("  %7.2f h  %-13s level %4d weight %5d", now / 3600000.0,
+               irrigation_event_str(e), in.level, in.weight);
+        if (e != IRRIGATION_EVENT_START) {
+          printf("  dose %u ms %d g", ctl.dose_ms, ctl.dose_weight);
+        }
+        printf("\n");
+      }
+      if (e == IRRIGATION_EVENT_START) {
+        start = now;
+        starts++;
+      } else {
+        if (first == IRRIGATION_EVENT_NONE) {
+          first = e;
+        }
+        if (ctl.dose_ms > s_config.dose_max_ms + s_config.poll_ms) {
+          printf("  FAIL: dose of %u ms\n", ctl.dose_ms);
+          failures++;
+        }
+        if (ctl.dose_weight > s_config.dose_max_weight + pot->flow * s_config.poll_ms / 1000) {
+          printf("  FAIL: dose of %d g\n", ctl.dose_weight);
+          failures++;
+        }
+      }
+    }
+    step = irrigation_pump_on(&ctl) ? irrigation_poll_ms(&ctl) : SIM_WAKE_MS;
+    if (irrigation_pump_on(&ctl)) {
+      water += pot->flow * step / 1000;
+    }
+    water -= pot->uptake * step / 3600000;
+    if (water < 0) {
+      water = 0;
+    } else if (water > pot->capacity) {
+      water = pot->capacity;
+    }
+    now += step;
+  }
+  if (first != pot->expect) {
+    printf("  FAIL: first stop %s, expected %s\n", irrigation_event_str(first),
+           irrigation_event_str(pot->expect));
+    failures++;
+  }
+  if (pot->expect == IRRIGATION_EVENT_STOP_WATCHDOG && starts != 1) {
+    printf("  FAIL: %d starts after the fault\n", starts - 1);
+    failures++;
+  }
+  printf("%s: %d doses, %s\n", pot->name, starts, failures ? "FAIL" : "ok");
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  const char *only = NULL;
+  int failures = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      s_verbose = true;
+    } else {
+      only = argv[i];
+    }
+  }
+  for (size_t i = 0; i < sizeof(s_pots) / sizeof(s_pots[0]); i++) {
+    if (only == NULL || strcmp(only, s_pots[i].name) == 0) {
+      failures += sim_run(&s_pots[i]);
+    }
+  }
+  return failures ? 1 : 0;
+}
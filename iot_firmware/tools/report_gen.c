@@ -0,0 +1,128 @@
+/*
+ * Encodes shadow reports on the host with main/app_report.c and the JSON encoder of the SDK,
+ * for tools/fleet_sim.py --report-gen.
+ *
+ *   SDK=components/esp-aws-iot/aws-iot-device-sdk-embedded-C
+ *   cc -Imain -I$SDK/include -I$SDK/external_libs/jsmn -I$SDK/samples/linux/shadow_sample \
+ *      main/app_report.c $SDK/src/aws_iot_shadow_json.c $SDK/src/aws_iot_json_utils.c \
+ *      $SDK/external_libs/jsmn/jsmn.c tools/report_gen.c -o report_gen
+ *
+ * Reads a report per line from stdin and writes its document as one line to stdout:
+ *
+ *   <client id> voltage_mv=4100 time=1700000000 env_temperature_x100=2150 samples=[[...]]
+ *
+ * The fields of app_report_t are taken by their key, the others are added in their order as
+ * the sensor fields and the objects of main.c: a value which starts with [, { or " is added
+ * as it is, like the buffers of app_bank, the others as integers. The bank, the rollup and the
+ * sensor table keep their state in RTC memory and are not built here, so fleet_sim passes
+ * their output.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_json_data.h"
+
+#include "app_report.h"
+
+#define REPORT_LINE_MAX 16384
+#define REPORT_DOC_MAX 16384
+
+// the prefix of the client token. the SDK sets it in aws_iot_shadow_connect(), which needs the
+// MQTT client and is not linked here.
+char mqttClientID[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES];
+
+static char s_line[REPORT_LINE_MAX];
+static char s_doc[REPORT_DOC_MAX];
+static struct jsonStruct s_extra[APP_REPORT_EXTRA_MAX];
+static int32_t s_values[APP_REPORT_EXTRA_MAX];
+
+static int report_fixed(app_report_t *r, const char *key, const char *value)
+{
+  long v = strtol(value, NULL, 10);
+
+  if (strcmp(key, "voltage_mv") == 0) {
+    r->voltage_mv = (uint16_t) v;
+  } else if (strcmp(key, "current_ma") == 0) {
+    r->current_ma = (uint16_t) v;
+  } else if (strcmp(key, "charge_current_ma") == 0) {
+    r->charge_current_ma = (uint16_t) v;
+  } else if (strcmp(key, "weight_gain") == 0) {
+    r->weight_gain = (uint16_t) v;
+  } else if (strcmp(key, "weight_zero_offset") == 0) {
+    r->weight_zero_offset = (uint32_t) strtoul(value, NULL, 10);
+  } else if (strcmp(key, "weight_value") == 0) {
+    r->weight_value = (int32_t) v;
+  } else if (strcmp(key, "weight_lsb_e9") == 0) {
+    r->weight_lsb_e9 = (int32_t) v;
+  } else if (strcmp(key, "time") == 0) {
+    r->time = (uint32_t) strtoul(value, NULL, 10);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+static int report_extra(app_report_t *r, char *key, char *value)
+{
+  struct jsonStruct *f;
+
+  if (r->extra_count >= APP_REPORT_EXTRA_MAX) {
+    return -1;
+  }
+  f = &s_extra[r->extra_count];
+  f->cb = NULL;
+  f->pKey = key;
+  if (value[0] == '[' || value[0] == '{' || value[0] == '"') {
+    f->pData = value;
+    f->dataLength = strlen(value) + 1;
+    f->type = SHADOW_JSON_OBJECT;
+  } else {
+    s_values[r->extra_count] = (int32_t) strtol(value, NULL, 10);
+    f->pData = &s_values[r->extra_count];
+    f->dataLength = sizeof(int32_t);
+    f->type = SHADOW_JSON_INT32;
+  }
+  r->extra[r->extra_count++] = f;
+  return 0;
+}
+
+int main(void)
+{
+  while (fgets(s_line, sizeof(s_line), stdin) != NULL) {
+    app_report_t r = { 0 };
+    char *save = NULL;
+    char *tok;
+    IoT_Error_t err;
+
+    s_line[strcspn(s_line, "\n")] = '\0';
+    tok = strtok_r(s_line, " ", &save);
+    if (tok == NULL) {
+      continue;
+    }
+    r.client_id = tok;
+    snprintf(mqttClientID, sizeof(mqttClientID), "%s", tok);
+    while ((tok = strtok_r(NULL, " ", &save)) != NULL) {
+      char *eq = strchr(tok, '=');
+      if (eq == NULL) {
+        fprintf(stderr, "no value: %s\n", tok);
+        return 1;
+      }
+      *eq = '\0';
+      if (!report_fixed(&r, tok, eq + 1) && report_extra(&r, tok, eq + 1) != 0) {
+        fprintf(stderr, "more than %d extra fields\n", APP_REPORT_EXTRA_MAX);
+        return 1;
+      }
+    }
+    err = app_report_encode(s_doc, sizeof(s_doc), &r);
+    if (err != SUCCESS) {
+      fprintf(stderr, "app_report_encode returns %d\n", err);
+      return 1;
+    }
+    printf("%s\n", s_doc);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Local stand-in for the AWS IoT endpoint for CONFIG_APP_TLS_BENCH.
+# The server requests the client certificate, so the device signs with its key.
+#   sh tools/tls_bench_server.sh [rsa|ec] [port]
+set -e
+TYPE=${1:-ec}
+PORT=${2:-8443}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+case "$TYPE" in
+  rsa) openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=tls-bench" \
+         -keyout "$DIR/key.pem" -out "$DIR/cert.pem" 2>/dev/null ;;
+  ec)  openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 1 \
+         -subj "/CN=tls-bench" -keyout "$DIR/key.pem" -out "$DIR/cert.pem" 2>/dev/null ;;
+  *)   echo "usage: $0 [rsa|ec] [port]" >&2; exit 1 ;;
+esac
+echo "listening on $PORT with a $TYPE server certificate"
+openssl s_server -accept "$PORT" -cert "$DIR/cert.pem" -key "$DIR/key.pem" -verify 1 -naccept 1000 -quiet
@@ -0,0 +1,302 @@
+#!/usr/bin/env python
+#
+# Decoder and benchmark of the time series codec (components/tscodec).
+#
+#   python tools/tscodec.py decode shadow.json      # "samples_z" of a shadow update
+#   python tools/tscodec.py decode --base64 AQcAAAAA...
+#   python tools/tscodec.py bench trace.csv         # or --synth N
+#
+# A trace is a CSV with a header: time (seconds since epoch) followed by the fields of
+# the bank (BANK_FIELDS). The bench compares the sizes of the raw RTC struct, the json of
+# app_bank_to_json() and the codec, and the encode time of this python port. The encode
+# time on the device is in the "banked sample" binlog record.
+
+import argparse
+import base64
+import csv
+import json
+import math
+import random
+import struct
+import sys
+import time
+
+VERSION = 1
+INT = 0
+FLOAT = 1
+DOD_BITS = (0, 7, 9, 12, 32)
+DELTA_BITS = (0, 6, 12, 20, 32)
+NO_WINDOW = 0xff
+
+# layout of main/app_bank.c: name, type, scale of the fixed-point value
+BANK_FIELDS = (
+    ('env_temperature', INT, 100),
+    ('env_humidity', INT, 100),
+    ('soil_temperature', INT, 100),
+    ('soil_humidity', INT, 100),
+    ('env_light', INT, 1),
+    ('water_level', INT, 1),
+    ('weight_value', INT, 1),
+)
+
+
+def zigzag(v):
+    return ((v << 1) ^ (v >> 31)) & 0xffffffff
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def s32(v):
+    v &= 0xffffffff
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def clz(v):
+    return 32 - v.bit_length()
+
+
+def ctz(v):
+    return (v & -v).bit_length() - 1
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.bits = []
+
+    def put(self, v, n):
+        for i in range(n - 1, -1, -1):
+            self.bits.append((v >> i) & 1)
+
+    def to_bytes(self):
+        out = bytearray((len(self.bits) + 7) // 8)
+        for i, b in enumerate(self.bits):
+            if b:
+                out[i // 8] |= 0x80 >> (i % 8)
+        return bytes(out)
+
+
+class BitReader(object):
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def get(self, n):
+        v = 0
+        for _ in range(n):
+            if self.pos // 8 >= len(self.data):
+                raise ValueError('truncated')
+            v = (v << 1) | ((self.data[self.pos // 8] >> (7 - self.pos % 8)) & 1)
+            self.pos += 1
+        return v
+
+
+def put_class(w, classes, zz):
+    for i, bits in enumerate(classes):
+        last = i == len(classes) - 1
+        if not last and (zz >> bits) != 0:
+            continue
+        w.put((1 << i) - 1, i)
+        if not last:
+            w.put(0, 1)
+        w.put(zz, bits)
+        return
+
+
+def get_class(r, classes):
+    i = 0
+    while i < len(classes) - 1 and r.get(1) == 1:
+        i += 1
+    return r.get(classes[i])
+
+
+def float_bits(f):
+    return struct.unpack('<I', struct.pack('<f', f))[0]
+
+
+def bits_float(u):
+    return struct.unpack('<f', struct.pack('<I', u))[0]
+
+
+def encode(types, samples):
+    """samples: [(t, [int value or float bits, ...]), ...]"""
+    w = BitWriter()
+    prev_t = prev_dt = 0
+    prev_v = [0] * len(types)
+    lead = [NO_WINDOW] * len(types)
+    trail = [0] * len(types)
+    for n, (t, values) in enumerate(samples):
+        if n == 0:
+            w.put(t, 32)
+        else:
+            dt = s32(t - prev_t)
+            put_class(w, DOD_BITS, zigzag(s32(dt - prev_dt)))
+            prev_dt = dt
+        prev_t = t
+        for i, v in enumerate(values):
+            v &= 0xffffffff
+            if types[i] == FLOAT:
+                x = v ^ prev_v[i]
+                if x == 0:
+                    w.put(0, 1)
+                elif lead[i] != NO_WINDOW and clz(x) >= lead[i] and ctz(x) >= trail[i]:
+                    w.put(2, 2)
+                    w.put(x >> trail[i], 32 - lead[i] - trail[i])
+                else:
+                    lead[i], trail[i] = clz(x), ctz(x)
+                    length = 32 - lead[i] - trail[i]
+                    w.put(3, 2)
+                    w.put(lead[i], 5)
+                    w.put(length - 1, 5)
+                    w.put(x >> trail[i], length)
+            else:
+                put_class(w, DELTA_BITS, zigzag(s32(v - prev_v[i])))
+            prev_v[i] = v
+    header = bytes([VERSION, len(types)] + list(types)) + struct.pack('<H', len(samples))
+    return header + w.to_bytes()
+
+
+def decode(data):
+    if len(data) < 4 or data[0] != VERSION:
+        raise ValueError('not a tscodec v%d buffer' % VERSION)
+    nfields = data[1]
+    types = list(data[2:2 + nfields])
+    count = struct.unpack('<H', data[2 + nfields:4 + nfields])[0]
+    r = BitReader(data[4 + nfields:])
+    t = dt = 0
+    v = [0] * nfields
+    lead = [0] * nfields
+    trail = [0] * nfields
+    out = []
+    for n in range(count):
+        if n == 0:
+            t = r.get(32)
+        else:
+            dt += unzigzag(get_class(r, DOD_BITS))
+            t = (t + dt) & 0xffffffff
+        for i in range(nfields):
+            if types[i] == FLOAT:
+                if r.get(1) == 0:
+                    x = 0
+                elif r.get(1) == 0:
+                    x = r.get(32 - lead[i] - trail[i]) << trail[i]
+                else:
+                    lead[i] = r.get(5)
+                    length = r.get(5) + 1
+                    trail[i] = 32 - lead[i] - length
+                    x = r.get(length) << trail[i]
+                v[i] ^= x
+            else:
+                v[i] = (v[i] + unzigzag(get_class(r, DELTA_BITS))) & 0xffffffff
+        out.append((t, [bits_float(x) if types[i] == FLOAT else s32(x) for i, x in enumerate(v)]))
+    return types, out
+
+
+def bank_values(row):
+    return [int(round(float(row[name]) * scale)) if typ == INT else float_bits(float(row[name]))
+            for name, typ, scale in BANK_FIELDS]
+
+
+def load_trace(path):
+    with open(path) as f:
+        rows = list(csv.DictReader(f))
+    return [(int(float(row['time'])), row) for row in rows]
+
+
+def synth_trace(n, seed=1):
+    # 10 min period, a diurnal cycle and sensor noise
+    rng = random.Random(seed)
+    t = 1700000000
+    weight = 52000
+    trace = []
+    for i in range(n):
+        t += 600 + rng.choice((-1, 0, 0, 0, 1))
+        day = math.sin(2 * math.pi * (t % 86400) / 86400)
+        weight -= rng.randrange(0, 20)
+        if weight < 40000:
+            weight = 52000
+        trace.append((t, {
+            'env_temperature': '%.2f' % (22 + 4 * day + rng.gauss(0, 0.05)),
+            'env_humidity': '%.2f' % (55 - 10 * day + rng.gauss(0, 0.2)),
+            'soil_temperature': '%.2f' % (20 + 2 * day + rng.gauss(0, 0.03)),
+            'soil_humidity': '%.2f' % (40 - (i % 144) * 0.05 + rng.gauss(0, 0.1)),
+            'env_light': str(max(0, int(2000 * day + rng.gauss(0, 20)))),
+            'water_level': str(1800 - i % 500 + rng.randrange(-2, 3)),
+            'weight_value': str(weight + rng.randrange(-30, 31)),
+        }))
+    return trace
+
+
+def bench(trace, batch):
+    types = [typ for _, typ, _ in BANK_FIELDS]
+    raw = json_size = z = 0
+    encode_s = 0.0
+    for start in range(0, len(trace), batch):
+        chunk = trace[start:start + batch]
+        samples = [(t, bank_values(row)) for t, row in chunk]
+        t0 = time.perf_counter()
+        data = encode(types, samples)
+        encode_s += time.perf_counter() - t0
+        if decode(data)[1] != [(t, v) for t, v in samples]:
+            raise SystemExit('round trip failed at sample %d' % start)
+        z += len(data)
+        # app_bank_sample_t
+        raw += 20 * len(chunk)
+        # app_bank_to_json() and app_bank_times_to_json()
+        arrays = ','.join('[%s]' % ','.join(str(v) for v in bank_values(row)) for _, row in chunk)
+        times = [chunk[0][0]] + [chunk[i][0] - chunk[i - 1][0] for i in range(1, len(chunk))]
+        json_size += len('"samples":[%s],"samples_time":%s' % (arrays, json.dumps(times, separators=(',', ':'))))
+    n = len(trace)
+    b64 = z * 4 // 3
+    print('samples %d, batch %d' % (n, batch))
+    print('raw struct   %7d bytes  %6.2f bytes/sample' % (raw, raw / n))
+    print('json         %7d bytes  %6.2f bytes/sample' % (json_size, json_size / n))
+    print('tscodec      %7d bytes  %6.2f bytes/sample  ratio %.1fx raw, %.1fx json (base64 %.1fx)'
+          % (z, z / n, raw / z, json_size / z, json_size / b64))
+    print('encode (python) %.1f us/sample' % (encode_s / n * 1e6))
+
+
+def main():
+    p = argparse.ArgumentParser(description='tscodec decoder and benchmark')
+    sub = p.add_subparsers(dest='command', required=True)
+    d = sub.add_parser('decode', help='decode a buffer')
+    d.add_argument('file', nargs='?', help='shadow update json or binary buffer')
+    d.add_argument('--base64', help='buffer as base64')
+    b = sub.add_parser('bench', help='compression ratio and encode time')
+    b.add_argument('trace', nargs='?', help='CSV trace')
+    b.add_argument('--synth', type=int, help='use a synthetic trace of N samples')
+    b.add_argument('--batch', type=int, default=16, help='samples per buffer (bank size)')
+    args = p.parse_args()
+
+    if args.command == 'decode':
+        if args.base64:
+            data = base64.b64decode(args.base64)
+        else:
+            with open(args.file, 'rb') as f:
+                data = f.read()
+            if data[:1] == b'{':
+                doc = json.loads(data)
+                reported = doc.get('state', {}).get('reported', doc)
+                data = base64.b64decode(reported['samples_z'])
+        types, samples = decode(data)
+        bank = len(types) == len(BANK_FIELDS) and all(
+            typ == f[1] for typ, f in zip(types, BANK_FIELDS))
+        if bank:
+            print('time,' + ','.join(f[0] for f in BANK_FIELDS))
+        for t, values in samples:
+            if bank:
+                values = [v / f[2] if f[2] != 1 else v for v, f in zip(values, BANK_FIELDS)]
+            print('%d,%s' % (t, ','.join(str(v) for v in values)))
+    else:
+        if args.synth:
+            trace = synth_trace(args.synth)
+        elif args.trace:
+            trace = load_trace(args.trace)
+        else:
+            sys.exit('a trace or --synth N is required')
+        bench(trace, args.batch)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Simulates the wake times of a fleet and prints the peak number of concurrent connections.
+
+Compares a fixed sleep period with the slotted schedule of main/app_sched.c after all devices
+were powered on at the same moment (e.g. after a power outage).
+
+    python tools/wake_sim.py --fleet 10 100 1000 --slot-width 5 --jitter 1
+"""
+import argparse
+import random
+
+PERIOD_S = 600.0
+
+
+def fnv1a(s):
+    h = 2166136261
+    for c in s.encode():
+        h ^= c
+        h = (h * 16777619) & 0xffffffff
+    return h
+
+
+def awake_time(rng, args):
+    # association, DHCP, TLS and MQTT. long tail from retries.
+    return rng.lognormvariate(0, args.awake_sigma) * args.awake
+
+
+def fixed_schedule(rng, args, device):
+    # sleeps a fixed period after every cycle, starting right after power-on
+    t = rng.uniform(0, args.boot_spread_hw)
+    for _ in range(args.cycles):
+        d = awake_time(rng, args)
+        yield t, t + d
+        t += d + args.period
+
+
+def slotted_schedule(rng, args, device):
+    slots = max(1, int(args.period // args.slot_width))
+    slot = fnv1a(device) % slots
+    jitter_max = min(args.jitter, args.slot_width / 2)
+    boot_slots = int(args.boot_spread // args.slot_width)
+    t = rng.uniform(0, args.boot_spread_hw)
+    # app_sched_boot_wait()
+    if boot_slots > 1:
+        t += (slot % boot_slots) * args.slot_width + rng.uniform(0, args.jitter)
+    for _ in range(args.cycles):
+        d = awake_time(rng, args)
+        yield t, t + d
+        # app_sched_next_sleep_us()
+        now = t + d
+        target = now - (now % args.period) + slot * args.slot_width + rng.uniform(-jitter_max, jitter_max)
+        while target < now + 1.0:
+            target += args.period
+        t = target
+
+
+def peak_concurrency(intervals):
+    events = []
+    for start, end in intervals:
+        events.append((start, 1))
+        events.append((end, -1))
+    # ends before starts at the same time
+    events.sort(key=lambda e: (e[0], e[1]))
+    peak = n = 0
+    for _, delta in events:
+        n += delta
+        peak = max(peak, n)
+    return peak
+
+
+def simulate(schedule, fleet, args):
+    rng = random.Random(args.seed)
+    intervals = []
+    for i in range(fleet):
+        intervals.extend(schedule(rng, args, "pot-%04d" % i))
+    return peak_concurrency(intervals)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--fleet", type=int, nargs="+", default=[10, 50, 100, 250, 500, 1000, 2000])
+    p.add_argument("--period", type=float, default=PERIOD_S, help="SLEEP_TIMER_TIMEOUT [s]")
+    p.add_argument("--slot-width", type=float, default=5.0, help="APP_WAKE_SLOT_WIDTH_MS [s]")
+    p.add_argument("--jitter", type=float, default=1.0, help="APP_WAKE_JITTER_MS [s]")
+    p.add_argument("--boot-spread", type=float, default=60.0, help="APP_WAKE_BOOT_SPREAD_MS [s]")
+    p.add_argument("--boot-spread-hw", type=float, default=0.5, help="spread of the power-on itself [s]")
+    p.add_argument("--awake", type=float, default=4.0, help="median awake time of a full cycle [s]")
+    p.add_argument("--awake-sigma", type=float, default=0.4)
+    p.add_argument("--cycles", type=int, default=6)
+    p.add_argument("--seed", type=int, default=1)
+    args = p.parse_args()
+
+    print("%8s %10s %10s %10s" % ("fleet", "fixed", "slotted", "no jitter"))
+    for fleet in args.fleet:
+        fixed = simulate(fixed_schedule, fleet, args)
+        slotted = simulate(slotted_schedule, fleet, args)
+        jitter = args.jitter
+        args.jitter = 0.0
+        no_jitter = simulate(slotted_schedule, fleet, args)
+        args.jitter = jitter
+        print("%8d %10d %10d %10d" % (fleet, fixed, slotted, no_jitter))
+
+
+if __name__ == "__main__":
+    main()